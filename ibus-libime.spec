@@ -13,12 +13,10 @@ BuildRequires:  g++
 BuildRequires:  cmake
 BuildRequires:  ibus-devel
 BuildRequires:  libime-devel
-BuildRequires:  glibmm2.4-devel
 BuildRequires:  fcitx5-devel
 Requires:       ibus
 Requires:       libime
 Requires:       libime-data
-Requires:       glibmm2.4
 Requires:       fcitx5-libs
 
 %description
@@ -41,6 +39,13 @@ ibus-libime is an ibus front-end for libime.
 %files
 %{_datadir}/ibus/component/libime.xml
 %{_libexecdir}/ibus-engine-libime
+%{_libexecdir}/ibus-libime-decoded
+%{_bindir}/ibus-libime-flight-decode
+%{_bindir}/ibus-libime-s2t
+%{_bindir}/ibus-libime-english
+%{_bindir}/ibus-libime-abbrev
+%{_bindir}/ibus-libime-dict
+%{_bindir}/ibus-libime-history
 %license LICENSE
 %doc README.md
 
@@ -0,0 +1,55 @@
+#include "abbreviation_index.h"
+
+#include "configs.h"
+#include "logger.h"
+
+AbbreviationIndex::AbbreviationIndex()
+    : enabled_(Config::getInstance().getAbbreviationEnabled()),
+      path_(Config::getInstance().getAbbreviationIndexPath()) {}
+
+bool AbbreviationIndex::isInitials(std::string_view input) {
+  if (input.size() < kMinInitials || input.size() > kMaxInitials) {
+    return false;
+  }
+  for (char c : input) {
+    // Every consonant letter starts some syllable; vowels make it pinyin
+    if (c < 'a' || c > 'z' || c == 'a' || c == 'e' || c == 'i' || c == 'o' ||
+        c == 'u' || c == 'v') {
+      return false;
+    }
+  }
+  return true;
+}
+
+const MappedTrie *AbbreviationIndex::index() {
+  if (!load_attempted_) {
+    load_attempted_ = true;
+    if (index_.open(path_, kMagic)) {
+      LOG_INFO("Abbreviation index loaded: {} ({} bytes)", path_,
+               index_.mappedSize());
+    } else {
+      LOG_INFO("No abbreviation index at {}", path_);
+    }
+  }
+  return index_.isOpen() ? &index_ : nullptr;
+}
+
+std::string_view AbbreviationIndex::lookup(std::string_view initials) {
+  const MappedTrie *trie = index();
+  if (!trie) {
+    return {};
+  }
+  uint32_t node = trie->find(initials);
+  if (node == MappedTrie::kInvalid || !trie->hasValue(node)) {
+    return {};
+  }
+  return trie->value(node);
+}
+
+std::string_view AbbreviationIndex::nextPhrase(std::string_view &phrases) {
+  size_t end = phrases.find('\0');
+  std::string_view phrase = phrases.substr(0, end);
+  phrases = end == std::string_view::npos ? std::string_view()
+                                          : phrases.substr(end + 1);
+  return phrase;
+}
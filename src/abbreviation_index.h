@@ -0,0 +1,59 @@
+#ifndef IBUS_LIBIME_ABBREVIATION_INDEX_H
+#define IBUS_LIBIME_ABBREVIATION_INDEX_H
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+#include "mapped_trie.h"
+
+// Phrases typed by their initials only, e.g. "zgrm" for 中国人民.
+//
+// The index is built offline by `ibus-libime-abbrev build` from pinyin text
+// dictionaries: a MappedTrie keyed by the first letter of every syllable,
+// whose value lists at most kMaxPhrases phrases, most frequent first,
+// separated by NUL bytes. A lookup is one trie walk over the input, so its
+// cost does not depend on the dictionary size. The index is mapped on first
+// use.
+class AbbreviationIndex {
+public:
+  static AbbreviationIndex &getInstance() {
+    static AbbreviationIndex instance;
+    return instance;
+  }
+
+  static constexpr std::string_view kMagic = "IBLABR01";
+  static constexpr size_t kMinInitials = 2;
+  static constexpr size_t kMaxInitials = 10;
+  static constexpr size_t kMaxPhrases = 16;
+
+  // Whether abbreviations are offered ([abbreviation] enabled)
+  bool enabled() const { return enabled_; }
+
+  // Whether input is a run of initials the index may have, i.e. letters
+  // that start a syllable and no vowels
+  static bool isInitials(std::string_view input);
+
+  // NUL-separated phrases abbreviated by initials, most frequent first;
+  // empty when there are none
+  std::string_view lookup(std::string_view initials);
+
+  // Split the first phrase off a lookup result
+  static std::string_view nextPhrase(std::string_view &phrases);
+
+  // The mapped index, opened on first use; null when unavailable
+  const MappedTrie *index();
+
+private:
+  AbbreviationIndex();
+
+  bool enabled_;
+  bool load_attempted_ = false;
+  std::string path_;
+  MappedTrie index_;
+
+  AbbreviationIndex(const AbbreviationIndex &) = delete;
+  AbbreviationIndex &operator=(const AbbreviationIndex &) = delete;
+};
+
+#endif // IBUS_LIBIME_ABBREVIATION_INDEX_H
@@ -0,0 +1,106 @@
+#include "alloc_stats.h"
+
+#include <cstdlib>
+#include <new>
+
+namespace {
+
+// Per-thread so a keystroke only sees its own allocations, and so counting
+// needs no atomics
+thread_local AllocSnapshot counters;
+thread_local int library_depth = 0;
+
+} // namespace
+
+AllocSnapshot AllocStats::snapshot() { return counters; }
+
+AllocStats::LibraryScope::LibraryScope() { ++library_depth; }
+
+AllocStats::LibraryScope::~LibraryScope() { --library_depth; }
+
+#ifdef IBUS_LIBIME_ALLOC_PROFILING
+
+namespace {
+
+void count(std::size_t size) {
+  ++counters.count;
+  counters.bytes += size;
+  if (library_depth > 0) {
+    ++counters.library_count;
+    counters.library_bytes += size;
+  }
+}
+
+void *countedAlloc(std::size_t size) noexcept {
+  count(size);
+  return std::malloc(size ? size : 1);
+}
+
+void *countedAlignedAlloc(std::size_t size, std::align_val_t align) noexcept {
+  count(size);
+  auto alignment = static_cast<std::size_t>(align);
+  // aligned_alloc needs a size that is a multiple of the alignment
+  size = (size + alignment - 1) / alignment * alignment;
+  return std::aligned_alloc(alignment, size ? size : alignment);
+}
+
+void *checked(void *p) {
+  if (!p) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+} // namespace
+
+void *operator new(std::size_t size) { return checked(countedAlloc(size)); }
+void *operator new[](std::size_t size) { return checked(countedAlloc(size)); }
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept {
+  return countedAlloc(size);
+}
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept {
+  return countedAlloc(size);
+}
+void *operator new(std::size_t size, std::align_val_t align) {
+  return checked(countedAlignedAlloc(size, align));
+}
+void *operator new[](std::size_t size, std::align_val_t align) {
+  return checked(countedAlignedAlloc(size, align));
+}
+void *operator new(std::size_t size, std::align_val_t align,
+                   const std::nothrow_t &) noexcept {
+  return countedAlignedAlloc(size, align);
+}
+void *operator new[](std::size_t size, std::align_val_t align,
+                     const std::nothrow_t &) noexcept {
+  return countedAlignedAlloc(size, align);
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete[](void *p) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void *p, std::size_t) noexcept { std::free(p); }
+void operator delete(void *p, const std::nothrow_t &) noexcept {
+  std::free(p);
+}
+void operator delete[](void *p, const std::nothrow_t &) noexcept {
+  std::free(p);
+}
+void operator delete(void *p, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void *p, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t, std::align_val_t) noexcept {
+  std::free(p);
+}
+void operator delete[](void *p, std::size_t, std::align_val_t) noexcept {
+  std::free(p);
+}
+void operator delete(void *p, std::align_val_t,
+                     const std::nothrow_t &) noexcept {
+  std::free(p);
+}
+void operator delete[](void *p, std::align_val_t,
+                       const std::nothrow_t &) noexcept {
+  std::free(p);
+}
+
+#endif // IBUS_LIBIME_ALLOC_PROFILING
@@ -0,0 +1,48 @@
+#ifndef IBUS_LIBIME_ALLOC_STATS_H
+#define IBUS_LIBIME_ALLOC_STATS_H
+
+#include <cstdint>
+
+// Heap allocations made by the calling thread since it started
+struct AllocSnapshot {
+  uint64_t count = 0;
+  uint64_t bytes = 0;
+  // The part of the above made inside AllocStats::LibraryScope
+  uint64_t library_count = 0;
+  uint64_t library_bytes = 0;
+};
+
+// C++ heap allocation accounting for profiling builds.
+//
+// Configuring with -DENABLE_ALLOC_PROFILING=ON replaces the global operator
+// new/delete with versions that count allocations per thread. Otherwise
+// kEnabled is false and snapshots stay empty. GLib allocations (g_malloc,
+// IBusText, GVariant) are not counted.
+class AllocStats {
+public:
+#ifdef IBUS_LIBIME_ALLOC_PROFILING
+  static constexpr bool kEnabled = true;
+#else
+  static constexpr bool kEnabled = false;
+#endif
+
+  // Front-end allocations (outside LibraryScope) allowed for a steady-state
+  // letter key; checked by `ibus-libime-bench typing` and the
+  // ibus_libime_keystroke_alloc_budget_exceeded_total counter
+  static constexpr uint64_t kKeystrokeBudget = 4;
+
+  static AllocSnapshot snapshot();
+
+  // Attributes allocations made while alive to libime rather than to the
+  // front end, e.g. around decoding
+  class LibraryScope {
+  public:
+    LibraryScope();
+    ~LibraryScope();
+
+    LibraryScope(const LibraryScope &) = delete;
+    LibraryScope &operator=(const LibraryScope &) = delete;
+  };
+};
+
+#endif // IBUS_LIBIME_ALLOC_STATS_H
@@ -5,13 +5,43 @@
 #include <format>
 #include <map>
 #include <string>
+#include <string_view>
+
+#include "config.h"
 
 Config::Config()
     : keyFile_(nullptr), logLevel_(nullptr), nbest_(3), pageSize_(9),
-      fuzzyFlags_(0) {
+      fuzzyFlags_(0), contextPoolSize_(4),
+      learningQueueSize_(16), learningDelay_(200), traditionalMode_(false),
+      fullWidthMode_(false), englishDetection_(true), englishCompletion_(false),
+      abbreviationEnabled_(true), predictionEnabled_(false),
+      predictionCount_(5), surroundingContext_(false), streamingEnabled_(false),
+      streamingStableKeys_(3), streamingMinLength_(12), metricsEnabled_(false),
+      decodeServiceEnabled_(false), flightRecorderEnabled_(true),
+      flightRecorderCapacity_(4096),
+      slowKeyThreshold_(200) {
   configPath_ = getConfigFilePath();
+  s2tTablePath_ = std::format("{}/s2t.dat", IBUS_LIBIME_PKGDATADIR);
+  englishWordListPath_ =
+      std::format("{}/english.dat", IBUS_LIBIME_PKGDATADIR);
+  englishCompletionPath_ =
+      std::format("{}/english-completion.dat", IBUS_LIBIME_PKGDATADIR);
+  abbreviationIndexPath_ =
+      std::format("{}/abbrev.dat", IBUS_LIBIME_PKGDATADIR);
+  userDictPath_ =
+      std::format("{}/ibus-libime/user.dict", g_get_user_data_dir());
+  userHistoryPath_ =
+      std::format("{}/ibus-libime/user.history", g_get_user_data_dir());
+  bypassPurposes_ = {"password", "pin", "digits", "number", "phone", "url"};
+  decodeServiceSocket_ = "/run/ibus-libime/decode.sock";
+  decodeServiceStateDir_ = IBUS_LIBIME_STATEDIR;
+  metricsSocketPath_ = std::format("{}/ibus-libime/metrics.sock",
+                                   g_get_user_runtime_dir());
   keyFile_ = g_key_file_new();
   loadConfig();
+  loadPinyinProfiles();
+  loadPunctuationOverrides();
+  loadKeyBindings();
 }
 
 Config::~Config() {
@@ -25,6 +55,27 @@ Config::~Config() {
   }
 }
 
+std::string Config::getTablePath(const char *name) const {
+  std::string path;
+  char *value = g_key_file_get_string(keyFile_, "table", name, nullptr);
+  if (value) {
+    path = value;
+    g_free(value);
+  }
+  return path;
+}
+
+std::string Config::getTableLanguage(const char *name) const {
+  std::string key = std::format("{}language", name);
+  std::string language;
+  char *value = g_key_file_get_string(keyFile_, "table", key.c_str(), nullptr);
+  if (value) {
+    language = value;
+    g_free(value);
+  }
+  return language;
+}
+
 std::string Config::getConfigFilePath() {
   const char *config_dir = g_get_user_config_dir();
   if (!config_dir || config_dir[0] == '\0') {
@@ -64,6 +115,84 @@ void Config::loadConfig() {
       error = nullptr;
     }
 
+    // Read context pool size (default: 4, 0 disables pooling)
+    int contextPoolSize =
+        g_key_file_get_integer(keyFile_, "general", "contextpoolsize", &error);
+    if (!error && contextPoolSize >= 0) {
+      contextPoolSize_ = contextPoolSize;
+    }
+    if (error) {
+      g_error_free(error);
+      error = nullptr;
+    }
+
+    // Read extra and user dictionaries (default: none, user.dict) and the
+    // user history snapshot (default: user.history)
+    gsize dictionaryCount = 0;
+    char **dictionaries = g_key_file_get_string_list(
+        keyFile_, "general", "dictionaries", &dictionaryCount, nullptr);
+    if (dictionaries) {
+      for (gsize i = 0; i < dictionaryCount; ++i) {
+        if (dictionaries[i][0] != '\0') {
+          dictionaryPaths_.emplace_back(dictionaries[i]);
+        }
+      }
+      g_strfreev(dictionaries);
+    }
+    char *userDict =
+        g_key_file_get_string(keyFile_, "general", "userdict", nullptr);
+    if (userDict) {
+      if (userDict[0] != '\0') {
+        userDictPath_ = userDict;
+      }
+      g_free(userDict);
+    }
+    char *userHistory =
+        g_key_file_get_string(keyFile_, "general", "userhistory", nullptr);
+    if (userHistory) {
+      if (userHistory[0] != '\0') {
+        userHistoryPath_ = userHistory;
+      }
+      g_free(userHistory);
+    }
+
+    // Read the input purposes passed through (default: password, pin,
+    // digits, number, phone, url; an empty list decodes every field)
+    gsize purposeCount = 0;
+    char **purposes = g_key_file_get_string_list(
+        keyFile_, "contenttype", "bypass", &purposeCount, nullptr);
+    if (purposes) {
+      bypassPurposes_.clear();
+      for (gsize i = 0; i < purposeCount; ++i) {
+        if (purposes[i][0] != '\0') {
+          bypassPurposes_.emplace_back(purposes[i]);
+        }
+      }
+      g_strfreev(purposes);
+    }
+
+    // Read learning queue size (default: 16, 0 learns synchronously)
+    int learningQueueSize = g_key_file_get_integer(keyFile_, "general",
+                                                   "learningqueuesize", &error);
+    if (!error && learningQueueSize >= 0) {
+      learningQueueSize_ = learningQueueSize;
+    }
+    if (error) {
+      g_error_free(error);
+      error = nullptr;
+    }
+
+    // Read learning delay in milliseconds (default: 200)
+    int learningDelay =
+        g_key_file_get_integer(keyFile_, "general", "learningdelay", &error);
+    if (!error && learningDelay > 0) {
+      learningDelay_ = learningDelay;
+    }
+    if (error) {
+      g_error_free(error);
+      error = nullptr;
+    }
+
     // Read fuzzy flags (default: 0)
     // Try to read as string first (comma-separated flag names)
     char *fuzzyFlagsStr =
@@ -85,6 +214,224 @@ void Config::loadConfig() {
     }
     if (error) {
       g_error_free(error);
+      error = nullptr;
+    }
+
+    // Read traditional Chinese output settings (default: simplified)
+    gboolean traditionalMode =
+        g_key_file_get_boolean(keyFile_, "general", "traditional", &error);
+    if (!error) {
+      traditionalMode_ = traditionalMode;
+    }
+    if (error) {
+      g_error_free(error);
+      error = nullptr;
+    }
+    gboolean fullWidthMode =
+        g_key_file_get_boolean(keyFile_, "general", "fullwidth", &error);
+    if (!error) {
+      fullWidthMode_ = fullWidthMode;
+    }
+    if (error) {
+      g_error_free(error);
+      error = nullptr;
+    }
+    char *s2tTable =
+        g_key_file_get_string(keyFile_, "general", "s2ttable", nullptr);
+    if (s2tTable) {
+      if (s2tTable[0] != '\0') {
+        s2tTablePath_ = s2tTable;
+      }
+      g_free(s2tTable);
+    }
+
+    // Read English detection settings (default: enabled)
+    gboolean englishDetection =
+        g_key_file_get_boolean(keyFile_, "english", "detect", &error);
+    if (!error) {
+      englishDetection_ = englishDetection;
+    }
+    if (error) {
+      g_error_free(error);
+      error = nullptr;
+    }
+    char *wordList =
+        g_key_file_get_string(keyFile_, "english", "wordlist", nullptr);
+    if (wordList) {
+      if (wordList[0] != '\0') {
+        englishWordListPath_ = wordList;
+      }
+      g_free(wordList);
+    }
+    gboolean englishCompletion =
+        g_key_file_get_boolean(keyFile_, "english", "complete", &error);
+    if (!error) {
+      englishCompletion_ = englishCompletion;
+    }
+    if (error) {
+      g_error_free(error);
+      error = nullptr;
+    }
+    char *completion =
+        g_key_file_get_string(keyFile_, "english", "completion", nullptr);
+    if (completion) {
+      if (completion[0] != '\0') {
+        englishCompletionPath_ = completion;
+      }
+      g_free(completion);
+    }
+
+    // Read abbreviation settings (default: enabled)
+    gboolean abbreviationEnabled =
+        g_key_file_get_boolean(keyFile_, "abbreviation", "enabled", &error);
+    if (!error) {
+      abbreviationEnabled_ = abbreviationEnabled;
+    }
+    if (error) {
+      g_error_free(error);
+      error = nullptr;
+    }
+    char *abbreviationIndex =
+        g_key_file_get_string(keyFile_, "abbreviation", "index", nullptr);
+    if (abbreviationIndex) {
+      if (abbreviationIndex[0] != '\0') {
+        abbreviationIndexPath_ = abbreviationIndex;
+      }
+      g_free(abbreviationIndex);
+    }
+
+    // Read prediction settings (default: disabled, 5 phrases)
+    gboolean predictionEnabled =
+        g_key_file_get_boolean(keyFile_, "prediction", "enabled", &error);
+    if (!error) {
+      predictionEnabled_ = predictionEnabled;
+    }
+    if (error) {
+      g_error_free(error);
+      error = nullptr;
+    }
+    int predictionCount =
+        g_key_file_get_integer(keyFile_, "prediction", "count", &error);
+    if (!error && predictionCount > 0) {
+      predictionCount_ = predictionCount;
+    }
+    if (error) {
+      g_error_free(error);
+      error = nullptr;
+    }
+
+    // Read whether the text before the cursor seeds decoding (default: false)
+    gboolean surroundingContext =
+        g_key_file_get_boolean(keyFile_, "context", "surrounding", &error);
+    if (!error) {
+      surroundingContext_ = surroundingContext;
+    }
+    if (error) {
+      g_error_free(error);
+      error = nullptr;
+    }
+
+    // Read streaming settings (default: disabled, 3 keys, 12 letters)
+    gboolean streamingEnabled =
+        g_key_file_get_boolean(keyFile_, "streaming", "enabled", &error);
+    if (!error) {
+      streamingEnabled_ = streamingEnabled;
+    }
+    if (error) {
+      g_error_free(error);
+      error = nullptr;
+    }
+    int stableKeys =
+        g_key_file_get_integer(keyFile_, "streaming", "stablekeys", &error);
+    if (!error && stableKeys > 0) {
+      streamingStableKeys_ = stableKeys;
+    }
+    if (error) {
+      g_error_free(error);
+      error = nullptr;
+    }
+    int minLength =
+        g_key_file_get_integer(keyFile_, "streaming", "minlength", &error);
+    if (!error && minLength > 0) {
+      streamingMinLength_ = minLength;
+    }
+    if (error) {
+      g_error_free(error);
+      error = nullptr;
+    }
+
+    gboolean metricsEnabled =
+        g_key_file_get_boolean(keyFile_, "metrics", "enabled", &error);
+    if (!error) {
+      metricsEnabled_ = metricsEnabled;
+    }
+    if (error) {
+      g_error_free(error);
+      error = nullptr;
+    }
+    char *metricsSocket =
+        g_key_file_get_string(keyFile_, "metrics", "socket", nullptr);
+    if (metricsSocket) {
+      if (metricsSocket[0] != '\0') {
+        metricsSocketPath_ = metricsSocket;
+      }
+      g_free(metricsSocket);
+    }
+
+    // Read decode service settings (default: decode locally)
+    gboolean decodeServiceEnabled =
+        g_key_file_get_boolean(keyFile_, "service", "enabled", &error);
+    if (!error) {
+      decodeServiceEnabled_ = decodeServiceEnabled;
+    }
+    if (error) {
+      g_error_free(error);
+      error = nullptr;
+    }
+    char *decodeSocket =
+        g_key_file_get_string(keyFile_, "service", "socket", nullptr);
+    if (decodeSocket) {
+      if (decodeSocket[0] != '\0') {
+        decodeServiceSocket_ = decodeSocket;
+      }
+      g_free(decodeSocket);
+    }
+    char *stateDir =
+        g_key_file_get_string(keyFile_, "service", "statedir", nullptr);
+    if (stateDir) {
+      if (stateDir[0] != '\0') {
+        decodeServiceStateDir_ = stateDir;
+      }
+      g_free(stateDir);
+    }
+
+    // Read flight recorder settings (default: enabled, 4096 events, 200ms)
+    gboolean flightRecorderEnabled =
+        g_key_file_get_boolean(keyFile_, "flightrecorder", "enabled", &error);
+    if (!error) {
+      flightRecorderEnabled_ = flightRecorderEnabled;
+    }
+    if (error) {
+      g_error_free(error);
+      error = nullptr;
+    }
+    int flightRecorderCapacity =
+        g_key_file_get_integer(keyFile_, "flightrecorder", "capacity", &error);
+    if (!error && flightRecorderCapacity > 0) {
+      flightRecorderCapacity_ = flightRecorderCapacity;
+    }
+    if (error) {
+      g_error_free(error);
+      error = nullptr;
+    }
+    int slowKeyThreshold =
+        g_key_file_get_integer(keyFile_, "flightrecorder", "slowkeyms", &error);
+    if (!error && slowKeyThreshold >= 0) {
+      slowKeyThreshold_ = slowKeyThreshold;
+    }
+    if (error) {
+      g_error_free(error);
+      error = nullptr;
     }
   } else {
     // Failed to load (file might not exist), ignore the error
@@ -94,6 +441,119 @@ void Config::loadConfig() {
   }
 }
 
+void Config::loadPinyinProfiles() {
+  // The default profile comes from [general]; a "fuzzy" profile is always
+  // available, and [pinyin:<name>] groups override or add profiles
+  pinyinProfiles_.clear();
+  pinyinProfiles_.push_back({"", nbest_, pageSize_, fuzzyFlags_});
+  pinyinProfiles_.push_back(
+      {"fuzzy", nbest_, pageSize_,
+       parseFuzzyFlagsString("Inner,CommonTypo,L_N,Z_ZH,C_CH,S_SH,AN_ANG,"
+                             "EN_ENG,IN_ING")});
+
+  static constexpr std::string_view prefix = "pinyin:";
+  gchar **groups = g_key_file_get_groups(keyFile_, nullptr);
+  for (gchar **group = groups; group && *group; ++group) {
+    std::string_view groupName(*group);
+    if (!groupName.starts_with(prefix) || groupName.size() == prefix.size()) {
+      continue;
+    }
+    std::string name(groupName.substr(prefix.size()));
+
+    PinyinProfile *profile = nullptr;
+    for (auto &existing : pinyinProfiles_) {
+      if (existing.name == name) {
+        profile = &existing;
+      }
+    }
+    if (!profile) {
+      pinyinProfiles_.push_back({name, nbest_, pageSize_, fuzzyFlags_});
+      profile = &pinyinProfiles_.back();
+    }
+
+    GError *error = nullptr;
+    int nbest = g_key_file_get_integer(keyFile_, *group, "nbest", &error);
+    if (!error && nbest > 0) {
+      profile->nbest = nbest;
+    }
+    if (error) {
+      g_error_free(error);
+      error = nullptr;
+    }
+    int pageSize = g_key_file_get_integer(keyFile_, *group, "pagesize", &error);
+    if (!error && pageSize > 0) {
+      profile->pageSize = pageSize;
+    }
+    if (error) {
+      g_error_free(error);
+      error = nullptr;
+    }
+    char *fuzzyFlagsStr =
+        g_key_file_get_string(keyFile_, *group, "fuzzyflags", nullptr);
+    if (fuzzyFlagsStr) {
+      profile->fuzzyFlags = parseFuzzyFlagsString(fuzzyFlagsStr);
+      g_free(fuzzyFlagsStr);
+    }
+  }
+  g_strfreev(groups);
+}
+
+void Config::loadPunctuationOverrides() {
+  punctuationOverrides_.clear();
+  static constexpr std::string_view prefix = "punctuation:";
+  gchar **groups = g_key_file_get_groups(keyFile_, nullptr);
+  for (gchar **group = groups; group && *group; ++group) {
+    std::string_view groupName(*group);
+    PunctuationOverrides overrides;
+    if (groupName.starts_with(prefix) && groupName.size() > prefix.size()) {
+      overrides.client = groupName.substr(prefix.size());
+    } else if (groupName != "punctuation") {
+      continue;
+    }
+
+    gchar **keys = g_key_file_get_keys(keyFile_, *group, nullptr, nullptr);
+    for (gchar **key = keys; key && *key; ++key) {
+      char *value = g_key_file_get_string(keyFile_, *group, *key, nullptr);
+      if (value) {
+        overrides.entries.emplace_back(*key, value);
+        g_free(value);
+      }
+    }
+    g_strfreev(keys);
+
+    // Keep [punctuation] ahead of the per-client groups built on it
+    if (overrides.client.empty()) {
+      punctuationOverrides_.insert(punctuationOverrides_.begin(),
+                                   std::move(overrides));
+    } else {
+      punctuationOverrides_.push_back(std::move(overrides));
+    }
+  }
+  g_strfreev(groups);
+}
+
+void Config::loadKeyBindings() {
+  keyBindings_.clear();
+  gchar **keys = g_key_file_get_keys(keyFile_, "keys", nullptr, nullptr);
+  for (gchar **key = keys; key && *key; ++key) {
+    char *value = g_key_file_get_string(keyFile_, "keys", *key, nullptr);
+    if (value) {
+      keyBindings_.emplace_back(*key, value);
+      g_free(value);
+    }
+  }
+  g_strfreev(keys);
+}
+
+const PinyinProfile &Config::getPinyinProfile(const std::string &name) const {
+  for (const auto &profile : pinyinProfiles_) {
+    if (profile.name == name) {
+      return profile;
+    }
+  }
+  return pinyinProfiles_.front();
+}
+
 const char *Config::getLogLevel() {
   // Priority: environment variable > config file
   const char *envLogLevel = std::getenv("IBUS_LIBIME_LOG_LEVEL");
@@ -110,6 +570,26 @@ int Config::getPageSize() const { return pageSize_; }
 
 int Config::getFuzzyFlags() const { return fuzzyFlags_; }
 
+int Config::getContextPoolSize() const { return contextPoolSize_; }
+
+int Config::getLearningQueueSize() const { return learningQueueSize_; }
+
+int Config::getLearningDelay() const { return learningDelay_; }
+
+bool Config::getTraditionalMode() const { return traditionalMode_; }
+
+bool Config::getFullWidthMode() const { return fullWidthMode_; }
+
+bool Config::getMetricsEnabled() const { return metricsEnabled_; }
+
+bool Config::getFlightRecorderEnabled() const { return flightRecorderEnabled_; }
+
+int Config::getFlightRecorderCapacity() const {
+  return flightRecorderCapacity_;
+}
+
+int Config::getSlowKeyThreshold() const { return slowKeyThreshold_; }
+
 int Config::parseFuzzyFlagsString(const char *flagsStr) {
   if (!flagsStr || flagsStr[0] == '\0') {
     return 0;
@@ -4,6 +4,24 @@
 #include <glib.h>
 
 #include <string>
+#include <utility>
+#include <vector>
+
+// Candidate settings of one pinyin engine. Every profile is served by the
+// same dictionary and language model; only these settings differ.
+struct PinyinProfile {
+  std::string name; // Empty for the default libime-pinyin engine
+  int nbest;
+  int pageSize;
+  int fuzzyFlags; // 0 selects the built-in default
+};
+
+// Punctuation changes from [punctuation] (empty client) or from a
+// [punctuation:<client>] group, as keyval name and replacement pairs
+struct PunctuationOverrides {
+  std::string client;
+  std::vector<std::pair<std::string, std::string>> entries;
+};
 
 class Config {
 public:
@@ -25,6 +43,146 @@ public:
   // Get fuzzy flags as integer
   int getFuzzyFlags() const;
 
+  // Get every pinyin profile; the first one is the default profile
+  const std::vector<PinyinProfile> &getPinyinProfiles() const {
+    return pinyinProfiles_;
+  }
+
+  // Get a pinyin profile by name, falling back to the default profile
+  const PinyinProfile &getPinyinProfile(const std::string &name) const;
+
+  // Get the extra pinyin dictionaries loaded after the system one
+  // ([general] dictionaries, separated by ';')
+  const std::vector<std::string> &getDictionaryPaths() const {
+    return dictionaryPaths_;
+  }
+
+  // Get the user pinyin dictionary path ([general] userdict)
+  const std::string &getUserDictPath() const { return userDictPath_; }
+
+  // Get the user history snapshot loaded at startup ([general] userhistory)
+  const std::string &getUserHistoryPath() const { return userHistoryPath_; }
+
+  // Get the number of idle contexts/properties kept for reuse
+  int getContextPoolSize() const;
+
+  // Get the maximum number of committed sentences waiting to be learned
+  int getLearningQueueSize() const;
+
+  // Get the longest delay (ms) before queued learning is applied
+  int getLearningDelay() const;
+
+  // Whether candidates and commits start out in traditional Chinese
+  bool getTraditionalMode() const;
+
+  // Whether ASCII starts out converted to full-width forms
+  bool getFullWidthMode() const;
+
+  // Get the configured punctuation changes, [punctuation] first
+  const std::vector<PunctuationOverrides> &getPunctuationOverrides() const {
+    return punctuationOverrides_;
+  }
+
+  // Whether compositions are decoded after the text before the cursor
+  // ([context] surrounding)
+  bool getSurroundingContext() const { return surroundingContext_; }
+
+  // Whether the stable leading words of a long composition are locked so
+  // only the rest is decoded again ([streaming] enabled)
+  bool getStreamingEnabled() const { return streamingEnabled_; }
+
+  // Letter keys a leading word must stay in the best sentence before it is
+  // locked ([streaming] stablekeys)
+  int getStreamingStableKeys() const { return streamingStableKeys_; }
+
+  // Unlocked input length, in letters, below which nothing is locked
+  // ([streaming] minlength)
+  int getStreamingMinLength() const { return streamingMinLength_; }
+
+  // Input purposes whose fields get keys passed through undecoded
+  // ([contenttype] bypass, separated by ';')
+  const std::vector<std::string> &getBypassPurposes() const {
+    return bypassPurposes_;
+  }
+
+  // Whether English typed in Chinese mode is detected ([english] detect)
+  bool getEnglishDetection() const { return englishDetection_; }
+
+  // Get the English word list path ([english] wordlist)
+  const std::string &getEnglishWordListPath() const {
+    return englishWordListPath_;
+  }
+
+  // Whether English mode completes words ([english] complete)
+  bool getEnglishCompletion() const { return englishCompletion_; }
+
+  // Get the English completion table path ([english] completion)
+  const std::string &getEnglishCompletionPath() const {
+    return englishCompletionPath_;
+  }
+
+  // Whether phrases typed by their initials are offered
+  // ([abbreviation] enabled)
+  bool getAbbreviationEnabled() const { return abbreviationEnabled_; }
+
+  // Get the abbreviation index path ([abbreviation] index)
+  const std::string &getAbbreviationIndexPath() const {
+    return abbreviationIndexPath_;
+  }
+
+  // Whether follow-up phrases are predicted after a commit
+  // ([prediction] enabled)
+  bool getPredictionEnabled() const { return predictionEnabled_; }
+
+  // Get the number of phrases predicted after a commit ([prediction] count)
+  int getPredictionCount() const { return predictionCount_; }
+
+  // Get the [keys] group as action name and key list pairs
+  const std::vector<std::pair<std::string, std::string>> &
+  getKeyBindings() const {
+    return keyBindings_;
+  }
+
+  // Get the simplified-to-traditional table path ([general] s2ttable)
+  const std::string &getS2TTablePath() const { return s2tTablePath_; }
+
+  // Whether the metrics socket is enabled ([metrics] enabled)
+  bool getMetricsEnabled() const;
+
+  // Get the metrics socket path ([metrics] socket)
+  const std::string &getMetricsSocketPath() const { return metricsSocketPath_; }
+
+  // Whether pinyin engines decode through the shared decode service
+  // ([service] enabled)
+  bool getDecodeServiceEnabled() const { return decodeServiceEnabled_; }
+
+  // Get the decode service socket path ([service] socket)
+  const std::string &getDecodeServiceSocket() const {
+    return decodeServiceSocket_;
+  }
+
+  // Get the directory the decode service keeps user histories in
+  // ([service] statedir)
+  const std::string &getDecodeServiceStateDir() const {
+    return decodeServiceStateDir_;
+  }
+
+  // Whether the flight recorder is enabled ([flightrecorder] enabled)
+  bool getFlightRecorderEnabled() const;
+
+  // Get the number of events kept by the flight recorder
+  int getFlightRecorderCapacity() const;
+
+  // Get the keystroke duration (ms) that triggers a flight recorder dump
+  int getSlowKeyThreshold() const;
+
+  // Get the dictionary path configured for a table engine ([table] <name>),
+  // or an empty string when the default should be used
+  std::string getTablePath(const char *name) const;
+  // Get the language of a table engine ([table] <name>language), or an
+  // empty string when the default should be used
+  std::string getTableLanguage(const char *name) const;
+
   // Get config file path
   const std::string &getConfigPath() const { return configPath_; }
 
@@ -33,6 +191,9 @@ private:
   ~Config();
 
   void loadConfig();
+  void loadPinyinProfiles();
+  void loadPunctuationOverrides();
+  void loadKeyBindings();
   std::string getConfigFilePath();
   int parseFuzzyFlagsString(const char *flagsStr);
 
@@ -42,6 +203,39 @@ private:
   int nbest_;
   int pageSize_;
   int fuzzyFlags_;
+  std::vector<PinyinProfile> pinyinProfiles_;
+  std::vector<std::string> dictionaryPaths_;
+  std::string userDictPath_;
+  std::string userHistoryPath_;
+  std::vector<std::string> bypassPurposes_;
+  int contextPoolSize_;
+  int learningQueueSize_;
+  int learningDelay_;
+  bool traditionalMode_;
+  bool fullWidthMode_;
+  std::vector<PunctuationOverrides> punctuationOverrides_;
+  std::vector<std::pair<std::string, std::string>> keyBindings_;
+  bool englishDetection_;
+  std::string englishWordListPath_;
+  bool englishCompletion_;
+  std::string englishCompletionPath_;
+  bool abbreviationEnabled_;
+  std::string abbreviationIndexPath_;
+  bool predictionEnabled_;
+  int predictionCount_;
+  bool surroundingContext_;
+  bool streamingEnabled_;
+  int streamingStableKeys_;
+  int streamingMinLength_;
+  std::string s2tTablePath_;
+  bool metricsEnabled_;
+  std::string metricsSocketPath_;
+  bool decodeServiceEnabled_;
+  std::string decodeServiceSocket_;
+  std::string decodeServiceStateDir_;
+  bool flightRecorderEnabled_;
+  int flightRecorderCapacity_;
+  int slowKeyThreshold_;
 
   Config(const Config &) = delete;
   Config &operator=(const Config &) = delete;
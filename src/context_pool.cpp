@@ -0,0 +1,188 @@
+#include "context_pool.h"
+
+#include "configs.h"
+#include "logger.h"
+#include "metrics.h"
+
+using namespace libime;
+
+namespace {
+
+Metrics::Counter &poolHits(const char *pool) {
+  return Metrics::getInstance().counter(
+      std::format("ibus_libime_pool_hits_total{{pool=\"{}\"}}", pool),
+      "Objects reused from the engine object pool");
+}
+
+Metrics::Counter &poolMisses(const char *pool) {
+  return Metrics::getInstance().counter(
+      std::format("ibus_libime_pool_misses_total{{pool=\"{}\"}}", pool),
+      "Objects newly allocated because the engine object pool was empty");
+}
+
+Metrics::Gauge &poolSize(const char *pool) {
+  return Metrics::getInstance().gauge(
+      std::format("ibus_libime_pool_idle_objects{{pool=\"{}\"}}", pool),
+      "Idle objects currently held by the engine object pool");
+}
+
+} // namespace
+
+ContextPool::ContextPool()
+    : capacity_(Config::getInstance().getContextPoolSize()) {
+  Metrics::getInstance()
+      .gauge("ibus_libime_pool_capacity", "Maximum idle objects per pool")
+      .set(static_cast<int64_t>(capacity_));
+  contexts_.reserve(capacity_);
+  properties_.reserve(capacity_);
+}
+
+ContextPool::~ContextPool() { clear(); }
+
+std::unique_ptr<PinyinContext> ContextPool::acquireContext(PinyinIME *ime) {
+  static auto &hits = poolHits("context");
+  static auto &misses = poolMisses("context");
+
+  // Contexts are bound to the IME they were created for
+  while (!contexts_.empty()) {
+    auto context = std::move(contexts_.back());
+    contexts_.pop_back();
+    if (context->ime() == ime) {
+      hits.inc();
+      updateGauges();
+      return context;
+    }
+  }
+
+  misses.inc();
+  updateGauges();
+  LOG_DEBUG("Context pool empty, creating new PinyinContext");
+  return std::make_unique<PinyinContext>(ime);
+}
+
+void ContextPool::releaseContext(std::unique_ptr<PinyinContext> context) {
+  if (!context) {
+    return;
+  }
+  if (contexts_.size() >= capacity_) {
+    return; // Pool is full, let the context go
+  }
+  context->clear();
+  contexts_.push_back(std::move(context));
+  updateGauges();
+}
+
+EngineProperties ContextPool::acquireProperties() {
+  static auto &hits = poolHits("properties");
+  static auto &misses = poolMisses("properties");
+
+  if (!properties_.empty()) {
+    EngineProperties properties = properties_.back();
+    properties_.pop_back();
+    hits.inc();
+    updateGauges();
+    return properties;
+  }
+
+  misses.inc();
+  updateGauges();
+  return createProperties();
+}
+
+void ContextPool::releaseProperties(EngineProperties properties) {
+  if (!properties.list) {
+    return;
+  }
+  if (properties_.size() >= capacity_) {
+    destroyProperties(properties);
+    return;
+  }
+  resetProperties(properties);
+  properties_.push_back(properties);
+  updateGauges();
+}
+
+void ContextPool::clear() {
+  contexts_.clear();
+  for (auto &properties : properties_) {
+    destroyProperties(properties);
+  }
+  properties_.clear();
+  updateGauges();
+}
+
+EngineProperties ContextPool::createProperties() {
+  EngineProperties properties;
+
+  // Create property list
+  properties.list = ibus_prop_list_new();
+  g_object_ref_sink(properties.list);
+
+  // Create mode property - use PROP_TYPE_NORMAL for status bar display
+  IBusText *label = ibus_text_new_from_string("中");
+  IBusText *tooltip = ibus_text_new_from_string("切换中英文 (Shift)");
+
+  properties.mode = ibus_property_new("InputMode", PROP_TYPE_NORMAL, label,
+                                      nullptr, // icon - can be nullptr
+                                      tooltip,
+                                      TRUE, // sensitive
+                                      TRUE, // visible
+                                      PROP_STATE_UNCHECKED, nullptr);
+  // Keep our own reference; the list takes another one when appending
+  g_object_ref_sink(properties.mode);
+
+  ibus_prop_list_append(properties.list, properties.mode);
+
+  // Output script property, shown next to the input mode
+  properties.script = ibus_property_new(
+      "TraditionalMode", PROP_TYPE_NORMAL, ibus_text_new_from_string("简"),
+      nullptr, ibus_text_new_from_string("切换简繁体"), TRUE, TRUE,
+      PROP_STATE_UNCHECKED, nullptr);
+  g_object_ref_sink(properties.script);
+
+  ibus_prop_list_append(properties.list, properties.script);
+
+  properties.width = ibus_property_new(
+      "FullWidth", PROP_TYPE_NORMAL, ibus_text_new_from_string("半"), nullptr,
+      ibus_text_new_from_string("切换全角/半角"), TRUE, TRUE,
+      PROP_STATE_UNCHECKED, nullptr);
+  g_object_ref_sink(properties.width);
+
+  ibus_prop_list_append(properties.list, properties.width);
+  return properties;
+}
+
+void ContextPool::resetProperties(const EngineProperties &properties) {
+  ibus_property_set_label(properties.mode, ibus_text_new_from_string("中"));
+  ibus_property_set_state(properties.mode, PROP_STATE_UNCHECKED);
+  ibus_property_set_label(properties.script, ibus_text_new_from_string("简"));
+  ibus_property_set_state(properties.script, PROP_STATE_UNCHECKED);
+  ibus_property_set_label(properties.width, ibus_text_new_from_string("半"));
+  ibus_property_set_state(properties.width, PROP_STATE_UNCHECKED);
+}
+
+void ContextPool::destroyProperties(EngineProperties &properties) {
+  if (properties.mode) {
+    g_object_unref(properties.mode);
+    properties.mode = nullptr;
+  }
+  if (properties.script) {
+    g_object_unref(properties.script);
+    properties.script = nullptr;
+  }
+  if (properties.width) {
+    g_object_unref(properties.width);
+    properties.width = nullptr;
+  }
+  if (properties.list) {
+    g_object_unref(properties.list);
+    properties.list = nullptr;
+  }
+}
+
+void ContextPool::updateGauges() {
+  static auto &contexts = poolSize("context");
+  static auto &properties = poolSize("properties");
+  contexts.set(static_cast<int64_t>(contexts_.size()));
+  properties.set(static_cast<int64_t>(properties_.size()));
+}
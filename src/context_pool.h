@@ -0,0 +1,57 @@
+#ifndef IBUS_LIBIME_CONTEXT_POOL_H
+#define IBUS_LIBIME_CONTEXT_POOL_H
+
+#include <ibus.h>
+#include <libime/pinyin/pinyincontext.h>
+#include <libime/pinyin/pinyinime.h>
+
+#include <memory>
+#include <vector>
+
+// Property objects registered by one engine instance
+struct EngineProperties {
+  IBusPropList *list = nullptr;
+  IBusProperty *mode = nullptr;
+  IBusProperty *script = nullptr; // Simplified/traditional output
+  IBusProperty *width = nullptr;  // Half/full-width ASCII
+};
+
+// Recycles PinyinContext and property objects across engine lifetimes.
+//
+// IBus may create and destroy an engine per input context, so focus storms
+// would otherwise keep rebuilding the same objects. Released objects are reset
+// and kept (up to the configured pool size) for the next engine instance.
+class ContextPool {
+public:
+  static ContextPool &getInstance() {
+    static ContextPool instance;
+    return instance;
+  }
+
+  std::unique_ptr<libime::PinyinContext> acquireContext(libime::PinyinIME *ime);
+  void releaseContext(std::unique_ptr<libime::PinyinContext> context);
+
+  EngineProperties acquireProperties();
+  void releaseProperties(EngineProperties properties);
+
+  // Drop every pooled object; must run before the shared IME goes away
+  void clear();
+
+private:
+  ContextPool();
+  ~ContextPool();
+
+  static EngineProperties createProperties();
+  static void resetProperties(const EngineProperties &properties);
+  static void destroyProperties(EngineProperties &properties);
+  void updateGauges();
+
+  size_t capacity_;
+  std::vector<std::unique_ptr<libime::PinyinContext>> contexts_;
+  std::vector<EngineProperties> properties_;
+
+  ContextPool(const ContextPool &) = delete;
+  ContextPool &operator=(const ContextPool &) = delete;
+};
+
+#endif // IBUS_LIBIME_CONTEXT_POOL_H
@@ -0,0 +1,106 @@
+#include "decode_client.h"
+
+#include <glib.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+
+#include "logger.h"
+#include "metrics.h"
+
+namespace {
+
+struct ClientMetrics {
+  Metrics::Histogram &roundTrip;
+  Metrics::Counter &failures;
+
+  static ClientMetrics &get() {
+    static ClientMetrics metrics = [] {
+      auto &registry = Metrics::getInstance();
+      return ClientMetrics{
+          registry.histogram(
+              "ibus_libime_remote_decode_microseconds",
+              "Round trip of one request to the decode service",
+              {50, 100, 250, 500, 1000, 2500, 5000, 10000, 25000, 100000,
+               250000}),
+          registry.counter("ibus_libime_remote_decode_failures_total",
+                           "Connections to the decode service lost or "
+                           "refused")};
+    }();
+    return metrics;
+  }
+};
+
+} // namespace
+
+bool DecodeClient::connect(const std::string &path, uint32_t max_candidates) {
+  close();
+  sockaddr_un addr{};
+  addr.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(addr.sun_path)) {
+    return false;
+  }
+  std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+  fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+  if (fd_ < 0 ||
+      ::connect(fd_, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0) {
+    LOG_INFO("Decode service not available at {}: {}", path,
+             std::strerror(errno));
+    ClientMetrics::get().failures.inc();
+    close();
+    return false;
+  }
+  DecodeState state;
+  if (!request(DecodeOp::Hello, {kDecodeProtocolVersion, max_candidates},
+               state)) {
+    return false;
+  }
+  LOG_INFO("Connected to the decode service at {}", path);
+  return true;
+}
+
+void DecodeClient::close() {
+  if (fd_ >= 0) {
+    ::close(fd_);
+    fd_ = -1;
+  }
+}
+
+bool DecodeClient::request(DecodeOp op, std::initializer_list<uint32_t> args,
+                           DecodeState &state) {
+  buffer_.clear();
+  DecodeWriter writer(buffer_);
+  writer.u8(static_cast<uint8_t>(op));
+  for (uint32_t arg : args) {
+    writer.u32(arg);
+  }
+  return roundTrip(state);
+}
+
+bool DecodeClient::type(std::string_view text, DecodeState &state) {
+  buffer_.clear();
+  DecodeWriter writer(buffer_);
+  writer.u8(static_cast<uint8_t>(DecodeOp::Type));
+  writer.str(text);
+  return roundTrip(state);
+}
+
+bool DecodeClient::roundTrip(DecodeState &state) {
+  if (fd_ < 0) {
+    return false;
+  }
+  auto &metrics = ClientMetrics::get();
+  gint64 start = g_get_monotonic_time();
+  if (!writeDecodeFrame(fd_, buffer_, kTimeoutMs) ||
+      !readDecodeFrame(fd_, buffer_, kTimeoutMs) || !state.decode(buffer_)) {
+    LOG_WARN("Decode service request failed: {}", std::strerror(errno));
+    metrics.failures.inc();
+    close();
+    return false;
+  }
+  metrics.roundTrip.observe(g_get_monotonic_time() - start);
+  return true;
+}
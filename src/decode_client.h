@@ -0,0 +1,43 @@
+#ifndef IBUS_LIBIME_DECODE_CLIENT_H
+#define IBUS_LIBIME_DECODE_CLIENT_H
+
+#include <cstdint>
+#include <initializer_list>
+#include <string>
+#include <string_view>
+
+#include "decode_protocol.h"
+
+// One engine's connection to the decode service.
+//
+// Requests block until the reply arrives, for at most kTimeoutMs. Any failure
+// closes the connection for good; the engine then decodes locally.
+class DecodeClient {
+public:
+  static constexpr int kTimeoutMs = 250;
+
+  DecodeClient() = default;
+  ~DecodeClient() { close(); }
+
+  // Connect and say Hello; false if the service is not there
+  bool connect(const std::string &path, uint32_t max_candidates);
+  bool connected() const { return fd_ >= 0; }
+  void close();
+
+  // Send a request with integer arguments and read the session back
+  bool request(DecodeOp op, std::initializer_list<uint32_t> args,
+               DecodeState &state);
+  bool type(std::string_view text, DecodeState &state);
+
+private:
+  bool roundTrip(DecodeState &state);
+
+  int fd_ = -1;
+  // Request being sent, then the reply
+  std::string buffer_;
+
+  DecodeClient(const DecodeClient &) = delete;
+  DecodeClient &operator=(const DecodeClient &) = delete;
+};
+
+#endif // IBUS_LIBIME_DECODE_CLIENT_H
@@ -0,0 +1,48 @@
+// ibus-libime-decoded: the shared decode service. Loads the pinyin
+// dictionary and language model once and decodes for the engines of every
+// session on the host; see decode_service.h.
+
+#include <glib-unix.h>
+#include <glib.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include <clocale>
+#include <format>
+
+#include "decode_service.h"
+#include "logger.h"
+#include "metrics.h"
+#include "metrics_server.h"
+#include "pinyin_engine.h"
+
+int main(int argc, char *argv[]) {
+  setlocale(LC_ALL, "");
+
+  LOG_INFO("=== Starting IBus LibIME decode service ===");
+  LOG_INFO("Process ID: {}", getpid());
+
+  PinyinEngine::initializeSharedIME();
+  auto &service = DecodeService::getInstance();
+  if (!service.start()) {
+    return 1;
+  }
+  MetricsServer::getInstance().start();
+
+  GMainLoop *loop = g_main_loop_new(nullptr, FALSE);
+  auto quit = [](gpointer data) -> gboolean {
+    g_main_loop_quit(static_cast<GMainLoop *>(data));
+    return G_SOURCE_REMOVE;
+  };
+  g_unix_signal_add(SIGINT, quit, loop);
+  g_unix_signal_add(SIGTERM, quit, loop);
+  g_main_loop_run(loop);
+  g_main_loop_unref(loop);
+
+  LOG_INFO("Main loop exited");
+  service.stop();
+  MetricsServer::getInstance().stop();
+  PinyinEngine::cleanupSharedIME();
+  LOG_INFO("Final metrics:\n{}", Metrics::getInstance().format());
+  return 0;
+}
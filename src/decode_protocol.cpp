@@ -0,0 +1,176 @@
+#include "decode_protocol.h"
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cerrno>
+
+namespace {
+
+uint32_t readU32(const char *data) {
+  auto *bytes = reinterpret_cast<const unsigned char *>(data);
+  return static_cast<uint32_t>(bytes[0]) |
+         static_cast<uint32_t>(bytes[1]) << 8 |
+         static_cast<uint32_t>(bytes[2]) << 16 |
+         static_cast<uint32_t>(bytes[3]) << 24;
+}
+
+bool waitFor(int fd, short events, int timeout_ms) {
+  pollfd pfd{fd, events, 0};
+  int ready;
+  do {
+    ready = poll(&pfd, 1, timeout_ms);
+  } while (ready < 0 && errno == EINTR);
+  return ready > 0 && !(pfd.revents & (POLLERR | POLLNVAL));
+}
+
+bool readExactly(int fd, char *data, size_t size, int timeout_ms) {
+  while (size > 0) {
+    ssize_t n = recv(fd, data, size, 0);
+    if (n > 0) {
+      data += n;
+      size -= n;
+    } else if (n < 0 && (errno == EAGAIN || errno == EINTR)) {
+      if (errno == EAGAIN && !waitFor(fd, POLLIN, timeout_ms)) {
+        return false;
+      }
+    } else {
+      return false;
+    }
+  }
+  return true;
+}
+
+} // namespace
+
+void DecodeWriter::u32(uint32_t value) {
+  for (int shift = 0; shift < 32; shift += 8) {
+    out_.push_back(static_cast<char>(value >> shift));
+  }
+}
+
+void DecodeWriter::str(std::string_view value) {
+  u32(static_cast<uint32_t>(value.size()));
+  out_.append(value);
+}
+
+bool DecodeReader::u8(uint8_t &value) {
+  if (in_.empty()) {
+    return false;
+  }
+  value = static_cast<uint8_t>(in_[0]);
+  in_.remove_prefix(1);
+  return true;
+}
+
+bool DecodeReader::u32(uint32_t &value) {
+  if (in_.size() < 4) {
+    in_ = {};
+    return false;
+  }
+  value = readU32(in_.data());
+  in_.remove_prefix(4);
+  return true;
+}
+
+bool DecodeReader::str(std::string &value) {
+  uint32_t size;
+  if (!u32(size) || in_.size() < size) {
+    in_ = {};
+    return false;
+  }
+  value.assign(in_.substr(0, size));
+  in_.remove_prefix(size);
+  return true;
+}
+
+void DecodeState::encode(std::string &out) const {
+  DecodeWriter writer(out);
+  writer.str(input);
+  writer.u32(inputCursor);
+  writer.str(preedit);
+  writer.u32(preeditCursor);
+  writer.u8(selected);
+  writer.str(sentence);
+  writer.u32(static_cast<uint32_t>(candidates.size()));
+  for (const auto &candidate : candidates) {
+    writer.str(candidate);
+  }
+}
+
+bool DecodeState::decode(std::string_view in) {
+  DecodeReader reader(in);
+  uint8_t selected_flag;
+  uint32_t count;
+  if (!reader.str(input) || !reader.u32(inputCursor) ||
+      !reader.str(preedit) || !reader.u32(preeditCursor) ||
+      !reader.u8(selected_flag) || !reader.str(sentence) ||
+      !reader.u32(count) || count > kMaxDecodeFrame / 4) {
+    return false;
+  }
+  selected = selected_flag != 0;
+  candidates.resize(count);
+  for (auto &candidate : candidates) {
+    if (!reader.str(candidate)) {
+      return false;
+    }
+  }
+  return reader.done();
+}
+
+bool writeDecodeFrame(int fd, std::string_view payload, int timeout_ms) {
+  std::string frame;
+  frame.reserve(4 + payload.size());
+  DecodeWriter(frame).str(payload);
+  const char *data = frame.data();
+  size_t size = frame.size();
+  while (size > 0) {
+    ssize_t n = send(fd, data, size, MSG_NOSIGNAL);
+    if (n > 0) {
+      data += n;
+      size -= n;
+    } else if (n < 0 && (errno == EAGAIN || errno == EINTR)) {
+      if (errno == EAGAIN && !waitFor(fd, POLLOUT, timeout_ms)) {
+        return false;
+      }
+    } else {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool readDecodeFrame(int fd, std::string &payload, int timeout_ms) {
+  if (!waitFor(fd, POLLIN, timeout_ms)) {
+    return false;
+  }
+  char header[4];
+  if (!readExactly(fd, header, sizeof(header), timeout_ms)) {
+    return false;
+  }
+  uint32_t size = readU32(header);
+  if (size > kMaxDecodeFrame) {
+    return false;
+  }
+  payload.resize(size);
+  return readExactly(fd, payload.data(), size, timeout_ms);
+}
+
+bool takeDecodeFrame(std::string &buffer, std::string &payload, bool &error) {
+  error = false;
+  if (buffer.size() < 4) {
+    return false;
+  }
+  uint32_t size = readU32(buffer.data());
+  if (size > kMaxDecodeFrame) {
+    error = true;
+    return false;
+  }
+  if (buffer.size() < 4 + size) {
+    return false;
+  }
+  payload.assign(buffer, 4, size);
+  buffer.erase(0, 4 + size);
+  return true;
+}
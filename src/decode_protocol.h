@@ -0,0 +1,84 @@
+#ifndef IBUS_LIBIME_DECODE_PROTOCOL_H
+#define IBUS_LIBIME_DECODE_PROTOCOL_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Binary protocol between engine processes and the shared decode service
+// (ibus-libime-decoded) on a Unix domain socket.
+//
+// Every message is a frame: the payload length as a little-endian uint32,
+// then the payload. A request is an opcode byte followed by its arguments;
+// every request, Hello included, is answered by the session's DecodeState.
+// Integers are little-endian uint32 and strings a uint32 length followed by
+// the bytes, so a key press costs one small frame each way.
+
+constexpr uint32_t kDecodeProtocolVersion = 1;
+// Larger frames are a protocol error
+constexpr uint32_t kMaxDecodeFrame = 1 << 20;
+
+// Requests and their arguments
+enum class DecodeOp : uint8_t {
+  Hello = 1,     // Protocol version, most candidates to return
+  Type = 2,      // Text typed at the cursor
+  Backspace = 3,
+  Delete = 4,
+  SetCursor = 5, // Cursor position in the input
+  Select = 6,    // Candidate index, whether a full selection is learned
+  Clear = 7,
+};
+
+// The session as the engine shows it, returned after every request
+struct DecodeState {
+  std::string input;
+  uint32_t inputCursor = 0;
+  std::string preedit;
+  uint32_t preeditCursor = 0;
+  // The whole input is selected and sentence is to be committed
+  bool selected = false;
+  std::string sentence;
+  std::vector<std::string> candidates;
+
+  void encode(std::string &out) const;
+  bool decode(std::string_view in);
+};
+
+// Appends protocol values to a payload
+class DecodeWriter {
+public:
+  explicit DecodeWriter(std::string &out) : out_(out) {}
+
+  void u8(uint8_t value) { out_.push_back(static_cast<char>(value)); }
+  void u32(uint32_t value);
+  void str(std::string_view value);
+
+private:
+  std::string &out_;
+};
+
+// Reads protocol values off a payload; every read fails once the payload
+// runs short
+class DecodeReader {
+public:
+  explicit DecodeReader(std::string_view in) : in_(in) {}
+
+  bool u8(uint8_t &value);
+  bool u32(uint32_t &value);
+  bool str(std::string &value);
+  bool done() const { return in_.empty(); }
+
+private:
+  std::string_view in_;
+};
+
+// Write one frame to a socket, waiting at most timeout_ms for it to drain
+bool writeDecodeFrame(int fd, std::string_view payload, int timeout_ms);
+// Read one frame from a blocking socket, waiting at most timeout_ms
+bool readDecodeFrame(int fd, std::string &payload, int timeout_ms);
+// Take the first complete frame off a receive buffer; false while it is
+// incomplete. A frame over kMaxDecodeFrame sets error.
+bool takeDecodeFrame(std::string &buffer, std::string &payload, bool &error);
+
+#endif // IBUS_LIBIME_DECODE_PROTOCOL_H
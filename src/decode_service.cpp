@@ -0,0 +1,434 @@
+#include "decode_service.h"
+
+#include <glib-unix.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <format>
+#include <fstream>
+
+#include "configs.h"
+#include "context_pool.h"
+#include "decode_protocol.h"
+#include "logger.h"
+#include "metrics.h"
+#include "pinyin_engine.h"
+
+using namespace libime;
+
+namespace {
+
+// Replies a session may leave unread before it is dropped
+constexpr size_t kMaxOutbox = kMaxDecodeFrame;
+
+struct ServiceMetrics {
+  Metrics::Counter &requests;
+  Metrics::Counter &errors;
+  Metrics::Counter &learned;
+  Metrics::Gauge &sessions;
+  Metrics::Gauge &users;
+  Metrics::Histogram &duration;
+};
+
+ServiceMetrics &serviceMetrics() {
+  static ServiceMetrics metrics = [] {
+    auto &registry = Metrics::getInstance();
+    return ServiceMetrics{
+        registry.counter("ibus_libime_service_requests_total",
+                         "Requests handled by the decode service"),
+        registry.counter("ibus_libime_service_protocol_errors_total",
+                         "Sessions dropped for a malformed request"),
+        registry.counter("ibus_libime_service_learned_total",
+                         "Selections learned into a user's history"),
+        registry.gauge("ibus_libime_service_sessions",
+                       "Engines connected to the decode service"),
+        registry.gauge("ibus_libime_service_users",
+                       "Users with a session on the decode service"),
+        registry.histogram("ibus_libime_service_request_microseconds",
+                           "Time spent decoding one request in the service",
+                           {50, 100, 250, 500, 1000, 2500, 5000, 10000,
+                            25000})};
+  }();
+  return metrics;
+}
+
+} // namespace
+
+DecodeService::~DecodeService() { stop(); }
+
+bool DecodeService::start() {
+  const auto &config = Config::getInstance();
+  socket_path_ = config.getDecodeServiceSocket();
+  state_dir_ = config.getDecodeServiceStateDir();
+
+  sockaddr_un addr{};
+  addr.sun_family = AF_UNIX;
+  if (socket_path_.size() >= sizeof(addr.sun_path)) {
+    LOG_ERROR("Decode service socket path too long: {}", socket_path_);
+    return false;
+  }
+  std::memcpy(addr.sun_path, socket_path_.c_str(), socket_path_.size() + 1);
+  size_t slash = socket_path_.rfind('/');
+  if (slash != std::string::npos && slash > 0) {
+    std::string dir = socket_path_.substr(0, slash);
+    g_mkdir_with_parents(dir.c_str(), 0755);
+  }
+  // A socket left behind by a previous run
+  unlink(socket_path_.c_str());
+
+  listen_fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+  if (listen_fd_ < 0 ||
+      bind(listen_fd_, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) <
+          0 ||
+      listen(listen_fd_, SOMAXCONN) < 0) {
+    LOG_ERROR("Decode service cannot listen on {}: {}", socket_path_,
+              std::strerror(errno));
+    if (listen_fd_ >= 0) {
+      close(listen_fd_);
+      listen_fd_ = -1;
+    }
+    return false;
+  }
+  // Every user's engines connect; they are told apart by their credentials
+  chmod(socket_path_.c_str(), 0666);
+  listen_watch_ = g_unix_fd_add(listen_fd_, G_IO_IN, onAccept, this);
+
+  // The model's history until a user connects
+  users_[kNoUser];
+  active_user_ = kNoUser;
+  LOG_INFO("Decode service listening on {}, histories in {}", socket_path_,
+           state_dir_);
+  return true;
+}
+
+void DecodeService::stop() {
+  while (!sessions_.empty()) {
+    closeSession(sessions_.begin()->first);
+  }
+  if (listen_watch_) {
+    g_source_remove(listen_watch_);
+    listen_watch_ = 0;
+  }
+  if (listen_fd_ >= 0) {
+    close(listen_fd_);
+    listen_fd_ = -1;
+    unlink(socket_path_.c_str());
+    LOG_INFO("Decode service stopped");
+  }
+}
+
+gboolean DecodeService::onAccept(gint fd, GIOCondition, gpointer user_data) {
+  auto *service = static_cast<DecodeService *>(user_data);
+  auto *ime = PinyinEngine::sharedIME();
+  while (true) {
+    int client = accept4(fd, nullptr, nullptr, SOCK_CLOEXEC | SOCK_NONBLOCK);
+    if (client < 0) {
+      if (errno != EAGAIN && errno != EINTR) {
+        LOG_WARN("Decode service accept failed: {}", std::strerror(errno));
+      }
+      if (errno != EINTR) {
+        return G_SOURCE_CONTINUE;
+      }
+      continue;
+    }
+    ucred cred{};
+    socklen_t length = sizeof(cred);
+    if (getsockopt(client, SOL_SOCKET, SO_PEERCRED, &cred, &length) < 0) {
+      close(client);
+      continue;
+    }
+
+    auto session = std::make_unique<Session>();
+    session->fd = client;
+    session->uid = cred.uid;
+    session->context = ContextPool::getInstance().acquireContext(ime);
+    session->watch = g_unix_fd_add(
+        client, static_cast<GIOCondition>(G_IO_IN | G_IO_HUP | G_IO_ERR),
+        onReadable, session.get());
+    service->sessions_.emplace(client, std::move(session));
+    service->openUser(cred.uid);
+    serviceMetrics().sessions.set(service->sessions_.size());
+    LOG_DEBUG("Decode session {} opened for uid {} (pid {})", client,
+              cred.uid, cred.pid);
+  }
+}
+
+gboolean DecodeService::onReadable(gint fd, GIOCondition,
+                                   gpointer user_data) {
+  auto &service = getInstance();
+  auto &session = *static_cast<Session *>(user_data);
+
+  char chunk[4096];
+  bool closed = false;
+  while (true) {
+    ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+    if (n > 0) {
+      session.buffer.append(chunk, n);
+    } else if (n < 0 && errno == EINTR) {
+      continue;
+    } else {
+      closed = n == 0 || errno != EAGAIN;
+      break;
+    }
+  }
+
+  std::string request;
+  bool error = false;
+  while (takeDecodeFrame(session.buffer, request, error)) {
+    if (!service.handle(session, request)) {
+      error = true;
+      break;
+    }
+  }
+  if (error) {
+    serviceMetrics().errors.inc();
+    LOG_WARN("Decode session {} dropped after a failed request", fd);
+  }
+  if (error || closed) {
+    // This source goes away when the callback returns
+    session.watch = 0;
+    service.closeSession(fd);
+    return G_SOURCE_REMOVE;
+  }
+  return G_SOURCE_CONTINUE;
+}
+
+gboolean DecodeService::onWritable(gint fd, GIOCondition,
+                                   gpointer user_data) {
+  auto &session = *static_cast<Session *>(user_data);
+  // This source goes away when the callback returns; flush() adds another
+  // while replies are left
+  session.write_watch = 0;
+  if (!getInstance().flush(session)) {
+    LOG_WARN("Decode session {} dropped: {}", fd, std::strerror(errno));
+    getInstance().closeSession(fd);
+  }
+  return G_SOURCE_REMOVE;
+}
+
+bool DecodeService::flush(Session &session) {
+  while (!session.outbox.empty()) {
+    ssize_t n = send(session.fd, session.outbox.data(), session.outbox.size(),
+                     MSG_NOSIGNAL);
+    if (n > 0) {
+      session.outbox.erase(0, n);
+    } else if (n < 0 && errno == EAGAIN) {
+      break;
+    } else if (!(n < 0 && errno == EINTR)) {
+      return false;
+    }
+  }
+  if (session.outbox.empty()) {
+    if (session.write_watch) {
+      g_source_remove(session.write_watch);
+      session.write_watch = 0;
+    }
+  } else if (!session.write_watch) {
+    session.write_watch =
+        g_unix_fd_add(session.fd, G_IO_OUT, onWritable, &session);
+  }
+  return true;
+}
+
+bool DecodeService::handle(Session &session, const std::string &request) {
+  auto &metrics = serviceMetrics();
+  gint64 start = g_get_monotonic_time();
+  DecodeReader reader(request);
+  uint8_t op;
+  if (!reader.u8(op) ||
+      (!session.ready && static_cast<DecodeOp>(op) != DecodeOp::Hello)) {
+    return false;
+  }
+
+  activateUser(session.uid);
+  PinyinContext &context = *session.context;
+  bool learn = false;
+  switch (static_cast<DecodeOp>(op)) {
+  case DecodeOp::Hello: {
+    uint32_t version;
+    if (!reader.u32(version) || !reader.u32(session.maxCandidates) ||
+        version != kDecodeProtocolVersion) {
+      return false;
+    }
+    session.ready = true;
+    break;
+  }
+  case DecodeOp::Type: {
+    std::string text;
+    if (!reader.str(text)) {
+      return false;
+    }
+    context.type(text);
+    break;
+  }
+  case DecodeOp::Backspace:
+    context.backspace();
+    break;
+  case DecodeOp::Delete:
+    if (context.cursor() < context.size()) {
+      context.del();
+    }
+    break;
+  case DecodeOp::SetCursor: {
+    uint32_t cursor;
+    if (!reader.u32(cursor)) {
+      return false;
+    }
+    if (cursor <= context.size()) {
+      context.setCursor(cursor);
+    }
+    break;
+  }
+  case DecodeOp::Select: {
+    uint32_t index, learn_flag;
+    if (!reader.u32(index) || !reader.u32(learn_flag)) {
+      return false;
+    }
+    if (index < context.candidates().size()) {
+      context.select(index);
+      learn = context.selected() && learn_flag;
+    }
+    break;
+  }
+  case DecodeOp::Clear:
+    context.clear();
+    break;
+  default:
+    return false;
+  }
+  if (!reader.done()) {
+    return false;
+  }
+
+  DecodeState state;
+  fillState(session, state);
+  std::string reply;
+  state.encode(reply);
+  // Replies never wait on the client: what it does not read yet is queued,
+  // and only a session that lets its queue grow is dropped
+  DecodeWriter(session.outbox).str(reply);
+  bool sent = session.outbox.size() <= kMaxOutbox && flush(session);
+  if (!sent) {
+    LOG_WARN("Decode session {} cannot take its replies", session.fd);
+  }
+
+  // The engine commits as soon as it has the reply; learning can wait
+  if (state.selected) {
+    if (learn) {
+      PinyinEngine::sharedIME()->model()->history().add(
+          context.selectedWords());
+      metrics.learned.inc();
+    }
+    context.clear();
+  }
+  metrics.requests.inc();
+  metrics.duration.observe(g_get_monotonic_time() - start);
+  return sent;
+}
+
+void DecodeService::fillState(const Session &session,
+                              DecodeState &state) const {
+  const PinyinContext &context = *session.context;
+  state.input = context.userInput();
+  state.inputCursor = context.cursor();
+  auto [preedit, cursor] = context.preeditWithCursor();
+  state.preedit = std::move(preedit);
+  state.preeditCursor = cursor;
+  state.selected = context.selected();
+  if (state.selected) {
+    state.sentence = context.sentence();
+    return;
+  }
+  const auto &candidates = context.candidates();
+  size_t count = std::min<size_t>(candidates.size(), session.maxCandidates);
+  state.candidates.reserve(count);
+  for (size_t i = 0; i < count; ++i) {
+    state.candidates.push_back(candidates[i].toString());
+  }
+}
+
+void DecodeService::closeSession(int fd) {
+  auto it = sessions_.find(fd);
+  if (it == sessions_.end()) {
+    return;
+  }
+  std::unique_ptr<Session> session = std::move(it->second);
+  sessions_.erase(it);
+  if (session->watch) {
+    g_source_remove(session->watch);
+  }
+  if (session->write_watch) {
+    g_source_remove(session->write_watch);
+  }
+  close(fd);
+  ContextPool::getInstance().releaseContext(std::move(session->context));
+  closeUser(session->uid);
+  serviceMetrics().sessions.set(sessions_.size());
+  LOG_DEBUG("Decode session {} closed", fd);
+}
+
+void DecodeService::activateUser(uid_t uid) {
+  if (uid == active_user_) {
+    return;
+  }
+  // Give the active user's history back to its slot, then take the new
+  // user's; each swap only exchanges the containers
+  HistoryBigram &history = PinyinEngine::sharedIME()->model()->history();
+  std::swap(history, users_[active_user_].history);
+  std::swap(history, users_[uid].history);
+  active_user_ = uid;
+}
+
+HistoryBigram &DecodeService::historyOf(uid_t uid) {
+  return uid == active_user_ ? PinyinEngine::sharedIME()->model()->history()
+                             : users_[uid].history;
+}
+
+void DecodeService::openUser(uid_t uid) {
+  User &user = users_[uid];
+  if (user.sessions++ > 0) {
+    return;
+  }
+  std::string path = historyPath(uid);
+  std::ifstream in(path, std::ios::binary);
+  if (in) {
+    try {
+      historyOf(uid).load(in);
+      LOG_INFO("History of uid {} loaded from {}", uid, path);
+    } catch (const std::exception &e) {
+      LOG_ERROR("Failed to load history {}: {}", path, e.what());
+      historyOf(uid).clear();
+    }
+  }
+  serviceMetrics().users.set(users_.size() - 1);
+}
+
+void DecodeService::closeUser(uid_t uid) {
+  auto it = users_.find(uid);
+  if (it == users_.end() || --it->second.sessions > 0) {
+    return;
+  }
+  std::string path = historyPath(uid);
+  std::string temp = path + ".tmp";
+  g_mkdir_with_parents(state_dir_.c_str(), 0700);
+  std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+  historyOf(uid).save(out);
+  out.close();
+  if (!out || rename(temp.c_str(), path.c_str()) < 0) {
+    LOG_ERROR("Failed to save history of uid {} to {}", uid, path);
+    unlink(temp.c_str());
+  }
+  if (uid == active_user_) {
+    activateUser(kNoUser);
+  }
+  users_.erase(uid);
+  serviceMetrics().users.set(users_.size() - 1);
+}
+
+std::string DecodeService::historyPath(uid_t uid) const {
+  return std::format("{}/{}.history", state_dir_, uid);
+}
@@ -0,0 +1,99 @@
+#ifndef IBUS_LIBIME_DECODE_SERVICE_H
+#define IBUS_LIBIME_DECODE_SERVICE_H
+
+#include <glib.h>
+#include <libime/core/historybigram.h>
+#include <libime/pinyin/pinyincontext.h>
+#include <sys/types.h>
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+struct DecodeState;
+
+// Decodes pinyin for the engine processes of every session on a host.
+//
+// One PinyinIME, with its dictionary and language model, serves them all over
+// a Unix domain socket (see decode_protocol.h); each connection is one
+// engine's composition in a PinyinContext of its own. Users are told apart by
+// the socket's peer credentials. Every user has a separate history, swapped
+// into the shared model before their requests run and saved under the state
+// directory when their last session ends. Requests are handled one at a time
+// on the GLib main loop; replies are queued per session and written as the
+// client takes them, so a client that stops reading holds up no one else.
+class DecodeService {
+public:
+  static DecodeService &getInstance() {
+    static DecodeService instance;
+    return instance;
+  }
+
+  // Listen on the [service] socket; the shared IME must be initialized
+  bool start();
+  // Close every session and save the user histories
+  void stop();
+
+private:
+  DecodeService() = default;
+  ~DecodeService();
+
+  struct Session {
+    int fd;
+    guint watch = 0;
+    // Watch for room to write, while replies are queued
+    guint write_watch = 0;
+    uid_t uid;
+    bool ready = false; // Hello received
+    uint32_t maxCandidates = 0;
+    std::string buffer;
+    // Reply frames the client has not taken yet
+    std::string outbox;
+    std::unique_ptr<libime::PinyinContext> context;
+  };
+
+  struct User {
+    libime::HistoryBigram history;
+    size_t sessions = 0;
+  };
+
+  // Owner of the history the model starts with, before any user connects
+  static constexpr uid_t kNoUser = static_cast<uid_t>(-1);
+
+  static gboolean onAccept(gint fd, GIOCondition condition,
+                           gpointer user_data);
+  static gboolean onReadable(gint fd, GIOCondition condition,
+                             gpointer user_data);
+  static gboolean onWritable(gint fd, GIOCondition condition,
+                             gpointer user_data);
+
+  // Run one request and reply; false drops the session
+  bool handle(Session &session, const std::string &request);
+  void fillState(const Session &session, DecodeState &state) const;
+  // Send queued replies without blocking; false if the client is gone
+  bool flush(Session &session);
+  // Remove the session and its watches; a callback clears its own watch
+  // first
+  void closeSession(int fd);
+
+  // Put the user's history into the shared model
+  void activateUser(uid_t uid);
+  libime::HistoryBigram &historyOf(uid_t uid);
+  void openUser(uid_t uid);
+  void closeUser(uid_t uid);
+  std::string historyPath(uid_t uid) const;
+
+  int listen_fd_ = -1;
+  guint listen_watch_ = 0;
+  std::string socket_path_;
+  std::string state_dir_;
+  std::unordered_map<int, std::unique_ptr<Session>> sessions_;
+  // Every user's history except the active one's, whose slot holds a spare
+  std::unordered_map<uid_t, User> users_;
+  uid_t active_user_ = kNoUser;
+
+  DecodeService(const DecodeService &) = delete;
+  DecodeService &operator=(const DecodeService &) = delete;
+};
+
+#endif // IBUS_LIBIME_DECODE_SERVICE_H
@@ -0,0 +1,979 @@
+#include "engine_base.h"
+
+#include <algorithm>
+#include <array>
+#include <iterator>
+#include <memory_resource>
+#include <unordered_map>
+
+#include "configs.h"
+#include "english_completer.h"
+#include "flight_recorder.h"
+#include "key_arena.h"
+#include "key_bindings.h"
+#include "logger.h"
+#include "s2t_converter.h"
+
+namespace {
+
+Metrics::Counter &commitCounter(const char *source) {
+  return Metrics::getInstance().counter(
+      std::format("ibus_libime_commits_total{{source=\"{}\"}}", source),
+      "Text committed to the client, by what triggered the commit");
+}
+
+Metrics::Counter &tableUpdateCounter(const char *kind) {
+  return Metrics::getInstance().counter(
+      std::format("ibus_libime_lookup_table_updates_total{{kind=\"{}\"}}",
+                  kind),
+      "Lookup table updates sent to the panel, full or cursor-only");
+}
+
+Metrics::Counter &pageFlipCounter(const char *direction) {
+  return Metrics::getInstance().counter(
+      std::format("ibus_libime_page_flips_total{{direction=\"{}\"}}",
+                  direction),
+      "Lookup table page changes");
+}
+
+// Names of the IBusInputPurpose values, as [contenttype] bypass lists them
+constexpr std::string_view kPurposeNames[] = {
+    "free-form", "alpha", "digits",   "number", "phone",    "url",
+    "email",     "name",  "password", "pin",    "terminal",
+};
+
+// Counter of the keys passed through in fields of this purpose, or null
+// when such fields are decoded
+Metrics::Counter *bypassCounterFor(guint purpose) {
+  static const auto counters = [] {
+    std::array<Metrics::Counter *, std::size(kPurposeNames)> counters{};
+    for (const auto &name : Config::getInstance().getBypassPurposes()) {
+      auto it = std::find(std::begin(kPurposeNames), std::end(kPurposeNames),
+                          name);
+      if (it == std::end(kPurposeNames)) {
+        LOG_WARN("Unknown input purpose in [contenttype] bypass: {}", name);
+        continue;
+      }
+      counters[it - std::begin(kPurposeNames)] =
+          &Metrics::getInstance().counter(
+              std::format(
+                  "ibus_libime_bypassed_keystrokes_total{{purpose=\"{}\"}}",
+                  name),
+              "Key presses passed through undecoded, by the field's input "
+              "purpose");
+    }
+    return counters;
+  }();
+  return purpose < counters.size() ? counters[purpose] : nullptr;
+}
+
+struct ContextStatus {
+  bool englishMode;
+};
+
+std::unordered_map<std::string, ContextStatus> context_status_map;
+
+// Mode of the last hint shown by any engine, -1 before the first one
+int hinted_mode = -1;
+
+// How long the mode hint stays visible, in milliseconds
+constexpr unsigned int kModeHintDuration = 1000;
+
+// Latest time predictions are computed after a commit when the main loop
+// never goes idle, in milliseconds
+constexpr unsigned int kPredictionDelay = 100;
+
+struct CompletionMetrics {
+  Metrics::Counter &shown;
+  Metrics::Counter &accepted;
+  Metrics::Counter &completedChars;
+
+  static CompletionMetrics &get() {
+    auto &registry = Metrics::getInstance();
+    static CompletionMetrics metrics{
+        registry.counter("ibus_libime_english_completions_shown_total",
+                         "English mode keys after which completions were "
+                         "shown"),
+        registry.counter("ibus_libime_english_completions_accepted_total",
+                         "English completions accepted"),
+        registry.counter("ibus_libime_english_completed_chars_total",
+                         "Characters committed by accepting completions")};
+    return metrics;
+  }
+};
+
+struct PredictionMetrics {
+  Metrics::Counter &shown;
+  Metrics::Counter &hits;
+  Metrics::Counter &committedChars;
+  Metrics::Counter &cancelled;
+  Metrics::Histogram &duration;
+
+  static PredictionMetrics &get() {
+    auto &registry = Metrics::getInstance();
+    static PredictionMetrics metrics{
+        registry.counter("ibus_libime_predictions_shown_total",
+                         "Commits followed by a list of predicted phrases"),
+        registry.counter("ibus_libime_prediction_hits_total",
+                         "Predicted phrases chosen from the list"),
+        registry.counter("ibus_libime_prediction_committed_chars_total",
+                         "Characters committed by choosing a prediction"),
+        registry.counter("ibus_libime_predictions_cancelled_total",
+                         "Predictions dropped because a key came first"),
+        registry.histogram("ibus_libime_prediction_microseconds",
+                           "Time spent computing predictions after a commit",
+                           {50, 100, 250, 500, 1000, 2500, 5000, 10000})};
+    return metrics;
+  }
+};
+
+} // namespace
+
+EngineMetrics &EngineMetrics::get() {
+  static EngineMetrics metrics = [] {
+    auto &registry = Metrics::getInstance();
+    EngineMetrics m{
+        registry.counter("ibus_libime_keystrokes_total",
+                         "Key press events delivered to the engine"),
+        commitCounter("candidate"),
+        commitCounter("enter"),
+        commitCounter("shift"),
+        commitCounter("punctuation"),
+        pageFlipCounter("up"),
+        pageFlipCounter("down"),
+        tableUpdateCounter("full"),
+        tableUpdateCounter("cursor"),
+        registry.counter("ibus_libime_resets_total",
+                         "Compositions cleared by reset"),
+        registry.gauge("ibus_libime_engine_instances",
+                       "Live engine instances (IBus clients)"),
+        {}};
+    constexpr size_t ranks = std::size(m.selections);
+    for (size_t i = 0; i < ranks; ++i) {
+      std::string rank =
+          i + 1 < ranks ? std::to_string(i + 1) : std::format("{}+", ranks);
+      m.selections[i] = &registry.counter(
+          std::format("ibus_libime_candidate_selections_total{{rank=\"{}\"}}",
+                      rank),
+          "Candidates selected, by rank in the candidate list");
+    }
+    registry.gaugeCallback(
+        "ibus_libime_known_input_contexts",
+        "Input contexts whose mode state is remembered",
+        []() { return static_cast<int64_t>(context_status_map.size()); });
+    return m;
+  }();
+  return metrics;
+}
+
+EngineBase::EngineBase(IBusEngine *engine)
+    : engine_(engine), page_size_(Config::getInstance().getPageSize()),
+      current_page_(0), cursor_pos_(0), english_mode_(false),
+      toggle_pressed_(false),
+      traditional_mode_(Config::getInstance().getTraditionalMode() &&
+                        S2TConverter::getInstance().load()),
+      full_width_mode_(Config::getInstance().getFullWidthMode()),
+      punctuation_(&PunctuationSchema::getInstance().defaultTable()) {
+  EngineMetrics::get().instances.add(1);
+  lookup_table_ = IBUS_LOOKUP_TABLE(
+      g_object_ref_sink(ibus_lookup_table_new(page_size_, 0, TRUE, TRUE)));
+  initProperties();
+  updateScriptProperty();
+  updateWidthProperty();
+}
+
+EngineBase::~EngineBase() {
+  EngineMetrics::get().instances.add(-1);
+  // The hide task must not outlive the engine it hides the text for
+  TaskScheduler::getInstance().cancel(aux_hide_task_);
+  TaskScheduler::getInstance().cancel(prediction_task_);
+  g_object_unref(lookup_table_);
+  // Hand the properties back for the next engine instance
+  ContextPool::getInstance().releaseProperties(properties_);
+}
+
+bool EngineBase::processKeyEvent(guint keyval, guint keycode,
+                                 guint modifiers) {
+  LOG_DEBUG("processKeyEvent: keyval=0x{:x} keycode={} modifiers=0x{:x}",
+            keyval, keycode, modifiers);
+
+  auto &bindings = KeyBindings::getInstance();
+
+  // Tapping the mode key (Shift by default) alone switches the mode
+  bool is_toggle = bindings.isModeToggle(keyval);
+
+  if (is_toggle && !(modifiers & IBUS_RELEASE_MASK)) {
+    toggle_pressed_ = true;
+    return FALSE; // Let other modifiers work
+  }
+
+  if (is_toggle && (modifiers & IBUS_RELEASE_MASK)) {
+    if (toggle_pressed_) {
+      if (hasInput()) {
+        std::string raw_input = rawInput();
+        LOG_INFO("Mode key released with pending input, committing raw "
+                 "input: {}",
+                 raw_input);
+        reset();
+        commitString(raw_input);
+        EngineMetrics::get().shiftCommits.inc();
+      }
+      toggleInputMode();
+    }
+    toggle_pressed_ = false;
+    return FALSE;
+  }
+
+  // Any other key in between makes it a chord rather than a tap
+  toggle_pressed_ = false;
+
+  // Ignore release events for other keys
+  if (modifiers & IBUS_RELEASE_MASK) {
+    LOG_DEBUG("Ignoring key release event");
+    return FALSE;
+  }
+
+  EngineMetrics::get().keystrokes.inc();
+
+  // Any key typed before the predictions are ready makes them moot
+  cancelPrediction();
+
+  // Shown predictions take the keys that pick and page through candidates;
+  // anything else dismisses them and is handled as usual
+  if (predicting_) {
+    KeyAction action = bindings.lookup(keyval, modifiers, true);
+    if (action == KeyAction::PageUp || action == KeyAction::PageDown ||
+        action == KeyAction::PrevCandidate ||
+        action == KeyAction::NextCandidate || action == KeyAction::Cancel ||
+        (action >= KeyAction::Select1 && action <= KeyAction::Select10)) {
+      return performAction(action);
+    }
+    dismissPredictions();
+  }
+
+  // Bound keys first, unless the composition claims them as input; their
+  // table entry already depends on the modifiers and on whether a
+  // composition is in progress
+  if (!english_mode_ && keepsKey(keyval, modifiers)) {
+    return processInputKey(keyval, modifiers);
+  }
+  if (!english_mode_) {
+    KeyAction action = bindings.lookup(keyval, modifiers, hasInput());
+    if (action != KeyAction::None) {
+      LOG_DEBUG("Key bound to {}", KeyBindings::actionName(action));
+      return performAction(action);
+    }
+  }
+
+  // Pass through if has Ctrl, Alt or Super (Win) modifier
+  if (modifiers &
+      (IBUS_CONTROL_MASK | IBUS_MOD1_MASK | IBUS_MOD4_MASK | IBUS_SUPER_MASK)) {
+    LOG_DEBUG("Passing through: has Ctrl/Alt/Super modifier");
+    clearCompletion();
+    return FALSE;
+  }
+
+  // In English mode, pass through all keys unless they become full-width
+  if (english_mode_) {
+    if (full_width_mode_ && commitPunctuation(keyval)) {
+      clearCompletion();
+      return TRUE;
+    }
+    if (EnglishCompleter::getInstance().enabled()) {
+      return completeEnglish(keyval, modifiers);
+    }
+    LOG_DEBUG("English mode: passing through");
+    return FALSE;
+  }
+
+  LOG_DEBUG("Current input length: {}", inputLength());
+
+  bool result = processInputKey(keyval, modifiers);
+  LOG_DEBUG("Input key processed: {}", result ? "handled" : "passed through");
+  return result;
+}
+
+bool EngineBase::performAction(KeyAction action) {
+  switch (action) {
+  case KeyAction::PageUp:
+    pageUp();
+    return TRUE;
+
+  case KeyAction::PageDown:
+    pageDown();
+    return TRUE;
+
+  case KeyAction::PrevCandidate:
+    cursorUp();
+    return TRUE;
+
+  case KeyAction::NextCandidate:
+    cursorDown();
+    return TRUE;
+
+  case KeyAction::SelectFirst:
+    choosePageCandidate(cursor_pos_);
+    return TRUE;
+
+  case KeyAction::CommitRaw: {
+    // Commit the raw input instead of the converted sentence
+    std::string raw_input = rawInput();
+    reset();
+    commitString(raw_input);
+    EngineMetrics::get().enterCommits.inc();
+    return TRUE;
+  }
+
+  case KeyAction::Cancel:
+    reset();
+    return TRUE;
+
+  case KeyAction::Backspace:
+    return deleteBackward();
+
+  case KeyAction::Delete:
+    return deleteForward();
+
+  case KeyAction::CursorLeft:
+    return moveCursor(-1);
+
+  case KeyAction::CursorRight:
+    return moveCursor(1);
+
+  default:
+    break;
+  }
+
+  if (action >= KeyAction::Select1 && action <= KeyAction::Select10) {
+    size_t position = static_cast<size_t>(action) -
+                      static_cast<size_t>(KeyAction::Select1);
+    choosePageCandidate(position);
+    return TRUE;
+  }
+  return FALSE;
+}
+
+void EngineBase::chooseCandidate(size_t index) {
+  if (completing_) {
+    acceptCompletion(index);
+    return;
+  }
+  size_t literals = literal_candidates_.size();
+  if (index >= literals) {
+    selectCandidate(index - literals);
+    return;
+  }
+  std::string text = std::move(literal_candidates_[index]);
+  bool predicted = predicting_;
+  LOG_INFO("Selecting literal candidate {}", index);
+  auto &selections = EngineMetrics::get().selections;
+  selections[std::min(index, std::size(selections) - 1)]->inc();
+  reset();
+  commitString(text);
+  EngineMetrics::get().candidateCommits.inc();
+  if (predicted) {
+    auto &metrics = PredictionMetrics::get();
+    metrics.hits.inc();
+    metrics.committedChars.inc(g_utf8_strlen(text.c_str(), -1));
+    predictionCommitted(index);
+  }
+}
+
+bool EngineBase::completeEnglish(guint keyval, guint modifiers) {
+  if (completing_) {
+    KeyAction action = KeyBindings::getInstance().lookup(keyval, modifiers,
+                                                         false);
+    if (action == KeyAction::Complete) {
+      acceptCompletion(0);
+      return TRUE;
+    }
+  }
+
+  auto &completer = EnglishCompleter::getInstance();
+  bool word_char =
+      keyval < 0x80 && (g_ascii_isalpha(keyval) ||
+                        (keyval == '\'' && !completion_word_.empty()));
+  if (word_char) {
+    if (completion_word_.empty()) {
+      completion_node_ = completer.root();
+    }
+    completion_word_.push_back(static_cast<char>(keyval));
+    completion_node_ = completer.next(completion_node_, keyval);
+  } else if (keyval == IBUS_KEY_BackSpace && !completion_word_.empty()) {
+    completion_word_.pop_back();
+    completion_node_ = completer.root();
+    for (char c : completion_word_) {
+      completion_node_ = completer.next(completion_node_, c);
+    }
+  } else {
+    clearCompletion();
+    return FALSE;
+  }
+  showCompletions();
+  return FALSE;
+}
+
+void EngineBase::showCompletions() {
+  std::string_view words;
+  if (completion_word_.size() >= EnglishCompleter::kMinPrefix) {
+    words = EnglishCompleter::getInstance().completions(completion_node_);
+  }
+  if (words.empty()) {
+    if (completing_) {
+      completing_ = false;
+      literal_candidates_.clear();
+      ibus_engine_hide_lookup_table(engine_);
+    }
+    return;
+  }
+
+  // A word typed in capitals is completed in capitals
+  bool capitals = true;
+  for (char c : completion_word_) {
+    capitals = capitals && !(c >= 'a' && c <= 'z');
+  }
+
+  // Completions keep the case typed so far; the strings are reused from
+  // key to key
+  size_t prefix = completion_word_.size();
+  size_t count = 0;
+  while (!words.empty()) {
+    std::string_view word = EnglishCompleter::nextWord(words);
+    if (literal_candidates_.size() <= count) {
+      literal_candidates_.emplace_back();
+    }
+    std::string &text = literal_candidates_[count++];
+    text.assign(completion_word_);
+    text.append(word.substr(std::min(prefix, word.size())));
+    if (capitals) {
+      for (size_t i = prefix; i < text.size(); ++i) {
+        text[i] = g_ascii_toupper(text[i]);
+      }
+    }
+  }
+  literal_candidates_.resize(count);
+  completing_ = true;
+  current_page_ = 0;
+  cursor_pos_ = 0;
+  CompletionMetrics::get().shown.inc();
+  updateLookupTable();
+}
+
+void EngineBase::acceptCompletion(size_t index) {
+  if (index >= literal_candidates_.size()) {
+    return;
+  }
+  // The typed prefix is already in the client
+  std::string suffix =
+      literal_candidates_[index].substr(completion_word_.size());
+  clearCompletion();
+  LOG_INFO("Accepting completion {}", index);
+  commitString(suffix);
+  auto &metrics = CompletionMetrics::get();
+  metrics.accepted.inc();
+  metrics.completedChars.inc(suffix.size());
+}
+
+void EngineBase::clearCompletion() {
+  completion_word_.clear();
+  completion_node_ = MappedTrie::kInvalid;
+  if (completing_) {
+    completing_ = false;
+    literal_candidates_.clear();
+    current_page_ = 0;
+    ibus_engine_hide_lookup_table(engine_);
+  }
+}
+
+void EngineBase::schedulePrediction() {
+  if (english_mode_ || !Config::getInstance().getPredictionEnabled()) {
+    return;
+  }
+  // Computed once the commit has gone out, never on the commit path
+  auto &scheduler = TaskScheduler::getInstance();
+  scheduler.cancel(prediction_task_);
+  prediction_task_ = scheduler.runWhenIdle(
+      kPredictionDelay,
+      [this]() {
+        prediction_task_ = 0;
+        showPredictions();
+      },
+      TaskScheduler::Priority::Low);
+}
+
+void EngineBase::cancelPrediction() {
+  if (prediction_task_ &&
+      TaskScheduler::getInstance().cancel(prediction_task_)) {
+    PredictionMetrics::get().cancelled.inc();
+  }
+  prediction_task_ = 0;
+}
+
+void EngineBase::showPredictions() {
+  if (hasInput()) {
+    return;
+  }
+  auto &metrics = PredictionMetrics::get();
+  uint64_t start = FlightRecorder::nowMicroseconds();
+  std::vector<std::string> phrases = predictNext();
+  metrics.duration.observe(FlightRecorder::nowMicroseconds() - start);
+  if (phrases.empty()) {
+    return;
+  }
+
+  literal_candidates_.clear();
+  for (const auto &phrase : phrases) {
+    literal_candidates_.push_back(toOutputScript(phrase));
+  }
+  predicting_ = true;
+  current_page_ = 0;
+  cursor_pos_ = 0;
+  metrics.shown.inc();
+  updateLookupTable();
+}
+
+void EngineBase::dismissPredictions() {
+  if (!predicting_) {
+    return;
+  }
+  literal_candidates_.clear();
+  predicting_ = false;
+  current_page_ = 0;
+  ibus_engine_hide_lookup_table(engine_);
+}
+
+void EngineBase::updateUI() {
+  uint64_t start = FlightRecorder::nowMicroseconds();
+  // New candidates start out with the first one highlighted
+  cursor_pos_ = 0;
+  updatePreedit();
+  updateLookupTable();
+  FlightRecorder::getInstance().record(
+      FlightEvent::UiUpdate, 0, static_cast<uint32_t>(totalCandidates()), 0,
+      static_cast<uint32_t>(FlightRecorder::nowMicroseconds() - start));
+}
+
+EngineBase::DecodeScope::DecodeScope(EngineBase &engine)
+    : engine_(engine), start_(FlightRecorder::nowMicroseconds()) {}
+
+EngineBase::DecodeScope::~DecodeScope() { engine_.recordDecode(start_); }
+
+void EngineBase::recordDecode(uint64_t start) {
+  // Only sizes and timings are recorded, never the input itself
+  FlightRecorder::getInstance().record(
+      FlightEvent::Decode, 0, static_cast<uint32_t>(inputLength()),
+      static_cast<uint32_t>(candidateCount()),
+      static_cast<uint32_t>(FlightRecorder::nowMicroseconds() - start));
+}
+
+void EngineBase::updateLookupTable() {
+  size_t literals = literal_candidates_.size();
+  size_t count = literals + candidateCount();
+
+  LOG_DEBUG("updateLookupTable: {} candidates", count);
+
+  if (count == 0) {
+    LOG_DEBUG("Hiding lookup table (no candidates)");
+    ibus_engine_hide_lookup_table(engine_);
+    return;
+  }
+
+  // The kept table is refilled rather than allocated per update
+  IBusLookupTable *table = lookup_table_;
+  ibus_lookup_table_clear(table);
+  ibus_lookup_table_set_page_size(table, page_size_);
+
+  // The list can shrink under a page kept from before, e.g. after a
+  // deletion; stay on its last page
+  current_page_ = std::min(current_page_, (count - 1) / page_size_);
+  size_t start = current_page_ * page_size_;
+  size_t end = std::min(start + page_size_, count);
+
+  LOG_DEBUG("Showing candidates {} to {} (page {})", start, end - 1,
+            current_page_);
+
+  // Candidate text is assembled in the per-event arena instead of a fresh
+  // string per candidate
+  std::pmr::string text(KeyArena::getInstance().resource());
+  for (size_t i = start; i < end; ++i) {
+    if (i < literals) {
+      ibus_lookup_table_append_candidate(
+          table, ibus_text_new_from_string(literal_candidates_[i].c_str()));
+      continue;
+    }
+    text.clear();
+    appendCandidate(i - literals, text);
+    LOG_DEBUG("  Candidate {}: {}", i + 1, text);
+
+    const char *display = text.c_str();
+    if (traditional_mode_) {
+      script_buffer_.clear();
+      S2TConverter::getInstance().convert(text, script_buffer_);
+      display = script_buffer_.c_str();
+    }
+    ibus_lookup_table_append_candidate(table,
+                                       ibus_text_new_from_string(display));
+  }
+
+  cursor_pos_ = std::min(cursor_pos_, end - start - 1);
+  ibus_lookup_table_set_cursor_pos(table, cursor_pos_);
+  ibus_engine_update_lookup_table(engine_, table, TRUE);
+  EngineMetrics::get().tableRebuilds.inc();
+}
+
+void EngineBase::updateCursor() {
+  // IBus has no cursor-only signal; the fast update resends the kept page
+  // as it is, without decoding, converting or allocating any candidate
+  ibus_lookup_table_set_cursor_pos(lookup_table_, cursor_pos_);
+  ibus_engine_update_lookup_table_fast(engine_, lookup_table_, TRUE);
+  EngineMetrics::get().cursorUpdates.inc();
+}
+
+void EngineBase::commitString(const std::string &text) {
+  if (sensitive_) {
+    LOG_INFO("Committing {} bytes of text", text.size());
+  } else {
+    LOG_INFO("Committing text: {}", text);
+  }
+  FlightRecorder::getInstance().record(FlightEvent::Commit, 0,
+                                       static_cast<uint32_t>(text.size()));
+  IBusText *ibus_text = ibus_text_new_from_string(text.c_str());
+  ibus_engine_commit_text(engine_, ibus_text);
+}
+
+bool EngineBase::commitPunctuation(guint keyval) {
+  std::string_view punct = convertPunctuation(keyval);
+  if (punct.empty()) {
+    return false;
+  }
+  if (!sensitive_) {
+    LOG_INFO("Committing punctuation: {}", punct);
+  }
+  FlightRecorder::getInstance().record(FlightEvent::Commit, 0,
+                                       static_cast<uint32_t>(punct.size()));
+  // Schema text is NUL-terminated and never freed, so IBus need not copy it
+  ibus_engine_commit_text(engine_,
+                          ibus_text_new_from_static_string(punct.data()));
+  EngineMetrics::get().punctuationCommits.inc();
+  return true;
+}
+
+std::string_view EngineBase::convertPunctuation(guint keyval) {
+  const PunctuationEntry *entry =
+      english_mode_ ? nullptr : punctuation_->find(keyval);
+  if (!entry && full_width_mode_) {
+    entry = PunctuationSchema::fullWidth().find(keyval);
+  }
+  if (!entry) {
+    return {};
+  }
+  if (entry->close.empty()) {
+    return entry->open;
+  }
+  // Alternate between the opening and closing forms, like quotes
+  bool closing = punctuation_closing_[keyval];
+  punctuation_closing_.flip(keyval);
+  return closing ? entry->close : entry->open;
+}
+
+void EngineBase::focusInId(const gchar *object_path, const gchar *client) {
+  LOG_INFO("Focus in with ID: {} client: {}", object_path, client);
+  // Engines usually serve a single input context; only look the mode up
+  // when the context changes
+  if (object_path_ != object_path) {
+    object_path_ = object_path;
+    auto it = context_status_map.find(object_path_);
+    english_mode_ = it != context_status_map.end() && it->second.englishMode;
+    punctuation_ = &PunctuationSchema::getInstance().forClient(client);
+  }
+  focus_english_mode_ = english_mode_;
+  focusIn();
+}
+
+void EngineBase::focusIn() {
+  LOG_INFO("Focus in");
+  FlightRecorder::getInstance().record(FlightEvent::FocusIn);
+  // IBus only sends the content type when it differs from the last field's,
+  // so a password field focused again would keep whatever came before
+  guint purpose = 0, hints = 0;
+  ibus_engine_get_content_type(engine_, &purpose, &hints);
+  setContentType(purpose, hints);
+  // Registering carries the current property state, so no separate
+  // property updates are needed
+  syncModeProperty();
+  ibus_engine_register_properties(engine_, properties_.list);
+
+  // Only hint the mode when it differs from what the user last saw
+  if (hinted_mode != static_cast<int>(english_mode_)) {
+    showModeHint();
+  }
+}
+
+void EngineBase::focusOutId(const gchar *object_path) {
+  LOG_INFO("Focus out with ID: {}", object_path);
+  if (object_path_ != object_path || english_mode_ != focus_english_mode_) {
+    object_path_ = object_path;
+    context_status_map[object_path_] = {english_mode_};
+    focus_english_mode_ = english_mode_;
+  }
+  focusOut();
+}
+
+void EngineBase::focusOut() {
+  LOG_INFO("Focus out");
+  FlightRecorder::getInstance().record(FlightEvent::FocusOut);
+  cancelPrediction();
+  dismissPredictions();
+  clearCompletion();
+  // Clear any pending input but keep the mode state
+  if (hasInput()) {
+    clearInput();
+    literal_candidates_.clear();
+    current_page_ = 0;
+    ibus_engine_hide_preedit_text(engine_);
+    ibus_engine_hide_lookup_table(engine_);
+  }
+  // Don't call reset() which would clear everything
+}
+
+void EngineBase::setContentType(guint purpose, guint hints) {
+  LOG_DEBUG("Content type: purpose={} hints=0x{:x}", purpose, hints);
+  Metrics::Counter *bypass = bypassCounterFor(purpose);
+  if (bypass && !bypass_counter_) {
+    // Nothing typed before the switch carries over into the field
+    reset();
+  }
+  bypass_counter_ = bypass;
+  sensitive_ = purpose == IBUS_INPUT_PURPOSE_PASSWORD ||
+               purpose == IBUS_INPUT_PURPOSE_PIN;
+#if IBUS_CHECK_VERSION(1, 5, 24)
+  sensitive_ = sensitive_ || (hints & IBUS_INPUT_HINT_PRIVATE);
+#endif
+}
+
+Metrics::Counter &EngineBase::unlearnedCommits() {
+  static auto &unlearned = Metrics::getInstance().counter(
+      "ibus_libime_unlearned_commits_total",
+      "Commits not learned from because the field is sensitive");
+  return unlearned;
+}
+
+bool EngineBase::learningAllowed() {
+  if (sensitive_) {
+    unlearnedCommits().inc();
+    return false;
+  }
+  return true;
+}
+
+void EngineBase::reset() {
+  LOG_DEBUG("Reset called");
+  FlightRecorder::getInstance().record(FlightEvent::Reset);
+  EngineMetrics::get().resets.inc();
+  cancelPrediction();
+  clearInput();
+  literal_candidates_.clear();
+  predicting_ = false;
+  completing_ = false;
+  completion_word_.clear();
+  current_page_ = 0;
+  cursor_pos_ = 0;
+  ibus_engine_hide_preedit_text(engine_);
+  ibus_engine_hide_lookup_table(engine_);
+  LOG_DEBUG("Reset complete");
+}
+
+void EngineBase::enable() {
+  LOG_INFO("Engine enabled");
+  reset();
+}
+
+void EngineBase::disable() {
+  LOG_INFO("Engine disabled");
+  reset();
+}
+
+void EngineBase::pageUp() {
+  if (current_page_ > 0) {
+    current_page_--;
+    cursor_pos_ = 0;
+    EngineMetrics::get().pageUps.inc();
+    updateLookupTable();
+  }
+}
+
+void EngineBase::pageDown() {
+  size_t max_page = (totalCandidates() + page_size_ - 1) / page_size_;
+
+  if (current_page_ + 1 < max_page) {
+    current_page_++;
+    cursor_pos_ = 0;
+    EngineMetrics::get().pageDowns.inc();
+    updateLookupTable();
+  }
+}
+
+void EngineBase::cursorUp() {
+  if (cursor_pos_ > 0) {
+    cursor_pos_--;
+    updateCursor();
+    return;
+  }
+  // Moving past the top of a page lands on the last candidate of the
+  // previous one
+  if (current_page_ > 0) {
+    current_page_--;
+    cursor_pos_ = page_size_ - 1;
+    EngineMetrics::get().pageUps.inc();
+    updateLookupTable();
+  }
+}
+
+void EngineBase::cursorDown() {
+  size_t index = current_page_ * page_size_ + cursor_pos_;
+  if (index + 1 >= totalCandidates()) {
+    return;
+  }
+  if (cursor_pos_ + 1 < page_size_) {
+    cursor_pos_++;
+    updateCursor();
+    return;
+  }
+  pageDown();
+}
+
+void EngineBase::toggleInputMode() {
+  clearCompletion();
+  english_mode_ = !english_mode_;
+  LOG_INFO("Input mode toggled: {}", english_mode_ ? "English" : "Chinese");
+  updateInputMode();
+}
+
+const std::string &EngineBase::toOutputScript(const std::string &text) {
+  if (!traditional_mode_) {
+    return text;
+  }
+  script_buffer_.clear();
+  S2TConverter::getInstance().convert(text, script_buffer_);
+  return script_buffer_;
+}
+
+void EngineBase::toggleTraditionalMode() {
+  if (!traditional_mode_ && !S2TConverter::getInstance().load()) {
+    LOG_WARN("Traditional Chinese requested but no conversion table loaded");
+    return;
+  }
+  traditional_mode_ = !traditional_mode_;
+  LOG_INFO("Output script toggled: {}",
+           traditional_mode_ ? "Traditional" : "Simplified");
+  updateScriptProperty();
+  if (hasInput()) {
+    updateLookupTable();
+  }
+}
+
+void EngineBase::toggleFullWidthMode() {
+  full_width_mode_ = !full_width_mode_;
+  LOG_INFO("Full-width mode toggled: {}", full_width_mode_ ? "on" : "off");
+  updateWidthProperty();
+}
+
+void EngineBase::initProperties() {
+  // Pooled properties come back reset to Chinese mode
+  properties_ = ContextPool::getInstance().acquireProperties();
+
+  // Register properties with engine
+  ibus_engine_register_properties(engine_, properties_.list);
+
+  LOG_INFO("Properties initialized");
+}
+
+bool EngineBase::syncModeProperty() {
+  if (!properties_.mode)
+    return false;
+
+  IBusPropState state =
+      english_mode_ ? PROP_STATE_CHECKED : PROP_STATE_UNCHECKED;
+  if (ibus_property_get_state(properties_.mode) == state) {
+    return false;
+  }
+
+  // Update label based on mode
+  const char *label = english_mode_ ? "En" : "中";
+
+  IBusText *label_text = ibus_text_new_from_string(label);
+  ibus_property_set_label(properties_.mode, label_text);
+  ibus_property_set_state(properties_.mode, state);
+
+  LOG_DEBUG("Mode property updated: {}", label);
+  return true;
+}
+
+void EngineBase::updateModeProperty() {
+  // Update the property in IBus only when it actually changed
+  if (syncModeProperty()) {
+    ibus_engine_update_property(engine_, properties_.mode);
+  }
+}
+
+void EngineBase::updateScriptProperty() {
+  if (!properties_.script)
+    return;
+
+  ibus_property_set_label(
+      properties_.script,
+      ibus_text_new_from_string(traditional_mode_ ? "繁" : "简"));
+  ibus_property_set_state(properties_.script, traditional_mode_
+                                                  ? PROP_STATE_CHECKED
+                                                  : PROP_STATE_UNCHECKED);
+  ibus_engine_update_property(engine_, properties_.script);
+}
+
+void EngineBase::updateWidthProperty() {
+  if (!properties_.width)
+    return;
+
+  // Pooled properties come back half-width
+  IBusPropState state =
+      full_width_mode_ ? PROP_STATE_CHECKED : PROP_STATE_UNCHECKED;
+  if (ibus_property_get_state(properties_.width) == state) {
+    return;
+  }
+  ibus_property_set_label(
+      properties_.width,
+      ibus_text_new_from_string(full_width_mode_ ? "全" : "半"));
+  ibus_property_set_state(properties_.width, state);
+  ibus_engine_update_property(engine_, properties_.width);
+}
+
+void EngineBase::showModeHint() {
+  hinted_mode = english_mode_;
+
+  // Update auxiliary text to show current mode
+  IBusText *text =
+      ibus_text_new_from_string(english_mode_ ? "English" : "中文");
+  ibus_engine_update_auxiliary_text(engine_, text, TRUE);
+
+  // Showing the hint again replaces the pending hide task
+  auto &scheduler = TaskScheduler::getInstance();
+  scheduler.cancel(aux_hide_task_);
+  aux_hide_task_ = scheduler.runLater(
+      kModeHintDuration,
+      [this]() {
+        aux_hide_task_ = 0;
+        ibus_engine_hide_auxiliary_text(engine_);
+      },
+      TaskScheduler::Priority::High);
+}
+
+void EngineBase::updateInputMode() {
+  showModeHint();
+
+  // Update icon
+  updateModeProperty();
+
+  // Clear any pending input or predictions when switching modes
+  if (hasInput() || predicting_) {
+    reset();
+  }
+}
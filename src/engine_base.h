@@ -0,0 +1,234 @@
+#ifndef ENGINE_BASE_H
+#define ENGINE_BASE_H
+
+#include <ibus.h>
+#include <libime/core/lattice.h>
+
+#include <bitset>
+#include <memory_resource>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "alloc_stats.h"
+#include "context_pool.h"
+#include "key_bindings.h"
+#include "mapped_trie.h"
+#include "metrics.h"
+#include "punctuation.h"
+#include "task_scheduler.h"
+
+// Engine activity counters exported through Metrics
+struct EngineMetrics {
+  Metrics::Counter &keystrokes;
+  Metrics::Counter &candidateCommits;
+  Metrics::Counter &enterCommits;
+  Metrics::Counter &shiftCommits;
+  Metrics::Counter &punctuationCommits;
+  Metrics::Counter &pageUps;
+  Metrics::Counter &pageDowns;
+  Metrics::Counter &tableRebuilds;
+  Metrics::Counter &cursorUpdates;
+  Metrics::Counter &resets;
+  Metrics::Gauge &instances;
+  // Selections by 1-based rank; the last slot collects ranks beyond it
+  Metrics::Counter *selections[11];
+
+  static EngineMetrics &get();
+};
+
+// Behaviour shared by every engine type registered with the IBus factory:
+// Chinese/English mode switching, punctuation, paging, the lookup table,
+// traditional Chinese output and the status bar properties. Subclasses own
+// the actual input context and decide how keys edit it.
+class EngineBase {
+public:
+  explicit EngineBase(IBusEngine *engine);
+  virtual ~EngineBase();
+
+  // Key event handling
+  virtual bool processKeyEvent(guint keyval, guint keycode, guint modifiers);
+
+  // Engine state management
+  virtual void focusIn();
+  void focusInId(const gchar *object_path, const gchar *client);
+  virtual void focusOut();
+  void focusOutId(const gchar *object_path);
+  virtual void reset();
+  virtual void enable();
+  virtual void disable();
+
+  // Candidate navigation
+  void pageUp();
+  void pageDown();
+  virtual void cursorUp();
+  virtual void cursorDown();
+  virtual void selectCandidate(size_t index) = 0;
+  // Select by index over all candidates, literal candidates first
+  void chooseCandidate(size_t index);
+  // Select by position on the current page, as the panel reports clicks
+  void choosePageCandidate(size_t position) {
+    chooseCandidate(current_page_ * page_size_ + position);
+  }
+  void toggleInputMode();
+  void toggleTraditionalMode();
+  void toggleFullWidthMode();
+
+  // IBus content type of the focused field
+  void setContentType(guint purpose, guint hints);
+  // Counter of the keys passed through untouched in the focused field, or
+  // null when its keys are decoded
+  Metrics::Counter *bypassCounter() const { return bypass_counter_; }
+  // The focused field is a password or marked private: nothing typed there
+  // is learned or recorded
+  bool sensitive() const { return sensitive_; }
+  // The decoder runs out of process and has gone away; the engine is to be
+  // replaced by a local one
+  virtual bool decoderLost() const { return false; }
+
+protected:
+  // Length of the composition in progress, zero when idle
+  virtual size_t inputLength() const = 0;
+  bool hasInput() const { return inputLength() > 0; }
+  // The raw key sequence typed so far, committed by Shift and Enter
+  virtual std::string rawInput() const = 0;
+  virtual void clearInput() = 0;
+  // Keys not taken by a key binding
+  virtual bool processInputKey(guint keyval, guint modifiers) = 0;
+  // Keys the composition takes as input ahead of their key bindings
+  virtual bool keepsKey(guint keyval, guint modifiers) const { return false; }
+  // Editing bound to keys; false passes the key on to the client
+  virtual bool deleteBackward() = 0;
+  virtual bool deleteForward() { return false; }
+  virtual bool moveCursor(int delta) { return false; }
+  virtual size_t candidateCount() const = 0;
+  // Append the text of decoder candidate index
+  virtual void appendCandidate(size_t index, std::pmr::string &text) const = 0;
+  static void appendSentence(const libime::SentenceResult &sentence,
+                             std::pmr::string &text) {
+    for (const auto *node : sentence.sentence()) {
+      text += node->word();
+    }
+  }
+  virtual void updatePreedit() = 0;
+  // Phrases likely to follow the text just committed, best first; empty
+  // when the engine cannot predict
+  virtual std::vector<std::string> predictNext() { return {}; }
+  // The prediction at index was chosen and committed
+  virtual void predictionCommitted(size_t index) {}
+
+  // Times one libime decode for the flight recorder and attributes its heap
+  // allocations to the library rather than to the front end
+  class DecodeScope {
+  public:
+    explicit DecodeScope(EngineBase &engine);
+    ~DecodeScope();
+
+  private:
+    EngineBase &engine_;
+    uint64_t start_;
+    AllocStats::LibraryScope library_;
+  };
+
+  // Run the action a key is bound to; false passes the key on
+  bool performAction(KeyAction action);
+
+  // Literal candidates followed by the decoder's
+  size_t totalCandidates() const {
+    return literal_candidates_.size() + candidateCount();
+  }
+
+  // Predict follow-up phrases once the main loop is idle after a commit
+  void schedulePrediction();
+  void dismissPredictions();
+
+  // Whether a commit may teach the user model; counts the commits it may not
+  bool learningAllowed();
+  static Metrics::Counter &unlearnedCommits();
+  // Input context last focused, as IBus names it
+  const std::string &objectPath() const { return object_path_; }
+
+  void updateUI();
+  void recordDecode(uint64_t start);
+  void updateLookupTable();
+  void commitString(const std::string &text);
+  // Commit the punctuation or full-width form of a key, if it has one
+  bool commitPunctuation(guint keyval);
+  std::string_view convertPunctuation(guint keyval);
+  const std::string &toOutputScript(const std::string &text);
+  void updateInputMode();
+
+  IBusEngine *engine_;
+
+  // Text shown ahead of the decoder's candidates and committed as is when
+  // chosen, e.g. an English word typed in Chinese mode
+  std::vector<std::string> literal_candidates_;
+  // The literal candidates are predictions shown without any input
+  bool predicting_ = false;
+  // The literal candidates complete the word typed in English mode
+  bool completing_ = false;
+
+  // UI state
+  size_t page_size_;
+  size_t current_page_;
+  size_t cursor_pos_; // Highlighted position on the current page
+
+  // Input mode state
+  bool english_mode_; // true = English mode, false = Chinese mode
+  bool toggle_pressed_; // Mode key is down with no other key in between
+  bool traditional_mode_; // Convert candidates and commits to traditional
+  bool full_width_mode_;  // Commit ASCII as full-width forms
+
+  // Punctuation state
+  const PunctuationTable *punctuation_; // Table for the focused client
+  // Keys whose next alternating form is the closing one (quotes)
+  std::bitset<PunctuationTable::kSize> punctuation_closing_;
+
+private:
+  void initProperties();
+  // Bring the mode property in line with english_mode_; true if it changed
+  bool syncModeProperty();
+  void updateModeProperty();
+  void showModeHint();
+  void updateScriptProperty();
+  void updateWidthProperty();
+  // Send a highlight move without rebuilding the candidates
+  void updateCursor();
+  void showPredictions();
+  void cancelPrediction();
+  // Track the word typed in English mode; the key still goes to the client
+  // unless it accepts a completion
+  bool completeEnglish(guint keyval, guint modifiers);
+  void showCompletions();
+  void acceptCompletion(size_t index);
+  void clearCompletion();
+
+  // Properties, checked out from the ContextPool
+  EngineProperties properties_;
+
+  // Candidates of the current page, kept so highlight moves only change the
+  // cursor
+  IBusLookupTable *lookup_table_;
+
+  // Scratch buffer for traditional Chinese conversion
+  std::string script_buffer_;
+
+  // Input context last focused, and its mode when focus came in
+  std::string object_path_;
+  bool focus_english_mode_ = false;
+
+  // Content type state, cleared on focus out
+  Metrics::Counter *bypass_counter_ = nullptr;
+  bool sensitive_ = false;
+
+  // Pending task hiding the mode hint shown by showModeHint
+  TaskScheduler::TaskId aux_hide_task_ = 0;
+  // Pending task computing predictions after a commit
+  TaskScheduler::TaskId prediction_task_ = 0;
+
+  // Word typed so far in English mode, and its node in the completion table
+  std::string completion_word_;
+  uint32_t completion_node_ = MappedTrie::kInvalid;
+};
+
+#endif // ENGINE_BASE_H
@@ -0,0 +1,46 @@
+#include "english_completer.h"
+
+#include "configs.h"
+#include "logger.h"
+
+EnglishCompleter::EnglishCompleter()
+    : enabled_(Config::getInstance().getEnglishCompletion()),
+      path_(Config::getInstance().getEnglishCompletionPath()) {}
+
+uint32_t EnglishCompleter::root() {
+  if (!load_attempted_) {
+    load_attempted_ = true;
+    if (table_.open(path_, kMagic)) {
+      LOG_INFO("English completion table loaded: {} ({} bytes)", path_,
+               table_.mappedSize());
+    } else {
+      LOG_WARN("No English completion table at {}", path_);
+    }
+  }
+  return table_.isOpen() ? MappedTrie::kRoot : MappedTrie::kInvalid;
+}
+
+uint32_t EnglishCompleter::next(uint32_t node, char c) const {
+  if (node == MappedTrie::kInvalid) {
+    return node;
+  }
+  if (c >= 'A' && c <= 'Z') {
+    c = static_cast<char>(c - 'A' + 'a');
+  }
+  return table_.child(node, static_cast<unsigned char>(c));
+}
+
+std::string_view EnglishCompleter::completions(uint32_t node) const {
+  if (node == MappedTrie::kInvalid || !table_.hasValue(node)) {
+    return {};
+  }
+  return table_.value(node);
+}
+
+std::string_view EnglishCompleter::nextWord(std::string_view &words) {
+  size_t end = words.find('\0');
+  std::string_view word = words.substr(0, end);
+  words = end == std::string_view::npos ? std::string_view()
+                                        : words.substr(end + 1);
+  return word;
+}
@@ -0,0 +1,59 @@
+#ifndef IBUS_LIBIME_ENGLISH_COMPLETER_H
+#define IBUS_LIBIME_ENGLISH_COMPLETER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include "mapped_trie.h"
+
+// Word completions offered while typing in English mode.
+//
+// The table is built offline by `ibus-libime-english completions`: a
+// MappedTrie keyed by every word prefix of kMinPrefix letters or more, whose
+// value lists at most kMaxCompletions longer words, most frequent first,
+// separated by NUL bytes. Callers step through the trie one typed letter at
+// a time, so completing a word costs one edge lookup per key and never
+// allocates. The table is mapped on the first letter typed in English mode.
+class EnglishCompleter {
+public:
+  static EnglishCompleter &getInstance() {
+    static EnglishCompleter instance;
+    return instance;
+  }
+
+  static constexpr std::string_view kMagic = "IBLCMP01";
+  static constexpr size_t kMinPrefix = 2;
+  static constexpr size_t kMaxCompletions = 5;
+
+  // Whether English mode offers completions ([english] complete)
+  bool enabled() const { return enabled_; }
+
+  // Node of the empty prefix, or MappedTrie::kInvalid when no table is
+  // available
+  uint32_t root();
+
+  // Node reached by typing c after the prefix at node, ignoring case;
+  // MappedTrie::kInvalid once no word starts with the prefix
+  uint32_t next(uint32_t node, char c) const;
+
+  // NUL-separated completions of the prefix at node, best first
+  std::string_view completions(uint32_t node) const;
+
+  // Split the first word off a completion list
+  static std::string_view nextWord(std::string_view &words);
+
+private:
+  EnglishCompleter();
+
+  bool enabled_;
+  bool load_attempted_ = false;
+  std::string path_;
+  MappedTrie table_;
+
+  EnglishCompleter(const EnglishCompleter &) = delete;
+  EnglishCompleter &operator=(const EnglishCompleter &) = delete;
+};
+
+#endif // IBUS_LIBIME_ENGLISH_COMPLETER_H
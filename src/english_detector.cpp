@@ -0,0 +1,153 @@
+#include "english_detector.h"
+
+#include <format>
+#include <memory_resource>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+#include "configs.h"
+#include "logger.h"
+
+namespace {
+
+// Every standard pinyin syllable, plus v for ü
+constexpr std::string_view kSyllables =
+    "a ai an ang ao ba bai ban bang bao bei ben beng bi bian biao bie bin "
+    "bing bo bu ca cai can cang cao ce cen ceng cha chai chan chang chao che "
+    "chen cheng chi chong chou chu chua chuai chuan chuang chui chun chuo ci "
+    "cong cou cu cuan cui cun cuo da dai dan dang dao de dei den deng di dia "
+    "dian diao die ding diu dong dou du duan dui dun duo e ei en eng er fa "
+    "fan fang fei fen feng fo fou fu ga gai gan gang gao ge gei gen geng gong "
+    "gou gu gua guai guan guang gui gun guo ha hai han hang hao he hei hen "
+    "heng hong hou hu hua huai huan huang hui hun huo ji jia jian jiang jiao "
+    "jie jin jing jiong jiu ju juan jue jun ka kai kan kang kao ke kei ken "
+    "keng kong kou ku kua kuai kuan kuang kui kun kuo la lai lan lang lao le "
+    "lei leng li lia lian liang liao lie lin ling liu lo long lou lu luan lue "
+    "lun luo lv lve ma mai man mang mao me mei men meng mi mian miao mie min "
+    "ming miu mo mou mu na nai nan nang nao ne nei nen neng ni nian niang "
+    "niao nie nin ning niu nong nou nu nuan nue nuo nv nve o ou pa pai pan "
+    "pang pao pei pen peng pi pian piao pie pin ping po pou pu qi qia qian "
+    "qiang qiao qie qin qing qiong qiu qu quan que qun ran rang rao re ren "
+    "reng ri rong rou ru rua ruan rui run ruo sa sai san sang sao se sen seng "
+    "sha shai shan shang shao she shei shen sheng shi shou shu shua shuai "
+    "shuan shuang shui shun shuo si song sou su suan sui sun suo ta tai tan "
+    "tang tao te teng ti tian tiao tie ting tong tou tu tuan tui tun tuo wa "
+    "wai wan wang wei wen weng wo wu xi xia xian xiang xiao xie xin xing xiong "
+    "xiu xu xuan xue xun ya yan yang yao ye yi yin ying yo yong you yu yuan "
+    "yue yun za zai zan zang zao ze zei zen zeng zha zhai zhan zhang zhao zhe "
+    "zhei zhen zheng zhi zhong zhou zhu zhua zhuai zhuan zhuang zhui zhun "
+    "zhuo zi zong zou zu zuan zui zun zuo";
+
+// Longest syllable, and the longest input checked against the word list
+constexpr size_t kMaxSyllable = 6;
+constexpr size_t kMaxWord = 64;
+// Input segmented without touching the heap; longer sentences still work
+constexpr size_t kInlineInput = 64;
+
+struct SyllableSets {
+  std::unordered_set<std::string_view> full;
+  std::unordered_set<std::string_view> prefixes; // Includes full syllables
+};
+
+const SyllableSets &syllables() {
+  static const SyllableSets sets = [] {
+    SyllableSets s;
+    std::string_view rest = kSyllables;
+    while (!rest.empty()) {
+      size_t space = rest.find(' ');
+      std::string_view syllable = rest.substr(0, space);
+      s.full.insert(syllable);
+      for (size_t n = 1; n <= syllable.size(); ++n) {
+        s.prefixes.insert(syllable.substr(0, n));
+      }
+      rest = space == std::string_view::npos ? std::string_view()
+                                             : rest.substr(space + 1);
+    }
+    return s;
+  }();
+  return sets;
+}
+
+// Whether input splits into tokens of the set, apostrophes separating
+// tokens explicitly
+bool segments(std::string_view input,
+              const std::unordered_set<std::string_view> &tokens) {
+  if (input.empty()) {
+    return false;
+  }
+  char buffer[4 * (kInlineInput + 1)];
+  std::pmr::monotonic_buffer_resource arena(buffer, sizeof(buffer));
+  std::pmr::string lower(input, &arena);
+  for (char &c : lower) {
+    if (c >= 'A' && c <= 'Z') {
+      c = static_cast<char>(c - 'A' + 'a');
+    }
+  }
+  std::string_view text(lower);
+
+  // reachable[i]: text[0, i) splits into tokens
+  std::pmr::vector<char> reachable(text.size() + 1, false, &arena);
+  reachable[0] = true;
+  for (size_t i = 0; i < text.size(); ++i) {
+    if (!reachable[i]) {
+      continue;
+    }
+    if (text[i] == '\'') {
+      reachable[i + 1] = true;
+      continue;
+    }
+    for (size_t n = 1; n <= kMaxSyllable && i + n <= text.size(); ++n) {
+      if (tokens.contains(text.substr(i, n))) {
+        reachable[i + n] = true;
+      }
+    }
+  }
+  return reachable[text.size()];
+}
+
+} // namespace
+
+EnglishDetector::EnglishDetector()
+    : enabled_(Config::getInstance().getEnglishDetection()),
+      path_(Config::getInstance().getEnglishWordListPath()) {}
+
+bool EnglishDetector::canBePinyin(std::string_view input) {
+  return segments(input, syllables().prefixes);
+}
+
+bool EnglishDetector::isFullPinyin(std::string_view input) {
+  return segments(input, syllables().full);
+}
+
+const MappedTrie *EnglishDetector::words() {
+  if (!load_attempted_) {
+    load_attempted_ = true;
+    if (words_.open(path_, kMagic)) {
+      LOG_INFO("English word list loaded: {} ({} bytes)", path_,
+               words_.mappedSize());
+    } else {
+      LOG_INFO("No English word list at {}, detecting by pinyin only", path_);
+    }
+  }
+  return words_.isOpen() ? &words_ : nullptr;
+}
+
+bool EnglishDetector::isWord(std::string_view input) {
+  const MappedTrie *trie = words();
+  if (!trie || input.size() > kMaxWord) {
+    return false;
+  }
+  // Walk the trie on the lowercased input without building a string
+  uint32_t node = MappedTrie::kRoot;
+  for (char c : input) {
+    if (c >= 'A' && c <= 'Z') {
+      c = static_cast<char>(c - 'A' + 'a');
+    }
+    node = trie->child(node, static_cast<unsigned char>(c));
+    if (node == MappedTrie::kInvalid) {
+      return false;
+    }
+  }
+  return trie->hasValue(node);
+}
@@ -0,0 +1,62 @@
+#ifndef IBUS_LIBIME_ENGLISH_DETECTOR_H
+#define IBUS_LIBIME_ENGLISH_DETECTOR_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include "mapped_trie.h"
+
+// Spots English typed in Chinese mode.
+//
+// Two checks, both without a dictionary decode: whether the input can be
+// pinyin at all (every letter belongs to a syllable or a syllable prefix),
+// and whether it is a word of the memory-mapped English word list built by
+// `ibus-libime-english build`. The word list is a MappedTrie whose values are
+// 32-bit word frequencies; it is mapped on first use.
+class EnglishDetector {
+public:
+  static EnglishDetector &getInstance() {
+    static EnglishDetector instance;
+    return instance;
+  }
+
+  static constexpr std::string_view kMagic = "IBLENG01";
+
+  // Whether detection is enabled ([english] detect)
+  bool enabled() const { return enabled_; }
+
+  // False when no segmentation into syllables and syllable prefixes
+  // (initials) exists, e.g. "iphone" or "update"; such input is English.
+  // Every other letter starts a syllable, so only an i, u or v that no
+  // syllable can take makes input fail, and "http" still can be pinyin.
+  static bool canBePinyin(std::string_view input);
+
+  // True when the input splits into complete syllables only, e.g. "women"
+  static bool isFullPinyin(std::string_view input);
+
+  // Whether the word list contains the input, ignoring case
+  bool isWord(std::string_view input);
+
+  // Whether the input should be offered as an English candidate next to
+  // the pinyin ones: a known word that is not plain complete pinyin
+  bool shouldOffer(std::string_view input) {
+    return isWord(input) && !isFullPinyin(input);
+  }
+
+  // The mapped word list, opened on first use; null when unavailable
+  const MappedTrie *words();
+
+private:
+  EnglishDetector();
+
+  bool enabled_;
+  bool load_attempted_ = false;
+  std::string path_;
+  MappedTrie words_;
+
+  EnglishDetector(const EnglishDetector &) = delete;
+  EnglishDetector &operator=(const EnglishDetector &) = delete;
+};
+
+#endif // IBUS_LIBIME_ENGLISH_DETECTOR_H
@@ -0,0 +1,193 @@
+#include "flight_recorder.h"
+
+#include <fcntl.h>
+#include <ibus.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <format>
+
+#include "configs.h"
+#include "logger.h"
+
+namespace {
+
+// Crash signals that trigger a final dump before the default action runs
+constexpr int kCrashSignals[] = {SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT};
+
+// Minimum time between two slow-keystroke dumps
+constexpr uint64_t kSlowDumpIntervalUs = 10 * 1000 * 1000;
+
+uint64_t clockMicroseconds(clockid_t clock) {
+  struct timespec ts;
+  clock_gettime(clock, &ts);
+  return static_cast<uint64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+bool writeAll(int fd, const void *data, size_t size) {
+  const char *p = static_cast<const char *>(data);
+  while (size > 0) {
+    ssize_t n = write(fd, p, size);
+    if (n < 0) {
+      return false;
+    }
+    p += n;
+    size -= static_cast<size_t>(n);
+  }
+  return true;
+}
+
+} // namespace
+
+FlightRecorder::FlightRecorder()
+    : mask_(0), head_(0), slow_key_us_(0), last_slow_dump_us_(0),
+      dump_path_{} {}
+
+void FlightRecorder::init() {
+  if (records_ || !Config::getInstance().getFlightRecorderEnabled()) {
+    return;
+  }
+
+  // Round the capacity up to a power of two so indexing is a mask
+  uint64_t capacity = 1;
+  uint64_t wanted =
+      std::min<uint64_t>(Config::getInstance().getFlightRecorderCapacity(),
+                         kMaxFlightRecords);
+  while (capacity < wanted) {
+    capacity <<= 1;
+  }
+  records_ = std::make_unique<FlightRecord[]>(capacity);
+  mask_ = capacity - 1;
+  slow_key_us_ = Config::getInstance().getSlowKeyThreshold() * 1000;
+
+  // Resolve the dump path now; the signal handler cannot allocate
+  const std::string &log_path = Logger::getInstance().getLogPath();
+  std::string path =
+      std::format("{}/flight-{}.bin",
+                  log_path.substr(0, log_path.find_last_of('/')), getpid());
+  strncpy(dump_path_, path.c_str(), sizeof(dump_path_) - 1);
+
+  installSignalHandlers();
+  LOG_INFO("Flight recorder enabled: {} events, dump path {}", capacity,
+           dump_path_);
+}
+
+void FlightRecorder::recordKey(uint32_t keyval, uint32_t modifiers,
+                               bool handled, uint32_t duration_us) {
+  FlightKeyClass key_class;
+  uint32_t recorded_keyval = 0;
+  if (keyval >= 'a' && keyval <= 'z') {
+    key_class = FlightKeyClass::Letter;
+  } else if (keyval >= 'A' && keyval <= 'Z') {
+    key_class = FlightKeyClass::Letter;
+  } else if (keyval >= '0' && keyval <= '9') {
+    key_class = FlightKeyClass::Digit;
+  } else if (keyval == ' ') {
+    key_class = FlightKeyClass::Space;
+  } else if (keyval > ' ' && keyval < 0x7f) {
+    key_class = FlightKeyClass::Punctuation;
+  } else if (keyval >= IBUS_KEY_KP_0 && keyval <= IBUS_KEY_KP_9) {
+    // Keypad keys that type text are classed like the main keyboard's
+    key_class = FlightKeyClass::Digit;
+  } else if ((keyval >= IBUS_KEY_KP_Multiply &&
+              keyval <= IBUS_KEY_KP_Divide) ||
+             keyval == IBUS_KEY_KP_Equal) {
+    key_class = FlightKeyClass::Punctuation;
+  } else if (keyval == IBUS_KEY_KP_Space) {
+    key_class = FlightKeyClass::Space;
+  } else if (keyval >= IBUS_KEY_Shift_L && keyval <= IBUS_KEY_Hyper_R) {
+    // Shift, Control, Alt, Super and friends
+    key_class = FlightKeyClass::Modifier;
+    recorded_keyval = keyval;
+  } else if (keyval >= 0xff00 && keyval <= 0xffff) {
+    // Editing, navigation and function keys carry no text
+    key_class = FlightKeyClass::Control;
+    recorded_keyval = keyval;
+  } else {
+    key_class = FlightKeyClass::Punctuation;
+  }
+
+  uint32_t flags = 0;
+  if (modifiers & IBUS_RELEASE_MASK) {
+    flags |= FlightFlagRelease;
+  }
+  if (handled) {
+    flags |= FlightFlagHandled;
+  }
+  record(FlightEvent::KeyEvent, flags, static_cast<uint32_t>(key_class),
+         recorded_keyval, duration_us);
+}
+
+void FlightRecorder::checkSlowKey(uint32_t duration_us) {
+  if (!records_ || slow_key_us_ == 0 || duration_us < slow_key_us_) {
+    return;
+  }
+
+  record(FlightEvent::SlowKey, 0, 0, 0, duration_us);
+  uint64_t now = nowMicroseconds();
+  if (last_slow_dump_us_ && now - last_slow_dump_us_ < kSlowDumpIntervalUs) {
+    return;
+  }
+  last_slow_dump_us_ = now;
+  LOG_WARN("Slow keystroke: {} us, dumping flight recorder to {}",
+           duration_us, dump_path_);
+  dump(FlightDumpReason::SlowKey);
+}
+
+bool FlightRecorder::dump(FlightDumpReason reason) {
+  if (!records_ || dump_path_[0] == '\0') {
+    return false;
+  }
+
+  int fd = open(dump_path_, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+  if (fd < 0) {
+    return false;
+  }
+
+  FlightDumpHeader header;
+  memcpy(header.magic, "IBLFREC1", sizeof(header.magic));
+  header.record_size = sizeof(FlightRecord);
+  header.capacity = static_cast<uint32_t>(mask_ + 1);
+  header.head = head_.load(std::memory_order_relaxed);
+  header.monotonic_us = nowMicroseconds();
+  header.realtime_us = clockMicroseconds(CLOCK_REALTIME);
+  header.reason = static_cast<uint32_t>(reason);
+  header.pid = static_cast<uint32_t>(getpid());
+
+  bool ok = writeAll(fd, &header, sizeof(header)) &&
+            writeAll(fd, records_.get(), sizeof(FlightRecord) * (mask_ + 1));
+  close(fd);
+  return ok;
+}
+
+uint64_t FlightRecorder::nowMicroseconds() {
+  return clockMicroseconds(CLOCK_MONOTONIC);
+}
+
+void FlightRecorder::installSignalHandlers() {
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  sigemptyset(&action.sa_mask);
+  action.sa_handler = onDumpSignal;
+  action.sa_flags = SA_RESTART;
+  sigaction(SIGUSR1, &action, nullptr);
+
+  // Crash handlers run once, then the default action takes over
+  action.sa_handler = onCrashSignal;
+  action.sa_flags = SA_RESETHAND | SA_NODEFER;
+  for (int sig : kCrashSignals) {
+    sigaction(sig, &action, nullptr);
+  }
+}
+
+void FlightRecorder::onDumpSignal(int sig) {
+  getInstance().dump(FlightDumpReason::Signal);
+}
+
+void FlightRecorder::onCrashSignal(int sig) {
+  getInstance().dump(FlightDumpReason::Crash);
+  raise(sig);
+}
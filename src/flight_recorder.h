@@ -0,0 +1,136 @@
+#ifndef IBUS_LIBIME_FLIGHT_RECORDER_H
+#define IBUS_LIBIME_FLIGHT_RECORDER_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+// Event types stored in a FlightRecord
+enum class FlightEvent : uint32_t {
+  KeyEvent = 1,  // a: key class, b: keyval (non-printable only), c: duration
+  Decode = 2,    // a: input length in bytes, b: candidates, c: duration
+  UiUpdate = 3,  // a: candidates on page, c: duration
+  FocusIn = 4,   //
+  FocusOut = 5,  //
+  Commit = 6,    // a: committed length in bytes
+  Reset = 7,     //
+  SlowKey = 8,   // c: duration that crossed the threshold
+};
+
+// Key classes recorded instead of the key itself, so a dump never contains
+// what the user typed
+enum class FlightKeyClass : uint32_t {
+  Letter = 1,
+  Digit = 2,
+  Punctuation = 3,
+  Space = 4,
+  Control = 5,
+  Modifier = 6,
+};
+
+// Flags stored in FlightRecord::flags
+enum FlightFlags : uint32_t {
+  FlightFlagRelease = 1 << 0,
+  FlightFlagHandled = 1 << 1,
+};
+
+// One fixed-size binary record; durations are in microseconds
+struct FlightRecord {
+  uint64_t timestamp_us; // CLOCK_MONOTONIC
+  uint32_t type;
+  uint32_t flags;
+  uint32_t a;
+  uint32_t b;
+  uint32_t c;
+  uint32_t reserved;
+};
+
+static_assert(sizeof(FlightRecord) == 32, "FlightRecord layout is on disk");
+
+// Most records the ring holds (32 MiB); dumps claiming more are corrupt
+constexpr uint32_t kMaxFlightRecords = 1u << 20;
+
+// Header written in front of the records in a dump file
+struct FlightDumpHeader {
+  char magic[8]; // "IBLFREC1"
+  uint32_t record_size;
+  uint32_t capacity;
+  uint64_t head;           // Total records ever written
+  uint64_t monotonic_us;   // CLOCK_MONOTONIC at dump time
+  uint64_t realtime_us;    // CLOCK_REALTIME at dump time
+  uint32_t reason;         // FlightDumpReason
+  uint32_t pid;
+};
+
+enum class FlightDumpReason : uint32_t {
+  Signal = 1,
+  SlowKey = 2,
+  Crash = 3,
+};
+
+// Fixed-size in-memory ring buffer of recent engine events.
+//
+// Recording is lock-free and never allocates. The buffer is dumped to
+// $XDG_STATE_HOME/ibus-libime/flight-<pid>.bin on SIGUSR1, on a crash signal,
+// or when a keystroke takes longer than the configured threshold. Use
+// ibus-libime-flight-decode to turn a dump into a readable timeline.
+class FlightRecorder {
+public:
+  static FlightRecorder &getInstance() {
+    static FlightRecorder instance;
+    return instance;
+  }
+
+  // Allocate the buffer and install signal handlers if enabled in the config
+  void init();
+
+  bool enabled() const { return records_ != nullptr; }
+
+  void record(FlightEvent type, uint32_t flags = 0, uint32_t a = 0,
+              uint32_t b = 0, uint32_t c = 0) {
+    if (!records_) {
+      return;
+    }
+    uint64_t index = head_.fetch_add(1, std::memory_order_relaxed);
+    FlightRecord &record = records_[index & mask_];
+    record.timestamp_us = nowMicroseconds();
+    record.type = static_cast<uint32_t>(type);
+    record.flags = flags;
+    record.a = a;
+    record.b = b;
+    record.c = c;
+    record.reserved = 0;
+  }
+
+  // Record a key event without its content
+  void recordKey(uint32_t keyval, uint32_t modifiers, bool handled,
+                 uint32_t duration_us);
+
+  // Dump the buffer if a keystroke was slower than the configured threshold
+  void checkSlowKey(uint32_t duration_us);
+
+  // Write the buffer to the dump file; async-signal-safe
+  bool dump(FlightDumpReason reason);
+
+  static uint64_t nowMicroseconds();
+
+private:
+  FlightRecorder();
+  ~FlightRecorder() = default;
+
+  static void installSignalHandlers();
+  static void onDumpSignal(int sig);
+  static void onCrashSignal(int sig);
+
+  std::unique_ptr<FlightRecord[]> records_;
+  uint64_t mask_;
+  std::atomic<uint64_t> head_;
+  uint32_t slow_key_us_;
+  uint64_t last_slow_dump_us_;
+  char dump_path_[4096];
+
+  FlightRecorder(const FlightRecorder &) = delete;
+  FlightRecorder &operator=(const FlightRecorder &) = delete;
+};
+
+#endif // IBUS_LIBIME_FLIGHT_RECORDER_H
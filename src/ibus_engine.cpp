@@ -2,10 +2,22 @@
 
 #include <glib.h>
 
+#include <cstring>
+#include <format>
 #include <iostream>
+#include <string_view>
+#include <vector>
 
+#include "alloc_stats.h"
+#include "configs.h"
+#include "flight_recorder.h"
+#include "key_arena.h"
 #include "logger.h"
+#include "metrics.h"
+#include "metrics_server.h"
 #include "pinyin_engine.h"
+#include "remote_pinyin_engine.h"
+#include "table_engine.h"
 
 // Static members
 IBusBus *IBusEngineWrapper::bus_ = nullptr;
@@ -42,14 +54,62 @@ static void ibus_libime_engine_property_activate(IBusEngine *engine,
 static void ibus_libime_engine_candidate_clicked(IBusEngine *engine,
                                                  guint index, guint button,
                                                  guint state);
+static void ibus_libime_engine_set_content_type(IBusEngine *engine,
+                                                guint purpose, guint hints);
 
 G_DEFINE_TYPE(IBusLibIMEEngine, ibus_libime_engine, IBUS_TYPE_ENGINE)
 
+static Metrics::Counter &local_fallbacks() {
+  return Metrics::getInstance().counter(
+      "ibus_libime_local_fallbacks_total",
+      "Pinyin engines decoding locally because the decode service is gone");
+}
+
+// Pinyin decodes in the shared service when it is enabled and running, and
+// in this process otherwise
+static EngineBase *create_pinyin_engine(IBusEngine *engine,
+                                        const PinyinProfile &profile) {
+  const auto &config = Config::getInstance();
+  if (config.getDecodeServiceEnabled()) {
+    auto client = std::make_unique<DecodeClient>();
+    if (client->connect(config.getDecodeServiceSocket(),
+                        RemotePinyinEngine::candidateLimit(profile))) {
+      return new RemotePinyinEngine(engine, profile, std::move(client));
+    }
+    local_fallbacks().inc();
+  }
+  return new PinyinEngine(engine, profile);
+}
+
+// The decode service went away under a remote engine: decode locally from
+// now on. The composition in progress is lost.
+static EngineBase *fall_back_to_local(IBusLibIMEEngine *libime_engine) {
+  IBusEngine *engine = IBUS_ENGINE(libime_engine);
+  auto *remote = static_cast<RemotePinyinEngine *>(libime_engine->input_engine);
+  const PinyinProfile &profile = remote->profile();
+  LOG_WARN("Decode service lost, decoding locally");
+  local_fallbacks().inc();
+  remote->reset();
+  delete remote;
+
+  auto *local = new PinyinEngine(engine, profile);
+  libime_engine->input_engine = local;
+  guint purpose = 0, hints = 0;
+  ibus_engine_get_content_type(engine, &purpose, &hints);
+  local->setContentType(purpose, hints);
+  if (engine->has_focus) {
+    local->focusIn();
+  }
+  return local;
+}
+
 static void ibus_libime_engine_class_init(IBusLibIMEEngineClass *klass) {
   GObjectClass *object_class = G_OBJECT_CLASS(klass);
   IBusEngineClass *engine_class = IBUS_ENGINE_CLASS(klass);
 
   object_class->constructor = ibus_libime_engine_constructor;
+  IBUS_OBJECT_CLASS(klass)->destroy =
+      (IBusObjectDestroyFunc)ibus_libime_engine_destroy;
 
   engine_class->process_key_event = ibus_libime_engine_process_key_event;
   engine_class->reset = ibus_libime_engine_reset;
@@ -65,6 +125,7 @@ static void ibus_libime_engine_class_init(IBusLibIMEEngineClass *klass) {
   engine_class->cursor_down = ibus_libime_engine_cursor_down;
   engine_class->property_activate = ibus_libime_engine_property_activate;
   engine_class->candidate_clicked = ibus_libime_engine_candidate_clicked;
+  engine_class->set_content_type = ibus_libime_engine_set_content_type;
 }
 
 static GObject *
@@ -77,86 +138,181 @@ ibus_libime_engine_constructor(GType type, guint n_construct_properties,
 
   // Set has-focus-id to TRUE if not set during construction
   g_object_set(obj, "has-focus-id", TRUE, NULL);
+
+  // The engine name is only known once construct properties are set
+  IBusLibIMEEngine *engine = (IBusLibIMEEngine *)obj;
+  const gchar *name = ibus_engine_get_name(IBUS_ENGINE(obj));
+  if (g_strcmp0(name, "libime-wubi") == 0) {
+    engine->input_engine = new TableEngine(IBUS_ENGINE(obj), "wubi");
+  } else if (g_strcmp0(name, "libime-cangjie") == 0) {
+    engine->input_engine = new TableEngine(IBUS_ENGINE(obj), "cangjie");
+  } else {
+    // libime-pinyin-<profile>, or the default profile for libime-pinyin
+    std::string_view suffix(name ? name : "");
+    std::string profile;
+    if (suffix.starts_with("libime-pinyin-")) {
+      profile = suffix.substr(strlen("libime-pinyin-"));
+    }
+    engine->input_engine = create_pinyin_engine(
+        IBUS_ENGINE(obj), Config::getInstance().getPinyinProfile(profile));
+  }
   return obj;
 }
 
 static void ibus_libime_engine_init(IBusLibIMEEngine *engine) {
-  engine->pinyin_engine = new PinyinEngine(IBUS_ENGINE(engine));
+  engine->input_engine = nullptr;
 }
 
 static void ibus_libime_engine_destroy(IBusLibIMEEngine *engine) {
-  delete engine->pinyin_engine;
-  engine->pinyin_engine = nullptr;
+  delete engine->input_engine;
+  engine->input_engine = nullptr;
 
   IBUS_OBJECT_CLASS(ibus_libime_engine_parent_class)
       ->destroy(IBUS_OBJECT(engine));
 }
 
+// Heap allocations of one key press; only called in profiling builds
+static void record_key_allocations(const AllocSnapshot &before, guint keyval) {
+  static const std::vector<uint64_t> bounds = {0,  1,  2,   4,   8,  16,
+                                               32, 64, 128, 256, 1024};
+  static auto &frontend = Metrics::getInstance().histogram(
+      "ibus_libime_keystroke_allocations",
+      "Heap allocations per key press outside libime", bounds);
+  static auto &library = Metrics::getInstance().histogram(
+      "ibus_libime_keystroke_library_allocations",
+      "Heap allocations per key press inside libime", bounds);
+  static auto &bytes = Metrics::getInstance().histogram(
+      "ibus_libime_keystroke_allocated_bytes",
+      "Heap bytes allocated per key press",
+      {0, 256, 1024, 4096, 16384, 65536, 262144, 1048576});
+  static auto &over_budget = Metrics::getInstance().counter(
+      "ibus_libime_keystroke_alloc_budget_exceeded_total",
+      "Letter key presses that allocated more than the front-end budget");
+
+  AllocSnapshot after = AllocStats::snapshot();
+  uint64_t library_count = after.library_count - before.library_count;
+  uint64_t frontend_count = after.count - before.count - library_count;
+  frontend.observe(frontend_count);
+  library.observe(library_count);
+  bytes.observe(after.bytes - before.bytes);
+  if (keyval >= 'a' && keyval <= 'z' &&
+      frontend_count > AllocStats::kKeystrokeBudget) {
+    over_budget.inc();
+  }
+}
+
 static gboolean ibus_libime_engine_process_key_event(IBusEngine *engine,
                                                      guint keyval,
                                                      guint keycode,
                                                      guint modifiers) {
+  static auto &latency = Metrics::getInstance().histogram(
+      "ibus_libime_keystroke_latency_microseconds",
+      "Time spent handling one key press in the engine",
+      {50, 100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000,
+       250000});
+
   IBusLibIMEEngine *libime_engine = (IBusLibIMEEngine *)engine;
-  return libime_engine->pinyin_engine->processKeyEvent(keyval, keycode,
-                                                       modifiers);
+  EngineBase *input_engine = libime_engine->input_engine;
+
+  // Fields such as passwords get their keys back untouched, before any
+  // timing, recording or decoding
+  if (Metrics::Counter *bypassed = input_engine->bypassCounter()) {
+    if (!(modifiers & IBUS_RELEASE_MASK)) {
+      bypassed->inc();
+    }
+    return FALSE;
+  }
+
+  KeyArena::Scope arena;
+  AllocSnapshot allocations = AllocStats::snapshot();
+  gint64 start = g_get_monotonic_time();
+  gboolean handled =
+      input_engine->processKeyEvent(keyval, keycode, modifiers);
+  if (input_engine->decoderLost()) {
+    input_engine = fall_back_to_local(libime_engine);
+    // A printable key is typed again, into a new composition
+    bool printable = keyval >= 0x20 && keyval < 0x7f &&
+                     !(modifiers & (IBUS_RELEASE_MASK | IBUS_CONTROL_MASK |
+                                    IBUS_MOD1_MASK));
+    if (printable) {
+      handled = input_engine->processKeyEvent(keyval, keycode, modifiers);
+    }
+  }
+  auto duration = static_cast<uint32_t>(g_get_monotonic_time() - start);
+  if (!input_engine->sensitive()) {
+    FlightRecorder::getInstance().recordKey(keyval, modifiers, handled,
+                                            duration);
+  }
+  if (!(modifiers & IBUS_RELEASE_MASK)) {
+    latency.observe(duration);
+    if constexpr (AllocStats::kEnabled) {
+      record_key_allocations(allocations, keyval);
+    }
+    FlightRecorder::getInstance().checkSlowKey(duration);
+  }
+  return handled;
 }
 
 static void ibus_libime_engine_focus_in(IBusEngine *engine) {
   IBusLibIMEEngine *libime_engine = (IBusLibIMEEngine *)engine;
-  libime_engine->pinyin_engine->focusIn();
+  libime_engine->input_engine->focusIn();
 }
 
 static void ibus_libime_engine_focus_in_id(IBusEngine *engine,
                                            const gchar *object_path,
                                            const gchar *client) {
   IBusLibIMEEngine *libime_engine = (IBusLibIMEEngine *)engine;
-  libime_engine->pinyin_engine->focusInId(object_path, client);
+  libime_engine->input_engine->focusInId(object_path, client);
 }
 
 static void ibus_libime_engine_focus_out(IBusEngine *engine) {
   IBusLibIMEEngine *libime_engine = (IBusLibIMEEngine *)engine;
-  libime_engine->pinyin_engine->focusOut();
+  libime_engine->input_engine->focusOut();
 }
 
 static void ibus_libime_engine_focus_out_id(IBusEngine *engine,
                                             const gchar *object_path) {
   IBusLibIMEEngine *libime_engine = (IBusLibIMEEngine *)engine;
-  libime_engine->pinyin_engine->focusOutId(object_path);
+  libime_engine->input_engine->focusOutId(object_path);
 }
 
 static void ibus_libime_engine_reset(IBusEngine *engine) {
   IBusLibIMEEngine *libime_engine = (IBusLibIMEEngine *)engine;
-  libime_engine->pinyin_engine->reset();
+  libime_engine->input_engine->reset();
 }
 
 static void ibus_libime_engine_enable(IBusEngine *engine) {
   IBusLibIMEEngine *libime_engine = (IBusLibIMEEngine *)engine;
-  libime_engine->pinyin_engine->enable();
+  libime_engine->input_engine->enable();
 }
 
 static void ibus_libime_engine_disable(IBusEngine *engine) {
   IBusLibIMEEngine *libime_engine = (IBusLibIMEEngine *)engine;
-  libime_engine->pinyin_engine->disable();
+  libime_engine->input_engine->disable();
 }
 
 static void ibus_libime_engine_page_up(IBusEngine *engine) {
   IBusLibIMEEngine *libime_engine = (IBusLibIMEEngine *)engine;
-  libime_engine->pinyin_engine->pageUp();
+  KeyArena::Scope arena;
+  libime_engine->input_engine->pageUp();
 }
 
 static void ibus_libime_engine_page_down(IBusEngine *engine) {
   IBusLibIMEEngine *libime_engine = (IBusLibIMEEngine *)engine;
-  libime_engine->pinyin_engine->pageDown();
+  KeyArena::Scope arena;
+  libime_engine->input_engine->pageDown();
 }
 
 static void ibus_libime_engine_cursor_up(IBusEngine *engine) {
   IBusLibIMEEngine *libime_engine = (IBusLibIMEEngine *)engine;
-  libime_engine->pinyin_engine->cursorUp();
+  KeyArena::Scope arena;
+  libime_engine->input_engine->cursorUp();
 }
 
 static void ibus_libime_engine_cursor_down(IBusEngine *engine) {
   IBusLibIMEEngine *libime_engine = (IBusLibIMEEngine *)engine;
-  libime_engine->pinyin_engine->cursorDown();
+  KeyArena::Scope arena;
+  libime_engine->input_engine->cursorDown();
 }
 
 static void ibus_libime_engine_property_activate(IBusEngine *engine,
@@ -166,7 +322,11 @@ static void ibus_libime_engine_property_activate(IBusEngine *engine,
 
   if (g_strcmp0(prop_name, "InputMode") == 0) {
     // Toggle input mode when user clicks the property
-    libime_engine->pinyin_engine->toggleInputMode();
+    libime_engine->input_engine->toggleInputMode();
+  } else if (g_strcmp0(prop_name, "TraditionalMode") == 0) {
+    libime_engine->input_engine->toggleTraditionalMode();
+  } else if (g_strcmp0(prop_name, "FullWidth") == 0) {
+    libime_engine->input_engine->toggleFullWidthMode();
   }
 }
 
@@ -174,22 +334,41 @@ static void ibus_libime_engine_candidate_clicked(IBusEngine *engine,
                                                  guint index, guint button,
                                                  guint state) {
   IBusLibIMEEngine *libime_engine = (IBusLibIMEEngine *)engine;
+  KeyArena::Scope arena;
   // Button 1 is left click (value is 1)
   if (button == 1) {
-    libime_engine->pinyin_engine->selectCandidate(index);
+    libime_engine->input_engine->choosePageCandidate(index);
   }
 }
 
+static void ibus_libime_engine_set_content_type(IBusEngine *engine,
+                                                guint purpose, guint hints) {
+  IBusLibIMEEngine *libime_engine = (IBusLibIMEEngine *)engine;
+  libime_engine->input_engine->setContentType(purpose, hints);
+}
+
 void ibus_libime_engine_register_type(IBusFactory *factory) {
   ibus_factory_add_engine(factory, "libime-pinyin", IBUS_TYPE_LIBIME_ENGINE);
+  for (const auto &profile : Config::getInstance().getPinyinProfiles()) {
+    if (!profile.name.empty()) {
+      std::string name = std::format("libime-pinyin-{}", profile.name);
+      ibus_factory_add_engine(factory, name.c_str(), IBUS_TYPE_LIBIME_ENGINE);
+    }
+  }
+  ibus_factory_add_engine(factory, "libime-wubi", IBUS_TYPE_LIBIME_ENGINE);
+  ibus_factory_add_engine(factory, "libime-cangjie", IBUS_TYPE_LIBIME_ENGINE);
 }
 
 // IBusEngineWrapper implementation
 void IBusEngineWrapper::init() {
   ibus_init();
+  FlightRecorder::getInstance().init();
 
-  // Initialize shared IME before creating any engine instances
-  PinyinEngine::initializeSharedIME();
+  // Initialize shared IME before creating any engine instances, unless the
+  // decode service holds it; fallback engines load it when first needed
+  if (!Config::getInstance().getDecodeServiceEnabled()) {
+    PinyinEngine::initializeSharedIME();
+  }
 
   bus_ = ibus_bus_new();
   g_signal_connect(bus_, "disconnected", G_CALLBACK(bus_disconnected_cb),
@@ -203,6 +382,8 @@ void IBusEngineWrapper::init() {
   if (!ibus_bus_request_name(bus_, "org.freedesktop.IBus.LibIME", 0)) {
     g_error("Failed to request bus name");
   }
+
+  MetricsServer::getInstance().start();
 }
 
 void IBusEngineWrapper::run() { ibus_main(); }
@@ -5,7 +5,7 @@
 
 #include <memory>
 
-class PinyinEngine;
+class EngineBase;
 
 class IBusEngineWrapper {
 public:
@@ -34,8 +34,8 @@ typedef struct _IBusLibIMEEngineClass IBusLibIMEEngineClass;
 struct _IBusLibIMEEngine {
   IBusEngine parent;
 
-  // Private data
-  PinyinEngine *pinyin_engine;
+  // Private data, created for the engine name requested by IBus
+  EngineBase *input_engine;
 };
 
 struct _IBusLibIMEEngineClass {
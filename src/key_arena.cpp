@@ -0,0 +1,20 @@
+#include "key_arena.h"
+
+#include "metrics.h"
+
+KeyArena::KeyArena() : arena_(buffer_, kSize, &overflow_) {}
+
+void KeyArena::reset() { arena_.release(); }
+
+void *KeyArena::Overflow::do_allocate(size_t bytes, size_t alignment) {
+  static auto &overflows = Metrics::getInstance().counter(
+      "ibus_libime_key_arena_overflows_total",
+      "Per-event scratch allocations that spilled to the heap");
+  overflows.inc();
+  return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+}
+
+void KeyArena::Overflow::do_deallocate(void *p, size_t bytes,
+                                       size_t alignment) {
+  std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+}
@@ -0,0 +1,58 @@
+#ifndef IBUS_LIBIME_KEY_ARENA_H
+#define IBUS_LIBIME_KEY_ARENA_H
+
+#include <cstddef>
+#include <memory_resource>
+
+// Scratch memory for temporaries built while handling one input event.
+//
+// Allocations bump a pointer through a fixed buffer and are all released at
+// once when the event is done, so per-candidate strings and the like cost no
+// heap allocations in steady state. Requests that do not fit spill to the
+// heap and are counted.
+class KeyArena {
+public:
+  static KeyArena &getInstance() {
+    static KeyArena instance;
+    return instance;
+  }
+
+  std::pmr::memory_resource *resource() { return &arena_; }
+
+  // Release everything handed out since the last reset
+  void reset();
+
+  // Resets the arena when the event handler it wraps returns
+  class Scope {
+  public:
+    Scope() = default;
+    ~Scope() { KeyArena::getInstance().reset(); }
+
+    Scope(const Scope &) = delete;
+    Scope &operator=(const Scope &) = delete;
+  };
+
+private:
+  KeyArena();
+
+  // Heap fallback that counts how often the buffer was too small
+  class Overflow : public std::pmr::memory_resource {
+  private:
+    void *do_allocate(size_t bytes, size_t alignment) override;
+    void do_deallocate(void *p, size_t bytes, size_t alignment) override;
+    bool do_is_equal(const memory_resource &other) const noexcept override {
+      return this == &other;
+    }
+  };
+
+  static constexpr size_t kSize = 16 * 1024;
+
+  alignas(std::max_align_t) std::byte buffer_[kSize];
+  Overflow overflow_;
+  std::pmr::monotonic_buffer_resource arena_;
+
+  KeyArena(const KeyArena &) = delete;
+  KeyArena &operator=(const KeyArena &) = delete;
+};
+
+#endif // IBUS_LIBIME_KEY_ARENA_H
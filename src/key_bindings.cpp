@@ -0,0 +1,160 @@
+#include "key_bindings.h"
+
+#include <ibus.h>
+
+#include <iterator>
+#include <string>
+
+#include "configs.h"
+#include "logger.h"
+
+namespace {
+
+constexpr size_t kActions = static_cast<size_t>(KeyAction::Count);
+
+// Config names of the actions, indexed by KeyAction
+constexpr std::string_view kActionNames[] = {
+    "", "togglemode", "pageup", "pagedown", "prevcandidate", "nextcandidate",
+    "selectfirst", "select1", "select2", "select3", "select4", "select5",
+    "select6", "select7", "select8", "select9", "select10", "commitraw",
+    "cancel", "backspace", "delete", "cursorleft", "cursorright", "complete",
+};
+static_assert(std::size(kActionNames) == kActions);
+
+struct DefaultBinding {
+  KeyAction action;
+  std::string_view keys;
+};
+
+constexpr DefaultBinding kDefaultBindings[] = {
+    {KeyAction::ToggleMode, "Shift_L,Shift_R"},
+    {KeyAction::PageUp, "Page_Up,minus"},
+    {KeyAction::PageDown, "Page_Down,equal"},
+    {KeyAction::PrevCandidate, "Up"},
+    {KeyAction::NextCandidate, "Down,Tab"},
+    {KeyAction::SelectFirst, "space"},
+    {KeyAction::Select1, "1"},
+    {KeyAction::Select2, "2"},
+    {KeyAction::Select3, "3"},
+    {KeyAction::Select4, "4"},
+    {KeyAction::Select5, "5"},
+    {KeyAction::Select6, "6"},
+    {KeyAction::Select7, "7"},
+    {KeyAction::Select8, "8"},
+    {KeyAction::Select9, "9"},
+    {KeyAction::Select10, "0"},
+    {KeyAction::CommitRaw, "Return,KP_Enter"},
+    {KeyAction::Cancel, "Escape"},
+    {KeyAction::Backspace, "BackSpace"},
+    {KeyAction::Delete, "Delete"},
+    {KeyAction::CursorLeft, "Left"},
+    {KeyAction::CursorRight, "Right"},
+    {KeyAction::Complete, "Tab"},
+};
+
+std::string_view trim(std::string_view text) {
+  size_t first = text.find_first_not_of(" \t");
+  if (first == std::string_view::npos) {
+    return {};
+  }
+  size_t last = text.find_last_not_of(" \t");
+  return text.substr(first, last - first + 1);
+}
+
+} // namespace
+
+KeyBindings::KeyBindings() {
+  for (const auto &binding : kDefaultBindings) {
+    bind(binding.action, binding.keys);
+  }
+
+  // Each configured action replaces all of its default keys
+  for (const auto &[name, keys] : Config::getInstance().getKeyBindings()) {
+    KeyAction action = KeyAction::None;
+    for (size_t i = 1; i < kActions; ++i) {
+      if (kActionNames[i] == name) {
+        action = static_cast<KeyAction>(i);
+      }
+    }
+    if (action == KeyAction::None) {
+      LOG_WARN("Ignoring unknown key binding action: {}", name);
+      continue;
+    }
+    unbind(action);
+    bind(action, keys);
+  }
+}
+
+void KeyBindings::bind(KeyAction action, std::string_view keys) {
+  // Mode switching is a tap that works with or without a composition, and
+  // English completion happens without one; everything else acts on the
+  // composition in progress
+  bool idle = action == KeyAction::ToggleMode || action == KeyAction::Complete;
+  bool composing = action != KeyAction::Complete;
+
+  while (!keys.empty()) {
+    size_t comma = keys.find(',');
+    std::string_view key = trim(keys.substr(0, comma));
+    keys = comma == std::string_view::npos ? std::string_view()
+                                           : keys.substr(comma + 1);
+    if (key.empty()) {
+      continue;
+    }
+
+    ModifierClass modifier = Plain;
+    if (key.starts_with("Control+")) {
+      modifier = Control;
+      key.remove_prefix(8);
+    } else if (key.starts_with("Shift+")) {
+      modifier = Shift;
+      key.remove_prefix(6);
+    }
+
+    std::string name(key);
+    size_t slot = keySlot(ibus_keyval_from_name(name.c_str()));
+    if (slot == kNoSlot) {
+      LOG_WARN("Ignoring unsupported key for {}: {}", actionName(action),
+               name);
+      continue;
+    }
+    if (composing) {
+      table_[index(slot, modifier, true)] = action;
+    }
+    if (idle) {
+      table_[index(slot, modifier, false)] = action;
+    }
+  }
+}
+
+void KeyBindings::unbind(KeyAction action) {
+  for (auto &bound : table_) {
+    if (bound == action) {
+      bound = KeyAction::None;
+    }
+  }
+}
+
+KeyAction KeyBindings::lookup(guint keyval, guint modifiers,
+                              bool composing) const {
+  if (modifiers & (IBUS_MOD1_MASK | IBUS_MOD4_MASK | IBUS_SUPER_MASK)) {
+    return KeyAction::None;
+  }
+  size_t slot = keySlot(keyval);
+  if (slot == kNoSlot) {
+    return KeyAction::None;
+  }
+  ModifierClass modifier = Plain;
+  if (modifiers & IBUS_CONTROL_MASK) {
+    modifier = Control;
+  } else if ((modifiers & IBUS_SHIFT_MASK) &&
+             (keyval <= ' ' || keyval > '~')) {
+    // Printable keyvals already carry Shift ('+' rather than '=')
+    modifier = Shift;
+  }
+  return table_[index(slot, modifier, composing)];
+}
+
+std::string_view KeyBindings::actionName(KeyAction action) {
+  size_t i = static_cast<size_t>(action);
+  return i < kActions ? kActionNames[i] : std::string_view();
+}
@@ -0,0 +1,97 @@
+#ifndef IBUS_LIBIME_KEY_BINDINGS_H
+#define IBUS_LIBIME_KEY_BINDINGS_H
+
+#include <glib.h>
+
+#include <array>
+#include <cstdint>
+#include <string_view>
+
+// What a bound key does
+enum class KeyAction : uint8_t {
+  None,
+  ToggleMode, // Tapping the key alone switches Chinese/English
+  PageUp,
+  PageDown,
+  PrevCandidate,
+  NextCandidate,
+  SelectFirst, // Highlighted candidate, the first one until moved
+  Select1,     // Select1..Select10 pick by position on the current page
+  Select2,
+  Select3,
+  Select4,
+  Select5,
+  Select6,
+  Select7,
+  Select8,
+  Select9,
+  Select10,
+  CommitRaw, // Commit the typed keys as they are
+  Cancel,
+  Backspace,
+  Delete,
+  CursorLeft,
+  CursorRight,
+  Complete, // Accept the first English completion (no composition)
+  Count
+};
+
+// Key bindings of the engine, from the built-in defaults and the [keys]
+// group of the config file.
+//
+// Bindings are compiled once into a dense table indexed by keyval, modifier
+// class and whether a composition is in progress, so dispatching a key is a
+// single array access.
+class KeyBindings {
+public:
+  static KeyBindings &getInstance() {
+    static KeyBindings instance;
+    return instance;
+  }
+
+  // Action bound to a key press, None when the key is unbound
+  KeyAction lookup(guint keyval, guint modifiers, bool composing) const;
+
+  // Whether keyval is tapped to switch the input mode (Shift by default)
+  bool isModeToggle(guint keyval) const {
+    size_t slot = keySlot(keyval);
+    return slot != kNoSlot &&
+           table_[index(slot, Plain, false)] == KeyAction::ToggleMode;
+  }
+
+  static std::string_view actionName(KeyAction action);
+
+private:
+  KeyBindings();
+
+  enum ModifierClass { Plain, Shift, Control, kModifierClasses };
+
+  // ASCII keyvals, then the 0xffxx function keys (BackSpace, Return, ...)
+  static constexpr size_t kKeySlots = 0x80 + 0x100;
+  static constexpr size_t kNoSlot = kKeySlots;
+
+  static constexpr size_t keySlot(guint keyval) {
+    if (keyval < 0x80) {
+      return keyval;
+    }
+    if (keyval >= 0xff00 && keyval <= 0xffff) {
+      return 0x80 + (keyval - 0xff00);
+    }
+    return kNoSlot;
+  }
+
+  static constexpr size_t index(size_t slot, ModifierClass modifier,
+                                bool composing) {
+    return (slot * kModifierClasses + modifier) * 2 + composing;
+  }
+
+  void bind(KeyAction action, std::string_view keys);
+  void unbind(KeyAction action);
+
+  std::array<KeyAction, kKeySlots * kModifierClasses * 2> table_{};
+
+  KeyBindings(const KeyBindings &) = delete;
+  KeyBindings &operator=(const KeyBindings &) = delete;
+};
+
+#endif // IBUS_LIBIME_KEY_BINDINGS_H
@@ -0,0 +1,109 @@
+#include "learning_queue.h"
+
+#include "configs.h"
+#include "context_pool.h"
+#include "logger.h"
+#include "metrics.h"
+#include "task_scheduler.h"
+
+using namespace libime;
+
+namespace {
+
+Metrics::Counter &learnedCounter() {
+  static auto &counter = Metrics::getInstance().counter(
+      "ibus_libime_learning_applied_total",
+      "Committed sentences applied to the user language model");
+  return counter;
+}
+
+Metrics::Counter &batchCounter() {
+  static auto &counter = Metrics::getInstance().counter(
+      "ibus_libime_learning_batches_total",
+      "Deferred learning batches flushed from the queue");
+  return counter;
+}
+
+Metrics::Counter &overflowCounter() {
+  static auto &counter = Metrics::getInstance().counter(
+      "ibus_libime_learning_overflows_total",
+      "Learning events applied synchronously because the queue was full");
+  return counter;
+}
+
+} // namespace
+
+LearningQueue::LearningQueue()
+    : capacity_(Config::getInstance().getLearningQueueSize()),
+      delay_ms_(Config::getInstance().getLearningDelay()) {
+  // Make sure the scheduler outlives this queue at exit
+  TaskScheduler::getInstance();
+}
+
+LearningQueue::~LearningQueue() {
+  TaskScheduler::getInstance().cancelKey(this);
+}
+
+void LearningQueue::enqueue(std::unique_ptr<PinyinContext> context) {
+  push({std::move(context), nullptr});
+}
+
+void LearningQueue::enqueue(std::function<void()> learn) {
+  push({nullptr, std::move(learn)});
+}
+
+void LearningQueue::push(Entry entry) {
+  if (capacity_ == 0) {
+    // Deferred learning disabled
+    learnOne(std::move(entry));
+    return;
+  }
+
+  if (queue_.size() >= capacity_) {
+    LOG_DEBUG("Learning queue full, applying oldest entry synchronously");
+    overflowCounter().inc();
+    auto oldest = std::move(queue_.front());
+    queue_.pop_front();
+    learnOne(std::move(oldest));
+  }
+
+  queue_.push_back(std::move(entry));
+  updateGauge();
+
+  // Run as soon as the main loop has nothing better to do, but never later
+  // than the configured delay so a busy loop cannot starve learning.
+  TaskScheduler::getInstance().runWhenIdle(
+      delay_ms_, [this]() { flush(); }, TaskScheduler::Priority::Normal, this);
+}
+
+void LearningQueue::flush() {
+  TaskScheduler::getInstance().cancelKey(this);
+  if (queue_.empty()) {
+    return;
+  }
+
+  LOG_DEBUG("Flushing {} pending learning events", queue_.size());
+  batchCounter().inc();
+  while (!queue_.empty()) {
+    auto entry = std::move(queue_.front());
+    queue_.pop_front();
+    learnOne(std::move(entry));
+  }
+  updateGauge();
+}
+
+void LearningQueue::learnOne(Entry entry) {
+  if (entry.context) {
+    entry.context->learn();
+    ContextPool::getInstance().releaseContext(std::move(entry.context));
+  } else {
+    entry.learn();
+  }
+  learnedCounter().inc();
+}
+
+void LearningQueue::updateGauge() {
+  static auto &pending = Metrics::getInstance().gauge(
+      "ibus_libime_learning_pending", "Learning events waiting in the queue");
+  pending.set(static_cast<int64_t>(queue_.size()));
+}
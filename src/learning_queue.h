@@ -0,0 +1,58 @@
+#ifndef IBUS_LIBIME_LEARNING_QUEUE_H
+#define IBUS_LIBIME_LEARNING_QUEUE_H
+
+#include <libime/pinyin/pinyincontext.h>
+
+#include <deque>
+#include <functional>
+#include <memory>
+
+// Defers user-model learning off the commit path.
+//
+// A committed context still holds the selection that learn() needs, so the
+// engine hands the whole context over and continues with a fresh one. Pinyin
+// contexts are queued as they are and go back to the ContextPool once learned;
+// other engines queue a callback that owns their context. The queue applies
+// pending learning in one batch once the main loop goes idle (or after a short
+// delay at the latest). The queue is bounded: when full, the oldest entry is
+// learned synchronously.
+class LearningQueue {
+public:
+  static LearningQueue &getInstance() {
+    static LearningQueue instance;
+    return instance;
+  }
+
+  // Take ownership of a context whose selection is complete
+  void enqueue(std::unique_ptr<libime::PinyinContext> context);
+  // Defer any other learning; learn runs once, on the main loop
+  void enqueue(std::function<void()> learn);
+
+  // Apply all pending learning now
+  void flush();
+
+  bool empty() const { return queue_.empty(); }
+
+private:
+  LearningQueue();
+  ~LearningQueue();
+
+  // A pinyin context, or a callback when there is none
+  struct Entry {
+    std::unique_ptr<libime::PinyinContext> context;
+    std::function<void()> learn;
+  };
+
+  void push(Entry entry);
+  void learnOne(Entry entry);
+  void updateGauge();
+
+  size_t capacity_;
+  unsigned int delay_ms_;
+  std::deque<Entry> queue_;
+
+  LearningQueue(const LearningQueue &) = delete;
+  LearningQueue &operator=(const LearningQueue &) = delete;
+};
+
+#endif // IBUS_LIBIME_LEARNING_QUEUE_H
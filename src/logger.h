@@ -30,6 +30,9 @@ public:
 
   LogLevel getLogLevel() const { return logLevel_; }
 
+  // Checked by the LOG_* macros so disabled messages are never formatted
+  bool isEnabled(LogLevel level) const { return level >= logLevel_; }
+
   void setLogLevel(const char *loglevel = nullptr) {
     // Priority: parameter > environment variable > config file
     if (!loglevel) {
@@ -140,22 +143,34 @@ private:
 // Convenience macros with std::format support
 #define LOG_DEBUG(fmt, ...)                                                    \
   do {                                                                         \
-    Logger::getInstance().debug(std::format(fmt __VA_OPT__(, ) __VA_ARGS__));  \
+    if (Logger::getInstance().isEnabled(LogLevel::DEBUG)) {                    \
+      Logger::getInstance().debug(                                             \
+          std::format(fmt __VA_OPT__(, ) __VA_ARGS__));                        \
+    }                                                                          \
   } while (0)
 
 #define LOG_INFO(fmt, ...)                                                     \
   do {                                                                         \
-    Logger::getInstance().info(std::format(fmt __VA_OPT__(, ) __VA_ARGS__));   \
+    if (Logger::getInstance().isEnabled(LogLevel::INFO)) {                     \
+      Logger::getInstance().info(                                              \
+          std::format(fmt __VA_OPT__(, ) __VA_ARGS__));                        \
+    }                                                                          \
   } while (0)
 
 #define LOG_WARN(fmt, ...)                                                     \
   do {                                                                         \
-    Logger::getInstance().warn(std::format(fmt __VA_OPT__(, ) __VA_ARGS__));   \
+    if (Logger::getInstance().isEnabled(LogLevel::WARN)) {                     \
+      Logger::getInstance().warn(                                              \
+          std::format(fmt __VA_OPT__(, ) __VA_ARGS__));                        \
+    }                                                                          \
   } while (0)
 
 #define LOG_ERROR(fmt, ...)                                                    \
   do {                                                                         \
-    Logger::getInstance().error(std::format(fmt __VA_OPT__(, ) __VA_ARGS__));  \
+    if (Logger::getInstance().isEnabled(LogLevel::ERROR)) {                    \
+      Logger::getInstance().error(                                             \
+          std::format(fmt __VA_OPT__(, ) __VA_ARGS__));                        \
+    }                                                                          \
   } while (0)
 
 #endif // IBUS_LIBIME_LOGGER_H
@@ -4,7 +4,9 @@
 #include <iostream>
 
 #include "ibus_engine.h"
+#include "learning_queue.h"
 #include "logger.h"
+#include "metrics.h"
 
 int main(int argc, char *argv[]) {
   // Set locale
@@ -46,5 +48,7 @@ int main(int argc, char *argv[]) {
   IBusEngineWrapper::run();
 
   LOG_INFO("Main loop exited");
+  LearningQueue::getInstance().flush();
+  LOG_INFO("Final metrics:\n{}", Metrics::getInstance().format());
   return 0;
 }
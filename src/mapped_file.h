@@ -0,0 +1,43 @@
+#ifndef IBUS_LIBIME_MAPPED_FILE_H
+#define IBUS_LIBIME_MAPPED_FILE_H
+
+#include <cstddef>
+#include <streambuf>
+#include <string>
+
+// Read-only memory mapping of a whole file
+class MappedFile {
+public:
+  MappedFile() = default;
+  ~MappedFile();
+
+  MappedFile(MappedFile &&other) noexcept;
+  MappedFile &operator=(MappedFile &&other) noexcept;
+
+  // Map the file; returns false (and stays unmapped) on any error
+  bool open(const std::string &path);
+  void close();
+
+  bool isOpen() const { return data_ != nullptr; }
+  const char *data() const { return static_cast<const char *>(data_); }
+  size_t size() const { return size_; }
+
+private:
+  void *data_ = nullptr;
+  size_t size_ = 0;
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+};
+
+// Read-only istream buffer over a mapped file, so dictionaries load without
+// copying the file through a read buffer first
+class MappedStreamBuf : public std::streambuf {
+public:
+  explicit MappedStreamBuf(const MappedFile &file) {
+    char *begin = const_cast<char *>(file.data());
+    setg(begin, begin, begin + file.size());
+  }
+};
+
+#endif // IBUS_LIBIME_MAPPED_FILE_H
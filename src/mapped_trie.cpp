@@ -0,0 +1,214 @@
+#include "mapped_trie.h"
+
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <vector>
+
+bool MappedTrie::open(const std::string &path, std::string_view magic) {
+  close();
+  if (!file_.open(path)) {
+    return false;
+  }
+
+  if (file_.size() < sizeof(TrieHeader)) {
+    close();
+    return false;
+  }
+  const auto *header = reinterpret_cast<const TrieHeader *>(file_.data());
+  if (magic.size() != sizeof(header->magic) ||
+      memcmp(header->magic, magic.data(), sizeof(header->magic)) != 0) {
+    close();
+    return false;
+  }
+
+  size_t expected = sizeof(TrieHeader) +
+                    sizeof(TrieNode) * static_cast<size_t>(header->node_count) +
+                    sizeof(TrieEdge) * static_cast<size_t>(header->edge_count) +
+                    header->value_size;
+  if (header->node_count == 0 || file_.size() < expected) {
+    close();
+    return false;
+  }
+
+  header_ = header;
+  nodes_ = reinterpret_cast<const TrieNode *>(file_.data() + sizeof(TrieHeader));
+  edges_ = reinterpret_cast<const TrieEdge *>(nodes_ + header->node_count);
+  values_ = reinterpret_cast<const char *>(edges_ + header->edge_count);
+  return true;
+}
+
+void MappedTrie::close() {
+  file_.close();
+  header_ = nullptr;
+  nodes_ = nullptr;
+  edges_ = nullptr;
+  values_ = nullptr;
+}
+
+uint32_t MappedTrie::child(uint32_t node, unsigned char label) const {
+  if (node >= header_->node_count) {
+    return kInvalid;
+  }
+  const TrieNode &n = nodes_[node];
+  if (n.first_edge > header_->edge_count ||
+      n.edge_count > header_->edge_count - n.first_edge) {
+    return kInvalid;
+  }
+
+  // Binary search over the sorted edge labels of this node
+  const TrieEdge *lo = edges_ + n.first_edge;
+  const TrieEdge *hi = lo + n.edge_count;
+  while (lo < hi) {
+    const TrieEdge *mid = lo + (hi - lo) / 2;
+    if (mid->label < label) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  if (lo != edges_ + n.first_edge + n.edge_count && lo->label == label) {
+    return lo->child;
+  }
+  return kInvalid;
+}
+
+uint32_t MappedTrie::find(std::string_view key) const {
+  uint32_t node = kRoot;
+  for (unsigned char c : key) {
+    node = child(node, c);
+    if (node == kInvalid) {
+      return kInvalid;
+    }
+  }
+  return node;
+}
+
+bool MappedTrie::hasValue(uint32_t node) const {
+  return node < header_->node_count &&
+         nodes_[node].value_offset != kNoValue;
+}
+
+std::string_view MappedTrie::value(uint32_t node) const {
+  if (!hasValue(node)) {
+    return {};
+  }
+  const TrieNode &n = nodes_[node];
+  if (n.value_offset > header_->value_size ||
+      n.value_size > header_->value_size - n.value_offset) {
+    return {};
+  }
+  return {values_ + n.value_offset, n.value_size};
+}
+
+size_t MappedTrie::longestMatch(std::string_view text,
+                                std::string_view *value) const {
+  size_t matched = 0;
+  uint32_t node = kRoot;
+  for (size_t i = 0; i < text.size(); ++i) {
+    node = child(node, static_cast<unsigned char>(text[i]));
+    if (node == kInvalid) {
+      break;
+    }
+    if (hasValue(node)) {
+      matched = i + 1;
+      *value = this->value(node);
+    }
+  }
+  return matched;
+}
+
+void TrieBuilder::insert(std::string_view key, std::string_view value) {
+  auto it = entries_.find(key);
+  if (it != entries_.end()) {
+    it->second = value;
+  } else {
+    entries_.emplace(std::string(key), std::string(value));
+  }
+}
+
+bool TrieBuilder::insertIfAbsent(std::string_view key, std::string_view value) {
+  if (entries_.find(key) != entries_.end()) {
+    return false;
+  }
+  entries_.emplace(std::string(key), std::string(value));
+  return true;
+}
+
+bool TrieBuilder::write(const std::string &path, std::string_view magic) const {
+  if (magic.size() != sizeof(TrieHeader::magic)) {
+    return false;
+  }
+
+  std::vector<const std::pair<const std::string, std::string> *> sorted;
+  sorted.reserve(entries_.size());
+  for (const auto &entry : entries_) {
+    sorted.push_back(&entry);
+  }
+
+  std::vector<TrieNode> nodes;
+  std::vector<TrieEdge> edges;
+  std::string values;
+
+  // Breadth-first construction. Each work item is a node together with the
+  // sorted range of keys below it; all keys in the range share the first
+  // `depth` bytes, and the shortest one (if it has exactly `depth` bytes) is
+  // the node's own value.
+  struct Work {
+    uint32_t node;
+    size_t begin;
+    size_t end;
+    size_t depth;
+  };
+  std::deque<Work> queue;
+  nodes.push_back({0, 0, MappedTrie::kNoValue, 0});
+  queue.push_back({0, 0, sorted.size(), 0});
+
+  while (!queue.empty()) {
+    Work work = queue.front();
+    queue.pop_front();
+
+    size_t i = work.begin;
+    if (i < work.end && sorted[i]->first.size() == work.depth) {
+      nodes[work.node].value_offset = static_cast<uint32_t>(values.size());
+      nodes[work.node].value_size =
+          static_cast<uint32_t>(sorted[i]->second.size());
+      values += sorted[i]->second;
+      ++i;
+    }
+
+    nodes[work.node].first_edge = static_cast<uint32_t>(edges.size());
+    while (i < work.end) {
+      auto label = static_cast<unsigned char>(sorted[i]->first[work.depth]);
+      size_t j = i + 1;
+      while (j < work.end &&
+             static_cast<unsigned char>(sorted[j]->first[work.depth]) ==
+                 label) {
+        ++j;
+      }
+      auto child = static_cast<uint32_t>(nodes.size());
+      nodes.push_back({0, 0, MappedTrie::kNoValue, 0});
+      edges.push_back({label, child});
+      queue.push_back({child, i, j, work.depth + 1});
+      i = j;
+    }
+    nodes[work.node].edge_count =
+        static_cast<uint32_t>(edges.size()) - nodes[work.node].first_edge;
+  }
+
+  TrieHeader header;
+  memcpy(header.magic, magic.data(), sizeof(header.magic));
+  header.node_count = static_cast<uint32_t>(nodes.size());
+  header.edge_count = static_cast<uint32_t>(edges.size());
+  header.value_size = static_cast<uint32_t>(values.size());
+  header.reserved = 0;
+
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  out.write(reinterpret_cast<const char *>(nodes.data()),
+            sizeof(TrieNode) * nodes.size());
+  out.write(reinterpret_cast<const char *>(edges.data()),
+            sizeof(TrieEdge) * edges.size());
+  out.write(values.data(), values.size());
+  return static_cast<bool>(out);
+}
@@ -0,0 +1,89 @@
+#ifndef IBUS_LIBIME_MAPPED_TRIE_H
+#define IBUS_LIBIME_MAPPED_TRIE_H
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <string_view>
+
+#include "mapped_file.h"
+
+// Compact byte-labelled trie with opaque values, built offline by TrieBuilder
+// and memory-mapped at runtime. Lookups walk the mapped arrays directly and
+// never allocate.
+//
+// File layout (host byte order):
+//   TrieHeader | TrieNode[node_count] | TrieEdge[edge_count] | value bytes
+// Edges of one node are contiguous and sorted by label.
+struct TrieHeader {
+  char magic[8]; // Identifies what the values mean, e.g. "IBLS2T01"
+  uint32_t node_count;
+  uint32_t edge_count;
+  uint32_t value_size;
+  uint32_t reserved;
+};
+
+struct TrieNode {
+  uint32_t first_edge;
+  uint32_t edge_count;
+  uint32_t value_offset;
+  uint32_t value_size; // 0 with value_offset == kNoValue means no value
+};
+
+struct TrieEdge {
+  uint32_t label; // Key byte
+  uint32_t child; // Node index
+};
+
+class MappedTrie {
+public:
+  static constexpr uint32_t kRoot = 0;
+  static constexpr uint32_t kInvalid = UINT32_MAX;
+  static constexpr uint32_t kNoValue = UINT32_MAX;
+
+  // Map a trie file; fails if the file is truncated or the magic differs
+  bool open(const std::string &path, std::string_view magic);
+  void close();
+
+  bool isOpen() const { return header_ != nullptr; }
+  size_t mappedSize() const { return file_.size(); }
+  uint32_t nodeCount() const { return header_ ? header_->node_count : 0; }
+
+  // Follow one byte from node; kInvalid if there is no such edge
+  uint32_t child(uint32_t node, unsigned char label) const;
+
+  // Node reached by key, or kInvalid
+  uint32_t find(std::string_view key) const;
+
+  bool hasValue(uint32_t node) const;
+  std::string_view value(uint32_t node) const;
+
+  // Length of the longest key with a value that prefixes text (0 if none);
+  // its value is stored in *value
+  size_t longestMatch(std::string_view text, std::string_view *value) const;
+
+private:
+  MappedFile file_;
+  const TrieHeader *header_ = nullptr;
+  const TrieNode *nodes_ = nullptr;
+  const TrieEdge *edges_ = nullptr;
+  const char *values_ = nullptr;
+};
+
+// Collects key/value pairs and writes them in the MappedTrie format
+class TrieBuilder {
+public:
+  // Insert or replace the value for key
+  void insert(std::string_view key, std::string_view value);
+  // Insert only if key is not present yet
+  bool insertIfAbsent(std::string_view key, std::string_view value);
+
+  size_t size() const { return entries_.size(); }
+
+  bool write(const std::string &path, std::string_view magic) const;
+
+private:
+  std::map<std::string, std::string, std::less<>> entries_;
+};
+
+#endif // IBUS_LIBIME_MAPPED_TRIE_H
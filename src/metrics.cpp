@@ -0,0 +1,118 @@
+#include "metrics.h"
+
+#include <algorithm>
+#include <format>
+
+Metrics::Histogram::Histogram(std::vector<uint64_t> bounds)
+    : bounds_(std::move(bounds)) {
+  std::sort(bounds_.begin(), bounds_.end());
+  buckets_ = std::make_unique<std::atomic<uint64_t>[]>(bounds_.size() + 1);
+}
+
+void Metrics::Histogram::observe(uint64_t value) {
+  size_t i = std::lower_bound(bounds_.begin(), bounds_.end(), value) -
+             bounds_.begin();
+  buckets_[i].fetch_add(1, std::memory_order_relaxed);
+  count_.fetch_add(1, std::memory_order_relaxed);
+  sum_.fetch_add(value, std::memory_order_relaxed);
+}
+
+uint64_t Metrics::Histogram::bucket(size_t i) const {
+  return buckets_[i].load(std::memory_order_relaxed);
+}
+
+Metrics::Counter &Metrics::counter(const std::string &name,
+                                   const std::string &help) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto &entry = entries_[name];
+  if (!entry.counter) {
+    entry.kind = Kind::Counter;
+    entry.help = help;
+    entry.counter = std::make_unique<Counter>();
+  }
+  return *entry.counter;
+}
+
+Metrics::Gauge &Metrics::gauge(const std::string &name,
+                               const std::string &help) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto &entry = entries_[name];
+  if (!entry.gauge) {
+    entry.kind = Kind::Gauge;
+    entry.help = help;
+    entry.gauge = std::make_unique<Gauge>();
+  }
+  return *entry.gauge;
+}
+
+Metrics::Histogram &Metrics::histogram(const std::string &name,
+                                       const std::string &help,
+                                       std::vector<uint64_t> bounds) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto &entry = entries_[name];
+  if (!entry.histogram) {
+    entry.kind = Kind::Histogram;
+    entry.help = help;
+    entry.histogram = std::make_unique<Histogram>(std::move(bounds));
+  }
+  return *entry.histogram;
+}
+
+void Metrics::gaugeCallback(const std::string &name, const std::string &help,
+                            std::function<int64_t()> callback) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto &entry = entries_[name];
+  entry.kind = Kind::GaugeCallback;
+  entry.help = help;
+  entry.callback = std::move(callback);
+}
+
+std::string Metrics::format() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::string out;
+  std::string last_base;
+
+  for (const auto &[name, entry] : entries_) {
+    // Labelled series of one metric share a single HELP/TYPE header
+    std::string base = name.substr(0, name.find('{'));
+    if (base != last_base) {
+      const char *type = "gauge";
+      if (entry.kind == Kind::Counter) {
+        type = "counter";
+      } else if (entry.kind == Kind::Histogram) {
+        type = "histogram";
+      }
+      out += std::format("# HELP {} {}\n# TYPE {} {}\n", base, entry.help,
+                         base, type);
+      last_base = base;
+    }
+
+    switch (entry.kind) {
+    case Kind::Counter:
+      out += std::format("{} {}\n", name, entry.counter->value());
+      break;
+    case Kind::Gauge:
+      out += std::format("{} {}\n", name, entry.gauge->value());
+      break;
+    case Kind::GaugeCallback:
+      out += std::format("{} {}\n", name, entry.callback());
+      break;
+    case Kind::Histogram: {
+      const auto &histogram = *entry.histogram;
+      uint64_t cumulative = 0;
+      for (size_t i = 0; i < histogram.bounds().size(); ++i) {
+        cumulative += histogram.bucket(i);
+        out += std::format("{}_bucket{{le=\"{}\"}} {}\n", name,
+                           histogram.bounds()[i], cumulative);
+      }
+      cumulative += histogram.bucket(histogram.bounds().size());
+      out += std::format("{}_bucket{{le=\"+Inf\"}} {}\n", name, cumulative);
+      out += std::format("{}_sum {}\n", name, histogram.sum());
+      out += std::format("{}_count {}\n", name, histogram.count());
+      break;
+    }
+    }
+  }
+
+  return out;
+}
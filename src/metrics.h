@@ -0,0 +1,102 @@
+#ifndef IBUS_LIBIME_METRICS_H
+#define IBUS_LIBIME_METRICS_H
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Process-wide registry of engine metrics.
+//
+// Metrics are registered by name on first use and live for the whole process,
+// so call sites can keep a reference and update it with a single relaxed
+// atomic operation:
+//
+//   static auto &hits = Metrics::getInstance().counter("name", "help");
+//   hits.inc();
+//
+// Names may carry Prometheus-style labels, e.g. `foo_total{pool="context"}`.
+class Metrics {
+public:
+  class Counter {
+  public:
+    void inc(uint64_t n = 1) { value_.fetch_add(n, std::memory_order_relaxed); }
+    uint64_t value() const { return value_.load(std::memory_order_relaxed); }
+
+  private:
+    std::atomic<uint64_t> value_{0};
+  };
+
+  class Gauge {
+  public:
+    void set(int64_t v) { value_.store(v, std::memory_order_relaxed); }
+    void add(int64_t d) { value_.fetch_add(d, std::memory_order_relaxed); }
+    int64_t value() const { return value_.load(std::memory_order_relaxed); }
+
+  private:
+    std::atomic<int64_t> value_{0};
+  };
+
+  // Cumulative histogram over integer observations (e.g. microseconds)
+  class Histogram {
+  public:
+    explicit Histogram(std::vector<uint64_t> bounds);
+
+    void observe(uint64_t value);
+
+    const std::vector<uint64_t> &bounds() const { return bounds_; }
+    // Observations <= bounds()[i]; index bounds().size() is +Inf
+    uint64_t bucket(size_t i) const;
+    uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+    uint64_t sum() const { return sum_.load(std::memory_order_relaxed); }
+
+  private:
+    std::vector<uint64_t> bounds_;
+    std::unique_ptr<std::atomic<uint64_t>[]> buckets_;
+    std::atomic<uint64_t> count_{0};
+    std::atomic<uint64_t> sum_{0};
+  };
+
+  static Metrics &getInstance() {
+    static Metrics instance;
+    return instance;
+  }
+
+  Counter &counter(const std::string &name, const std::string &help);
+  Gauge &gauge(const std::string &name, const std::string &help);
+  Histogram &histogram(const std::string &name, const std::string &help,
+                       std::vector<uint64_t> bounds);
+
+  // Register a gauge whose value is computed when a snapshot is taken
+  void gaugeCallback(const std::string &name, const std::string &help,
+                     std::function<int64_t()> callback);
+
+  // Render all metrics in the Prometheus text exposition format
+  std::string format() const;
+
+private:
+  enum class Kind { Counter, Gauge, GaugeCallback, Histogram };
+
+  struct Entry {
+    Kind kind;
+    std::string help;
+    std::unique_ptr<Counter> counter;
+    std::unique_ptr<Gauge> gauge;
+    std::unique_ptr<Histogram> histogram;
+    std::function<int64_t()> callback;
+  };
+
+  Metrics() = default;
+
+  mutable std::mutex mutex_;
+  std::map<std::string, Entry> entries_;
+
+  Metrics(const Metrics &) = delete;
+  Metrics &operator=(const Metrics &) = delete;
+};
+
+#endif // IBUS_LIBIME_METRICS_H
@@ -0,0 +1,108 @@
+#include "metrics_server.h"
+
+#include <gio/gunixsocketaddress.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <format>
+
+#include "configs.h"
+#include "logger.h"
+#include "metrics.h"
+
+MetricsServer::MetricsServer() : service_(nullptr) {}
+
+MetricsServer::~MetricsServer() { stop(); }
+
+void MetricsServer::start() {
+  if (service_ || !Config::getInstance().getMetricsEnabled()) {
+    return;
+  }
+
+  socketPath_ = Config::getInstance().getMetricsSocketPath();
+  // A bare socket name lives in the working directory, which exists
+  size_t slash = socketPath_.find_last_of('/');
+  if (slash != std::string::npos && slash > 0) {
+    std::string dir = socketPath_.substr(0, slash);
+    g_mkdir_with_parents(dir.c_str(), 0700);
+  }
+  // A previous engine process may have left its socket behind
+  unlink(socketPath_.c_str());
+
+  service_ = g_socket_service_new();
+  GSocketAddress *address = g_unix_socket_address_new(socketPath_.c_str());
+  GError *error = nullptr;
+  if (!g_socket_listener_add_address(
+          G_SOCKET_LISTENER(service_), address, G_SOCKET_TYPE_STREAM,
+          G_SOCKET_PROTOCOL_DEFAULT, nullptr, nullptr, &error)) {
+    LOG_ERROR("Failed to listen on metrics socket {}: {}", socketPath_,
+              error ? error->message : "unknown error");
+    if (error) {
+      g_error_free(error);
+    }
+    g_object_unref(address);
+    g_object_unref(service_);
+    service_ = nullptr;
+    return;
+  }
+  g_object_unref(address);
+
+  g_signal_connect(service_, "incoming", G_CALLBACK(onIncoming), this);
+  g_socket_service_start(service_);
+  registerProcessGauges();
+  LOG_INFO("Metrics available on {}", socketPath_);
+}
+
+void MetricsServer::stop() {
+  if (!service_) {
+    return;
+  }
+  g_socket_service_stop(service_);
+  g_socket_listener_close(G_SOCKET_LISTENER(service_));
+  g_object_unref(service_);
+  service_ = nullptr;
+  unlink(socketPath_.c_str());
+}
+
+void MetricsServer::registerProcessGauges() {
+  Metrics::getInstance().gaugeCallback(
+      "ibus_libime_resident_memory_bytes", "Resident set size of the engine",
+      []() -> int64_t {
+        // Second field of statm is the resident page count
+        FILE *statm = fopen("/proc/self/statm", "r");
+        if (!statm) {
+          return 0;
+        }
+        long size = 0;
+        long resident = 0;
+        if (fscanf(statm, "%ld %ld", &size, &resident) != 2) {
+          resident = 0;
+        }
+        fclose(statm);
+        return static_cast<int64_t>(resident) * sysconf(_SC_PAGESIZE);
+      });
+}
+
+gboolean MetricsServer::onIncoming(GSocketService *service,
+                                   GSocketConnection *connection,
+                                   GObject *source, gpointer user_data) {
+  static auto &scrapes = Metrics::getInstance().counter(
+      "ibus_libime_metrics_scrapes_total", "Metrics socket connections served");
+  scrapes.inc();
+
+  std::string payload = Metrics::getInstance().format();
+  GOutputStream *output =
+      g_io_stream_get_output_stream(G_IO_STREAM(connection));
+  GError *error = nullptr;
+  if (!g_output_stream_write_all(output, payload.data(), payload.size(),
+                                 nullptr, nullptr, &error)) {
+    LOG_WARN("Failed to write metrics: {}",
+             error ? error->message : "unknown error");
+    if (error) {
+      g_error_free(error);
+      error = nullptr;
+    }
+  }
+  g_io_stream_close(G_IO_STREAM(connection), nullptr, nullptr);
+  return TRUE;
+}
@@ -0,0 +1,43 @@
+#ifndef IBUS_LIBIME_METRICS_SERVER_H
+#define IBUS_LIBIME_METRICS_SERVER_H
+
+#include <gio/gio.h>
+
+#include <string>
+
+// Serves a Metrics snapshot on a Unix domain socket.
+//
+// Every client that connects receives the current metrics in the Prometheus
+// text format and the connection is closed, so a local agent can scrape the
+// engine with e.g. `socat - UNIX-CONNECT:<socket>`. The socket is served from
+// the GLib main loop.
+class MetricsServer {
+public:
+  static MetricsServer &getInstance() {
+    static MetricsServer instance;
+    return instance;
+  }
+
+  // Start listening if enabled in the config; safe to call more than once
+  void start();
+  void stop();
+
+  const std::string &getSocketPath() const { return socketPath_; }
+
+private:
+  MetricsServer();
+  ~MetricsServer();
+
+  static void registerProcessGauges();
+  static gboolean onIncoming(GSocketService *service,
+                             GSocketConnection *connection, GObject *source,
+                             gpointer user_data);
+
+  GSocketService *service_;
+  std::string socketPath_;
+
+  MetricsServer(const MetricsServer &) = delete;
+  MetricsServer &operator=(const MetricsServer &) = delete;
+};
+
+#endif // IBUS_LIBIME_METRICS_SERVER_H
@@ -1,49 +1,235 @@
 #include "pinyin_engine.h"
 
-#include <glibmm.h>
 #include <ibus.h>
 #include <libime/core/userlanguagemodel.h>
 #include <libime/pinyin/pinyindictionary.h>
 
+#include <algorithm>
 #include <cstdlib>
+#include <filesystem>
 #include <iostream>
-#include <map>
+#include <memory_resource>
+#include <unordered_map>
 
+#include "abbreviation_index.h"
 #include "config.h"
+#include "context_pool.h"
+#include "english_detector.h"
+#include "flight_recorder.h"
+#include "key_arena.h"
+#include "learning_queue.h"
 #include "logger.h"
+#include "mapped_file.h"
+#include "metrics.h"
 
 using namespace libime;
 
-struct PinyinContextStatus {
-  bool englishMode;
+namespace {
+
+struct EnglishMetrics {
+  Metrics::Counter &switches;
+  Metrics::Counter &offers;
+  Metrics::Counter &decodesSkipped;
+
+  static EnglishMetrics &get() {
+    static EnglishMetrics metrics{
+        Metrics::getInstance().counter(
+            "ibus_libime_english_switches_total",
+            "Compositions taken over as English because they cannot be "
+            "pinyin"),
+        Metrics::getInstance().counter(
+            "ibus_libime_english_offers_total",
+            "Keys after which an English word was offered as a candidate"),
+        Metrics::getInstance().counter(
+            "ibus_libime_english_decodes_skipped_total",
+            "Letter keys typed into English input without a pinyin decode")};
+    return metrics;
+  }
 };
 
-static std::map<std::string, PinyinContextStatus> context_status_map;
+// Symbols kept in English input, so URLs and identifiers stay together
+constexpr std::string_view kEnglishSymbols = "./:-_@#?=&~+%";
 
-// Initialize static member
-std::shared_ptr<PinyinIME> PinyinEngine::shared_ime_ = nullptr;
+bool isEnglishKey(guint keyval) {
+  if (keyval >= 0x80) {
+    return false;
+  }
+  char ch = static_cast<char>(keyval);
+  return g_ascii_isalnum(ch) ||
+         kEnglishSymbols.find(ch) != std::string_view::npos;
+}
+
+// Committed words kept as the context of chained predictions
+constexpr size_t kPredictionContextWords = 4;
+
+// Words before the cursor given to the decoder as context, and characters
+// read instead when the text was not committed by the engine
+constexpr size_t kSeedContextWords = 2;
+constexpr size_t kSeedContextChars = 2;
+// Clients whose last committed words are kept
+constexpr size_t kMaxClientContexts = 64;
+
+// The text last committed in a client and the decoder's words for it
+struct ClientContext {
+  std::string text;
+  std::vector<std::string> words;
+};
 
-PinyinEngine::PinyinEngine(IBusEngine *engine)
-    : engine_(engine), page_size_(Config::getInstance().getPageSize()),
-      current_page_(0), english_mode_(false), shift_pressed_(false),
-      double_quote_left_(true), single_quote_left_(true),
-      mode_prop_(nullptr), prop_list_(nullptr) {
-  LOG_INFO("PinyinEngine constructor called");
+std::unordered_map<std::string, ClientContext> client_contexts;
+
+Metrics::Counter &contextSelectionCounter(const char *name,
+                                          const char *context) {
+  return Metrics::getInstance().counter(
+      std::format("ibus_libime_{}_total{{context=\"{}\"}}", name, context),
+      "Pinyin candidates selected, by whether decoding saw the text before "
+      "the cursor");
+}
+
+struct ContextMetrics {
+  Metrics::Counter &commitSeeds;
+  Metrics::Counter &textSeeds;
+  Metrics::Counter &seededSelections;
+  Metrics::Counter &seededFirst;
+  Metrics::Counter &plainSelections;
+  Metrics::Counter &plainFirst;
+
+  static ContextMetrics &get() {
+    auto &registry = Metrics::getInstance();
+    auto seeds = [&](const char *source) -> Metrics::Counter & {
+      return registry.counter(
+          std::format("ibus_libime_context_seeds_total{{source=\"{}\"}}",
+                      source),
+          "Compositions decoded after the text before the cursor, by where "
+          "its words came from");
+    };
+    static ContextMetrics metrics{
+        seeds("commit"),
+        seeds("text"),
+        contextSelectionCounter("candidate_selections_by_context", "seeded"),
+        contextSelectionCounter("first_candidate_selections", "seeded"),
+        contextSelectionCounter("candidate_selections_by_context", "none"),
+        contextSelectionCounter("first_candidate_selections", "none")};
+    return metrics;
+  }
+};
+
+struct StreamingMetrics {
+  Metrics::Histogram &decodedLength;
+  Metrics::Counter &locks;
+  Metrics::Counter &lockedLetters;
+
+  static StreamingMetrics &get() {
+    static StreamingMetrics metrics{
+        Metrics::getInstance().histogram(
+            "ibus_libime_pinyin_decoded_length",
+            "Unlocked pinyin letters decoded after a letter key",
+            {4, 8, 12, 16, 24, 32, 48, 64, 96}),
+        Metrics::getInstance().counter(
+            "ibus_libime_prefix_locks_total",
+            "Stable leading words locked in long compositions"),
+        Metrics::getInstance().counter(
+            "ibus_libime_prefix_locked_letters_total",
+            "Pinyin letters no longer decoded because they were locked")};
+    return metrics;
+  }
+};
+
+struct AbbreviationMetrics {
+  Metrics::Counter &lookups;
+  Metrics::Counter &phrases;
+  Metrics::Histogram &duration;
+
+  static AbbreviationMetrics &get() {
+    static AbbreviationMetrics metrics{
+        Metrics::getInstance().counter(
+            "ibus_libime_abbreviation_lookups_total",
+            "Initials-only inputs looked up in the abbreviation index"),
+        Metrics::getInstance().counter(
+            "ibus_libime_abbreviation_phrases_total",
+            "Phrases from the abbreviation index shown as candidates"),
+        Metrics::getInstance().histogram(
+            "ibus_libime_abbreviation_lookup_microseconds",
+            "Time spent looking up and merging abbreviation phrases",
+            {1, 2, 5, 10, 25, 50, 100, 250, 1000})};
+    return metrics;
+  }
+};
+
+// Load a binary pinyin dictionary through a mapping; failures are logged
+// and the dictionary is left empty
+bool loadDictionary(PinyinDictionary &dict, size_t index,
+                    const std::string &path) {
+  MappedFile file;
+  if (!file.open(path)) {
+    LOG_WARN("Failed to map dictionary: {}", path);
+    return false;
+  }
+  gint64 start = g_get_monotonic_time();
+  try {
+    MappedStreamBuf buf(file);
+    std::istream in(&buf);
+    dict.load(index, in, PinyinDictFormat::Binary);
+  } catch (const std::exception &e) {
+    LOG_ERROR("Failed to load dictionary {}: {}", path, e.what());
+    return false;
+  }
+  LOG_INFO("Dictionary {} loaded ({} bytes) in {}us", path, file.size(),
+           g_get_monotonic_time() - start);
+  return true;
+}
+
+// Load a user history snapshot, such as one pretrained by
+// ibus-libime-history, into the user language model
+bool loadUserHistory(UserLanguageModel &model, const std::string &path) {
+  MappedFile file;
+  if (!file.open(path)) {
+    LOG_WARN("Failed to map user history: {}", path);
+    return false;
+  }
+  gint64 start = g_get_monotonic_time();
+  try {
+    MappedStreamBuf buf(file);
+    std::istream in(&buf);
+    model.load(in);
+  } catch (const std::exception &e) {
+    LOG_ERROR("Failed to load user history {}: {}", path, e.what());
+    model.history().clear();
+    return false;
+  }
+  LOG_INFO("User history {} loaded ({} bytes) in {}us", path, file.size(),
+           g_get_monotonic_time() - start);
+  return true;
+}
+
+PinyinFuzzyFlags fuzzyFlagsFor(const PinyinProfile &profile) {
+  if (profile.fuzzyFlags == 0) {
+    // Default: Inner + CommonTypo
+    return PinyinFuzzyFlags{PinyinFuzzyFlag::Inner,
+                            PinyinFuzzyFlag::CommonTypo};
+  }
+  // Use configured flags
+  return static_cast<PinyinFuzzyFlags>(profile.fuzzyFlags);
+}
+
+} // namespace
+
+// Initialize static members
+std::shared_ptr<PinyinIME> PinyinEngine::shared_ime_ = nullptr;
+const PinyinProfile *PinyinEngine::active_profile_ = nullptr;
+std::unique_ptr<Prediction> PinyinEngine::prediction_;
+
+PinyinEngine::PinyinEngine(IBusEngine *engine, const PinyinProfile &profile)
+    : EngineBase(engine), profile_(profile) {
+  LOG_INFO("PinyinEngine constructor called (profile: {})",
+           profile_.name.empty() ? "default" : profile_.name);
+  page_size_ = profile_.pageSize;
   initializeIME();
-  initProperties();
   LOG_INFO("PinyinEngine initialized successfully");
 }
 
 PinyinEngine::~PinyinEngine() {
-  // Clean up properties
-  if (mode_prop_) {
-    g_object_unref(mode_prop_);
-    mode_prop_ = nullptr;
-  }
-  if (prop_list_) {
-    g_object_unref(prop_list_);
-    prop_list_ = nullptr;
-  }
+  // Hand the context back for the next engine instance
+  ContextPool::getInstance().releaseContext(std::move(context_));
 }
 
 void PinyinEngine::initializeSharedIME() {
@@ -69,29 +255,74 @@ void PinyinEngine::initializeSharedIME() {
                             PinyinDictFormat::Binary);
   LOG_INFO("Dictionary loaded");
 
-  // Configure IME
-  int nbest = Config::getInstance().getNBest();
-  shared_ime_->setNBest(nbest);
+  // Lexicons compiled by ibus-libime-dict follow the system dictionary;
+  // imported user phrases have the user slot
+  const auto &config = Config::getInstance();
+  PinyinDictionary *dict = shared_ime_->dict();
+  for (const auto &path : config.getDictionaryPaths()) {
+    dict->addEmptyDict();
+    loadDictionary(*dict, dict->dictSize() - 1, path);
+  }
+  std::error_code ec;
+  if (std::filesystem::exists(config.getUserDictPath(), ec)) {
+    loadDictionary(*dict, PinyinDictionary::UserDict,
+                   config.getUserDictPath());
+  }
+  if (std::filesystem::exists(config.getUserHistoryPath(), ec)) {
+    loadUserHistory(*shared_ime_->model(), config.getUserHistoryPath());
+  }
+
+  // Configure IME with the default profile
+  const auto &profiles = Config::getInstance().getPinyinProfiles();
+  const PinyinProfile &profile = profiles.front();
+  shared_ime_->setNBest(profile.nbest);
+  shared_ime_->setFuzzyFlags(fuzzyFlagsFor(profile));
+  active_profile_ = &profile;
+  if (Config::getInstance().getPredictionEnabled()) {
+    UserLanguageModel *model = shared_ime_->model();
+    prediction_ = std::make_unique<Prediction>();
+    prediction_->setLanguageModel(model);
+    prediction_->setHistoryBigram(&model->history());
+  }
+  LOG_INFO("Shared IME configured: NBest={}, FuzzyFlags={}", profile.nbest,
+           profile.fuzzyFlags);
+  LOG_INFO("{} pinyin profile(s) share one dictionary and language model",
+           profiles.size());
+}
 
-  int fuzzyFlagsValue = Config::getInstance().getFuzzyFlags();
-  PinyinFuzzyFlags flags;
-  if (fuzzyFlagsValue == 0) {
-    // Default: Inner + CommonTypo
-    flags =
-        PinyinFuzzyFlags{PinyinFuzzyFlag::Inner, PinyinFuzzyFlag::CommonTypo};
-  } else {
-    // Use configured flags
-    flags = static_cast<PinyinFuzzyFlags>(fuzzyFlagsValue);
+void PinyinEngine::activateProfile() {
+  if (active_profile_ == &profile_) {
+    return;
+  }
+  static auto &switches = Metrics::getInstance().counter(
+      "ibus_libime_pinyin_profile_switches_total",
+      "Times the shared IME was reconfigured for another pinyin profile");
+
+  // Changing IME options resets every context of the shared IME, including
+  // the ones still waiting to be learned from
+  LearningQueue::getInstance().flush();
+  PinyinFuzzyFlags flags = fuzzyFlagsFor(profile_);
+  if (shared_ime_->nbest() != static_cast<size_t>(profile_.nbest)) {
+    shared_ime_->setNBest(profile_.nbest);
+  }
+  if (!(shared_ime_->fuzzyFlags() == flags)) {
+    shared_ime_->setFuzzyFlags(flags);
   }
-  shared_ime_->setFuzzyFlags(flags);
-  LOG_INFO("Shared IME configured: NBest={}, FuzzyFlags={}", nbest,
-           fuzzyFlagsValue);
+  active_profile_ = &profile_;
+  switches.inc();
+  LOG_DEBUG("Pinyin profile activated: {}",
+            profile_.name.empty() ? "default" : profile_.name);
 }
 
 void PinyinEngine::cleanupSharedIME() {
   if (shared_ime_) {
     LOG_INFO("Cleaning up shared IME");
+    LearningQueue::getInstance().flush();
+    // Pooled contexts reference the shared IME
+    ContextPool::getInstance().clear();
+    prediction_.reset();
     shared_ime_.reset();
+    active_profile_ = nullptr;
   }
 }
 
@@ -112,107 +343,77 @@ void PinyinEngine::initializeIME() {
     initializeSharedIME();
   }
 
-  // Create context using shared IME
-  context_ = std::make_unique<PinyinContext>(shared_ime_.get());
-  LOG_INFO("PinyinContext created for this instance");
+  // Reuse a pooled context for the shared IME when available
+  context_ = ContextPool::getInstance().acquireContext(shared_ime_.get());
+  LOG_INFO("PinyinContext ready for this instance");
 }
 
-bool PinyinEngine::processKeyEvent(guint keyval, guint keycode,
-                                   guint modifiers) {
-  LOG_DEBUG("processKeyEvent: keyval=0x{:x} keycode={} modifiers=0x{:x}",
-            keyval, keycode, modifiers);
+bool PinyinEngine::keepsKey(guint keyval, guint modifiers) const {
+  // Digits and symbols such as - and = would otherwise select or page
+  return !english_.empty() && isEnglishKey(keyval) &&
+         !(modifiers & (IBUS_CONTROL_MASK | IBUS_MOD1_MASK | IBUS_MOD4_MASK |
+                        IBUS_SUPER_MASK));
+}
 
-  // Handle Shift key for mode switching
-  bool is_shift = (keyval == IBUS_Shift_L || keyval == IBUS_Shift_R);
+bool PinyinEngine::processInputKey(guint keyval, guint modifiers) {
+  auto &detector = EnglishDetector::getInstance();
 
-  if (is_shift && !(modifiers & IBUS_RELEASE_MASK)) {
-    // Shift key pressed
-    if (!shift_pressed_) {
-      shift_pressed_ = true;
-    }
-    return FALSE; // Let other modifiers work
-  }
-
-  if (is_shift && (modifiers & IBUS_RELEASE_MASK)) {
-    // Shift key released
-    if (shift_pressed_) {
-      if (context_->size() > 0) {
-        LOG_INFO("Shift released with pending input, committing raw input: {}",
-                 context_->userInput());
-        std::string raw_input = context_->userInput();
-        reset();
-        commitString(raw_input);
-      }
-      toggleInputMode();
+  // English input continues without decoding; words, URLs and identifiers
+  // keep their digits and symbols
+  if (!english_.empty()) {
+    if (isEnglishKey(keyval)) {
+      typeEnglish(static_cast<char>(keyval));
+      return TRUE;
     }
-    shift_pressed_ = false;
-    return FALSE;
-  }
-
-  // If Shift was pressed and another key is pressed, reset the flag
-  if (shift_pressed_ && !is_shift) {
-    shift_pressed_ = false;
-  }
-
-  // Ignore release events for other keys
-  if (modifiers & IBUS_RELEASE_MASK) {
-    LOG_DEBUG("Ignoring key release event");
-    return FALSE;
-  }
-
-  // Pass through if has Ctrl, Alt or Super (Win) modifier
-  if (modifiers &
-      (IBUS_CONTROL_MASK | IBUS_MOD1_MASK | IBUS_MOD4_MASK | IBUS_SUPER_MASK)) {
-    LOG_DEBUG("Passing through: has Ctrl/Alt/Super modifier");
-    return FALSE;
-  }
-
-  // In English mode, pass through all keys
-  if (english_mode_) {
-    LOG_DEBUG("English mode: passing through");
+    // Anything else ends the English input, which goes out ahead of the key
+    std::string text = english_;
+    reset();
+    commitString(text);
     return FALSE;
   }
 
-  LOG_DEBUG("Current context size: {}", context_->size());
-
-  // If no input, pass through
-  if (context_->size() == 0) {
-    // Only handle input keys
-    if ((keyval >= 'a' && keyval <= 'z') || keyval == '\'') {
-      LOG_DEBUG("Processing input key with empty context");
-      return processInputKey(keyval, modifiers);
-    }
-  }
-
-  // Handle control keys when we have input
-  if (processControlKey(keyval, modifiers)) {
-    LOG_DEBUG("Control key handled");
-    return TRUE;
-  }
-
-  // Handle input keys
-  bool result = processInputKey(keyval, modifiers);
-  LOG_DEBUG("Input key processed: {}", result ? "handled" : "passed through");
-  return result;
-}
-
-bool PinyinEngine::processInputKey(guint keyval, guint modifiers) {
   // Handle punctuation in Chinese mode (only when no pending input)
   if (!english_mode_ && context_->size() == 0) {
-    std::string punct = convertPunctuation(keyval);
-    if (!punct.empty()) {
-      commitString(punct);
+    if (commitPunctuation(keyval)) {
       return TRUE;
     }
   }
 
+  // A capital letter starts a word rather than pinyin
+  if (detector.enabled() && context_->size() == 0 && keyval >= 'A' &&
+      keyval <= 'Z') {
+    EnglishMetrics::get().switches.inc();
+    typeEnglish(static_cast<char>(keyval));
+    return TRUE;
+  }
+
   // Handle letter input
   if (keyval >= 'a' && keyval <= 'z') {
+    if (detector.enabled() && detectEnglish(static_cast<char>(keyval))) {
+      return TRUE;
+    }
+    // A new composition should see everything committed before it
+    if (context_->size() == 0) {
+      activateProfile();
+      if (!LearningQueue::getInstance().empty()) {
+        LearningQueue::getInstance().flush();
+      }
+      seedContext();
+    }
     char ch = static_cast<char>(keyval);
     LOG_DEBUG("Typing letter: {}", ch);
-    context_->type(std::string(1, ch));
+    {
+      DecodeScope decode(*this);
+      context_->type(std::string_view(&ch, 1));
+    }
     LOG_DEBUG("Context after typing: size={} input={}", context_->size(),
               context_->userInput());
+    StreamingMetrics::get().decodedLength.observe(
+        context_->size() - context_->selectedLength());
+    if (Config::getInstance().getStreamingEnabled()) {
+      lockStablePrefix();
+    }
+    offerLiteralCandidates();
     updateUI();
     return TRUE;
   }
@@ -220,115 +421,204 @@ bool PinyinEngine::processInputKey(guint keyval, guint modifiers) {
   // Handle apostrophe for pinyin separation
   if (keyval == '\'' && context_->size() > 0) {
     LOG_DEBUG("Typing apostrophe");
-    context_->type("'");
+    {
+      DecodeScope decode(*this);
+      context_->type("'");
+    }
+    offerLiteralCandidates();
     updateUI();
     return TRUE;
   }
 
-  // Handle number selection (1-9, 0)
-  if (keyval >= '0' && keyval <= '9' && context_->size() > 0) {
-    size_t index = keyval - '1' + current_page_ * page_size_;
-    if (keyval == '0') {
-      index = 9 + current_page_ * page_size_;
-    }
-    LOG_DEBUG("Number key pressed: {} -> candidate index {}", keyval - '0',
-              index);
-    selectCandidate(index);
-    return TRUE;
+  return FALSE;
+}
+
+void PinyinEngine::lockStablePrefix() {
+  const auto &candidates = context_->candidates();
+  if (candidates.empty() || context_->cursor() != context_->size()) {
+    leading_words_.clear();
+    return;
   }
 
-  // Handle space - select first candidate
-  if (keyval == ' ' && context_->size() > 0) {
-    size_t index = current_page_ * page_size_;
-    LOG_DEBUG(
-        "Space pressed -> selecting first candidate on page {} (index {})",
-        current_page_, index);
-    selectCandidate(index);
-    return TRUE;
+  // Words the best sentence still starts with have stayed one more key;
+  // the ones after the first difference start over
+  const auto &best = candidates[0].sentence();
+  size_t same = 0;
+  while (same < leading_words_.size() && same < best.size() &&
+         leading_words_[same].word == best[same]->word() &&
+         leading_words_[same].end == best[same]->to()->index()) {
+    ++leading_words_[same].keys;
+    ++same;
+  }
+  leading_words_.erase(leading_words_.begin() + same, leading_words_.end());
+  for (size_t i = same; i < best.size(); ++i) {
+    leading_words_.push_back(
+        {std::string(best[i]->word()), best[i]->to()->index(), 1});
+  }
+
+  // The last word is the one being typed and is never locked
+  const auto &config = Config::getInstance();
+  size_t unlocked = context_->size() - context_->selectedLength();
+  if (leading_words_.size() < 2 ||
+      leading_words_.front().keys < config.getStreamingStableKeys() ||
+      unlocked < static_cast<size_t>(config.getStreamingMinLength())) {
+    return;
   }
+  // Locking is a partial selection of the word's own candidate
+  const LeadingWord &first = leading_words_.front();
+  for (size_t i = 0; i < candidates.size(); ++i) {
+    const auto &sentence = candidates[i].sentence();
+    if (sentence.size() != 1 || sentence[0]->word() != first.word ||
+        sentence[0]->to()->index() != first.end) {
+      continue;
+    }
+    size_t selected = context_->selectedLength();
+    {
+      DecodeScope decode(*this);
+      context_->select(i);
+    }
+    auto &metrics = StreamingMetrics::get();
+    metrics.locks.inc();
+    metrics.lockedLetters.inc(context_->selectedLength() - selected);
+    LOG_DEBUG("Locked leading word after {} keys, {} letters left to decode",
+              first.keys, context_->size() - context_->selectedLength());
+    leading_words_.erase(leading_words_.begin());
+    return;
+  }
+}
 
-  return FALSE;
+bool PinyinEngine::detectEnglish(char next) {
+  const std::string &input = context_->userInput();
+  std::pmr::string candidate(KeyArena::getInstance().resource());
+  candidate.reserve(input.size() + 1);
+  candidate.append(input);
+  candidate.push_back(next);
+  if (EnglishDetector::canBePinyin(candidate)) {
+    return false;
+  }
+  LOG_DEBUG("Input cannot be pinyin, switching to English");
+  EnglishMetrics::get().switches.inc();
+  english_.assign(candidate.data(), candidate.size());
+  context_->clear();
+  current_page_ = 0;
+  typeEnglish('\0');
+  return true;
 }
 
-bool PinyinEngine::processControlKey(guint keyval, guint modifiers) {
-  switch (keyval) {
-  case IBUS_KEY_BackSpace:
-    if (context_->size() > 0) {
-      context_->backspace();
-      if (context_->size() == 0) {
-        reset();
-      } else {
-        updateUI();
-      }
-      return TRUE;
-    }
-    return FALSE;
+void PinyinEngine::typeEnglish(char ch) {
+  if (ch) {
+    english_.push_back(ch);
+    EnglishMetrics::get().decodesSkipped.inc();
+  }
+  // The typed text is the only candidate
+  literal_candidates_.resize(1);
+  literal_candidates_[0].assign(english_);
+  current_page_ = 0;
+  updateUI();
+}
 
-  case IBUS_KEY_Delete:
-    if (context_->size() > 0) {
-      context_->del();
-      if (context_->size() == 0) {
-        reset();
-      } else {
-        updateUI();
-      }
-      return TRUE;
-    }
-    return FALSE;
+void PinyinEngine::offerLiteralCandidates() {
+  literal_candidates_.clear();
+  const std::string &input = context_->userInput();
+  auto &detector = EnglishDetector::getInstance();
+  if (detector.enabled() && detector.shouldOffer(input)) {
+    EnglishMetrics::get().offers.inc();
+    literal_candidates_.push_back(input);
+  }
+  if (AbbreviationIndex::getInstance().enabled() &&
+      AbbreviationIndex::isInitials(input)) {
+    offerAbbreviations(input);
+  }
+}
 
-  case IBUS_KEY_Escape:
-    if (context_->size() > 0) {
-      reset();
-      return TRUE;
-    }
-    return FALSE;
+void PinyinEngine::offerAbbreviations(const std::string &input) {
+  auto &metrics = AbbreviationMetrics::get();
+  uint64_t start = FlightRecorder::nowMicroseconds();
+  std::string_view phrases = AbbreviationIndex::getInstance().lookup(input);
+  metrics.lookups.inc();
+  if (phrases.empty()) {
+    metrics.duration.observe(FlightRecorder::nowMicroseconds() - start);
+    return;
+  }
 
-  case IBUS_KEY_Left:
-    if (context_->cursor() > 0) {
-      context_->setCursor(context_->cursor() - 1);
-      updateUI();
-      return TRUE;
+  // Phrases the decoder already ranks near the top are left where they are
+  auto *arena = KeyArena::getInstance().resource();
+  std::pmr::vector<std::pmr::string> leading(arena);
+  const auto &candidates = context_->candidates();
+  for (size_t i = 0; i < std::min(candidates.size(), page_size_); ++i) {
+    auto &text = leading.emplace_back();
+    for (const auto *node : candidates[i].sentence()) {
+      text += node->word();
     }
-    return FALSE;
+  }
 
-  case IBUS_KEY_Right:
-    if (context_->cursor() < context_->size()) {
-      context_->setCursor(context_->cursor() + 1);
-      updateUI();
-      return TRUE;
+  size_t offered = 0;
+  while (!phrases.empty()) {
+    std::string_view phrase = AbbreviationIndex::nextPhrase(phrases);
+    if (std::find(leading.begin(), leading.end(), phrase) != leading.end()) {
+      continue;
     }
-    return FALSE;
+    literal_candidates_.push_back(toOutputScript(std::string(phrase)));
+    ++offered;
+  }
+  metrics.phrases.inc(offered);
+  metrics.duration.observe(FlightRecorder::nowMicroseconds() - start);
+}
 
-  case IBUS_KEY_Return:
-  case IBUS_KEY_KP_Enter:
-    if (context_->size() > 0) {
-      // Commit the raw user input (pinyin) instead of the converted sentence
-      std::string raw_input = context_->userInput();
+bool PinyinEngine::deleteBackward() {
+  if (!english_.empty()) {
+    english_.pop_back();
+    if (english_.empty()) {
       reset();
-      commitString(raw_input);
-      return TRUE;
+    } else {
+      typeEnglish('\0');
     }
-    return FALSE;
+    return TRUE;
+  }
+  leading_words_.clear();
+  {
+    DecodeScope decode(*this);
+    context_->backspace();
+  }
+  if (context_->size() == 0) {
+    reset();
+  } else {
+    offerLiteralCandidates();
+    updateUI();
+  }
+  return TRUE;
+}
 
-  case IBUS_KEY_Page_Up:
-  case IBUS_KEY_minus:
-    if (context_->size() > 0) {
-      pageUp();
-      return TRUE;
-    }
+bool PinyinEngine::deleteForward() {
+  if (!english_.empty() || context_->cursor() == context_->size()) {
     return FALSE;
+  }
+  leading_words_.clear();
+  {
+    DecodeScope decode(*this);
+    context_->del();
+  }
+  if (context_->size() == 0) {
+    reset();
+  } else {
+    offerLiteralCandidates();
+    updateUI();
+  }
+  return TRUE;
+}
 
-  case IBUS_KEY_Page_Down:
-  case IBUS_KEY_equal:
-    if (context_->size() > 0) {
-      pageDown();
-      return TRUE;
-    }
+bool PinyinEngine::moveCursor(int delta) {
+  if (!english_.empty()) {
     return FALSE;
-
-  default:
+  }
+  size_t cursor = context_->cursor();
+  if ((delta < 0 && cursor == 0) || (delta > 0 && cursor == context_->size())) {
     return FALSE;
   }
+  context_->setCursor(cursor + delta);
+  leading_words_.clear();
+  updateUI();
+  return TRUE;
 }
 
 void PinyinEngine::selectCandidate(size_t index) {
@@ -339,18 +629,50 @@ void PinyinEngine::selectCandidate(size_t index) {
   if (index < candidates.size()) {
     std::string candidate_text = candidates[index].toString();
     LOG_INFO("Selecting candidate {}: {}", index, candidate_text);
+    auto &selections = EngineMetrics::get().selections;
+    selections[std::min(index, std::size(selections) - 1)]->inc();
+    auto &context_metrics = ContextMetrics::get();
+    (context_seeded_ ? context_metrics.seededSelections
+                     : context_metrics.plainSelections)
+        .inc();
+    if (index == 0) {
+      (context_seeded_ ? context_metrics.seededFirst
+                       : context_metrics.plainFirst)
+          .inc();
+    }
 
-    context_->select(index);
+    {
+      DecodeScope decode(*this);
+      context_->select(index);
+    }
 
     if (context_->selected()) {
       std::string sentence = context_->sentence();
-      LOG_INFO("Committing sentence: {}", sentence);
-      commitString(sentence);
-      context_->learn();
-      LOG_DEBUG("Learning completed");
+      const std::string &text = toOutputScript(sentence);
+      commitString(text);
+      EngineMetrics::get().candidateCommits.inc();
+      if (Config::getInstance().getSurroundingContext()) {
+        rememberCommit(text);
+      }
+      if (prediction_) {
+        committed_words_ = context_->selectedWords();
+      }
+      // Learning happens off the commit path; continue with a fresh context
+      if (learningAllowed()) {
+        LearningQueue::getInstance().enqueue(std::move(context_));
+        context_ =
+            ContextPool::getInstance().acquireContext(shared_ime_.get());
+        LOG_DEBUG("Learning queued");
+      }
       reset();
+      if (prediction_) {
+        schedulePrediction();
+      }
     } else {
       LOG_DEBUG("Partial selection, resetting page and updating UI");
+      leading_words_.clear();
+      // Offers were for the whole input
+      literal_candidates_.clear();
       current_page_ = 0;
       updateUI();
     }
@@ -360,244 +682,154 @@ void PinyinEngine::selectCandidate(size_t index) {
   }
 }
 
-void PinyinEngine::updateUI() {
-  updatePreedit();
-  updateLookupTable();
-}
-
-void PinyinEngine::updatePreedit() {
-  if (context_->size() == 0) {
-    ibus_engine_hide_preedit_text(engine_);
-    return;
+void PinyinEngine::requestSurroundingText() {
+  if (Config::getInstance().getSurroundingContext()) {
+    // Asking without taking the text makes the client start sending it
+    ibus_engine_get_surrounding_text(engine_, nullptr, nullptr, nullptr);
   }
-
-  ibus_engine_hide_auxiliary_text(engine_);
-
-  auto [preedit, cursor_pos] = context_->preeditWithCursor();
-
-  IBusText *text = ibus_text_new_from_string(preedit.c_str());
-  ibus_text_append_attribute(text, IBUS_ATTR_TYPE_UNDERLINE,
-                             IBUS_ATTR_UNDERLINE_SINGLE, 0, preedit.length());
-
-  ibus_engine_update_preedit_text(engine_, text, cursor_pos, TRUE);
 }
 
-void PinyinEngine::updateLookupTable() {
-  const auto &candidates = context_->candidates();
-
-  LOG_DEBUG("updateLookupTable: {} candidates", candidates.size());
-
-  if (candidates.empty()) {
-    LOG_DEBUG("Hiding lookup table (no candidates)");
-    ibus_engine_hide_lookup_table(engine_);
+void PinyinEngine::seedContext() {
+  context_seeded_ = false;
+  context_from_commit_ = false;
+  if (!Config::getInstance().getSurroundingContext()) {
     return;
   }
-
-  IBusLookupTable *table = ibus_lookup_table_new(page_size_, 0, TRUE, TRUE);
-
-  size_t start = current_page_ * page_size_;
-  size_t end = std::min(start + page_size_, candidates.size());
-
-  LOG_DEBUG("Showing candidates {} to {} (page {})", start, end - 1,
-            current_page_);
-
-  for (size_t i = start; i < end; ++i) {
-    const auto &candidate = candidates[i];
-    std::string text = candidate.toString();
-    LOG_DEBUG("  Candidate {}: {} (score: {})", i + 1, text, candidate.score());
-
-    IBusText *ibus_text = ibus_text_new_from_string(text.c_str());
-    ibus_lookup_table_append_candidate(table, ibus_text);
+  // Pooled contexts may still carry the words of their last composition
+  std::vector<std::string> words = wordsBeforeCursor();
+  context_seeded_ = !words.empty();
+  context_->setContextWords(words);
+  if (context_seeded_) {
+    auto &metrics = ContextMetrics::get();
+    (context_from_commit_ ? metrics.commitSeeds : metrics.textSeeds).inc();
   }
-
-  ibus_engine_update_lookup_table(engine_, table, TRUE);
-  g_object_unref(table);
 }
 
-void PinyinEngine::commitString(const std::string &text) {
-  LOG_INFO("Committing text: {}", text);
-  IBusText *ibus_text = ibus_text_new_from_string(text.c_str());
-  ibus_engine_commit_text(engine_, ibus_text);
+std::vector<std::string> PinyinEngine::wordsBeforeCursor() {
+  if (!(engine_->client_capabilities & IBUS_CAP_SURROUNDING_TEXT)) {
+    return {};
+  }
+  IBusText *surrounding = nullptr;
+  guint cursor = 0, anchor = 0;
+  ibus_engine_get_surrounding_text(engine_, &surrounding, &cursor, &anchor);
+  if (!surrounding) {
+    return {};
+  }
+  // Typing replaces a selection, so the context ends where it starts. The
+  // text is the caller's reference; keep only what precedes the cursor.
+  const gchar *text = ibus_text_get_text(surrounding);
+  guint offset =
+      std::min({cursor, anchor, ibus_text_get_length(surrounding)});
+  std::string before(text, g_utf8_offset_to_pointer(text, offset) - text);
+  g_object_unref(surrounding);
+
+  // Text committed here still in place before the cursor: the decoder's own
+  // words for it
+  auto it = client_contexts.find(objectPath());
+  if (it != client_contexts.end() && !it->second.text.empty() &&
+      before.ends_with(it->second.text)) {
+    context_from_commit_ = true;
+    return it->second.words;
+  }
+
+  // Otherwise the characters right before the cursor, up to punctuation
+  std::vector<std::string> words;
+  const gchar *begin = before.data();
+  const gchar *end = begin + before.size();
+  while (end > begin && words.size() < kSeedContextChars) {
+    const gchar *prev = g_utf8_prev_char(end);
+    if (g_unichar_get_script(g_utf8_get_char(prev)) != G_UNICODE_SCRIPT_HAN) {
+      break;
+    }
+    words.emplace(words.begin(), prev, end);
+    end = prev;
+  }
+  return words;
 }
 
-std::string PinyinEngine::convertPunctuation(guint keyval) {
-  // Handle quotes with alternating left/right
-  if (keyval == '"') {
-    std::string result = double_quote_left_ ? "“" : "”";
-    double_quote_left_ = !double_quote_left_;
-    LOG_DEBUG("Converting double quote: {} -> {}", (char)keyval, result);
-    return result;
+void PinyinEngine::rememberCommit(const std::string &text) {
+  if (client_contexts.size() >= kMaxClientContexts &&
+      !client_contexts.contains(objectPath())) {
+    client_contexts.clear();
   }
-
-  if (keyval == '\'') {
-    std::string result = single_quote_left_ ? "‘" : "’";
-    single_quote_left_ = !single_quote_left_;
-    LOG_DEBUG("Converting single quote: {} -> {}", (char)keyval, result);
-    return result;
+  ClientContext &client = client_contexts[objectPath()];
+  // Words of an earlier commit count only while they are still in place
+  if (!context_from_commit_) {
+    client.words.clear();
   }
-
-  // Map of English punctuation to Chinese punctuation
-  static const std::map<guint, std::string> punct_map = {
-      {',', "，"},  {'.', "。"}, {'?', "？"}, {'!', "！"}, {';', "；"},
-      {':', "："},  {'(', "（"}, {')', "）"}, {'[', "【"}, {']', "】"},
-      {'<', "《"},  {'>', "》"}, {'~', "～"},
-      {'\\', "、"}, {'$', "￥"}, {'^', "……"}, {'_', "——"},
-  };
-
-  auto it = punct_map.find(keyval);
-  if (it != punct_map.end()) {
-    LOG_DEBUG("Converting punctuation: {} -> {}", (char)keyval, it->second);
-    return it->second;
+  for (auto &word : context_->selectedWords()) {
+    client.words.push_back(std::move(word));
   }
-
-  return "";
-}
-
-void PinyinEngine::focusInId(const gchar *object_path, const gchar *client) {
-  LOG_INFO("Focus in with ID: {} client: {}", object_path, client);
-  english_mode_ = context_status_map[std::string(object_path)].englishMode;
-  focusIn();
-}
-
-void PinyinEngine::focusIn() {
-  LOG_INFO("Focus in");
-  // Restore the mode property display
-  ibus_engine_register_properties(engine_, prop_list_);
-
-  updateInputMode();
-  // Optionally load user data
-}
-
-void PinyinEngine::focusOutId(const gchar *object_path) {
-  LOG_INFO("Focus out with ID: {}", object_path);
-  context_status_map[std::string(object_path)] = {english_mode_};
-  focusOut();
-}
-
-void PinyinEngine::focusOut() {
-  LOG_INFO("Focus out");
-  // Clear any pending input but keep the mode state
-  if (context_->size() > 0) {
-    context_->clear();
-    current_page_ = 0;
-    ibus_engine_hide_preedit_text(engine_);
-    ibus_engine_hide_lookup_table(engine_);
+  if (client.words.size() > kSeedContextWords) {
+    client.words.erase(client.words.begin(),
+                       client.words.end() - kSeedContextWords);
   }
-  // Don't call reset() which would clear everything
-  // Optionally save user data
+  client.text = text;
 }
 
-void PinyinEngine::reset() {
-  LOG_DEBUG("Reset called");
-  context_->clear();
-  current_page_ = 0;
-  ibus_engine_hide_preedit_text(engine_);
-  ibus_engine_hide_lookup_table(engine_);
-  LOG_DEBUG("Reset complete");
-}
-
-void PinyinEngine::enable() {
-  LOG_INFO("Engine enabled");
-  reset();
-}
-
-void PinyinEngine::disable() {
-  LOG_INFO("Engine disabled");
-  reset();
-}
-
-void PinyinEngine::pageUp() {
-  if (current_page_ > 0) {
-    current_page_--;
-    updateLookupTable();
+std::vector<std::string> PinyinEngine::predictNext() {
+  if (!prediction_ || committed_words_.empty()) {
+    return {};
   }
+  predictions_ = prediction_->predict(
+      committed_words_,
+      static_cast<size_t>(Config::getInstance().getPredictionCount()));
+  return predictions_;
 }
 
-void PinyinEngine::pageDown() {
-  const auto &candidates = context_->candidates();
-  size_t max_page = (candidates.size() + page_size_ - 1) / page_size_;
-
-  if (current_page_ + 1 < max_page) {
-    current_page_++;
-    updateLookupTable();
+void PinyinEngine::predictionCommitted(size_t index) {
+  if (index >= predictions_.size()) {
+    return;
   }
+  // Keep predicting from the chosen phrase; the model only looks at the
+  // last couple of words
+  committed_words_.push_back(std::move(predictions_[index]));
+  if (committed_words_.size() > kPredictionContextWords) {
+    committed_words_.erase(committed_words_.begin(),
+                           committed_words_.end() - kPredictionContextWords);
+  }
+  schedulePrediction();
 }
 
-void PinyinEngine::cursorUp() {
-  // Cursor up in lookup table is handled by pageUp
-  pageUp();
-}
-
-void PinyinEngine::cursorDown() {
-  // Cursor down in lookup table is handled by pageDown
-  pageDown();
-}
-
-void PinyinEngine::toggleInputMode() {
-  english_mode_ = !english_mode_;
-  LOG_INFO("Input mode toggled: {}", english_mode_ ? "English" : "Chinese");
-  updateInputMode();
-}
-
-void PinyinEngine::initProperties() {
-  // Create property list
-  prop_list_ = ibus_prop_list_new();
-  g_object_ref_sink(prop_list_);
-
-  // Create mode property - use PROP_TYPE_NORMAL for status bar display
-  IBusText *label = ibus_text_new_from_string("中");
-  IBusText *tooltip = ibus_text_new_from_string("切换中英文 (Shift)");
-
-  mode_prop_ = ibus_property_new("InputMode", PROP_TYPE_NORMAL, label,
-                                 nullptr, // icon - can be nullptr
-                                 tooltip,
-                                 TRUE, // sensitive
-                                 TRUE, // visible
-                                 PROP_STATE_UNCHECKED, nullptr);
-
-  ibus_prop_list_append(prop_list_, mode_prop_);
-
-  // Register properties with engine
-  ibus_engine_register_properties(engine_, prop_list_);
-
-  LOG_INFO("Properties initialized");
-}
-
-void PinyinEngine::updateModeProperty() {
-  if (!mode_prop_)
+void PinyinEngine::updatePreedit() {
+  if (!english_.empty()) {
+    IBusText *text = ibus_text_new_from_string(english_.c_str());
+    ibus_text_append_attribute(text, IBUS_ATTR_TYPE_UNDERLINE,
+                               IBUS_ATTR_UNDERLINE_SINGLE, 0,
+                               g_utf8_strlen(english_.c_str(), -1));
+    ibus_engine_update_preedit_text(engine_, text, english_.size(), TRUE);
     return;
+  }
 
-  // Update label based on mode
-  const char *label = english_mode_ ? "En" : "中";
+  if (context_->size() == 0) {
+    ibus_engine_hide_preedit_text(engine_);
+    return;
+  }
 
-  IBusText *label_text = ibus_text_new_from_string(label);
-  ibus_property_set_label(mode_prop_, label_text);
+  ibus_engine_hide_auxiliary_text(engine_);
 
-  // Update state
-  ibus_property_set_state(mode_prop_, english_mode_ ? PROP_STATE_CHECKED
-                                                    : PROP_STATE_UNCHECKED);
+  auto [preedit, cursor_pos] = context_->preeditWithCursor();
 
-  // Update the property in IBus
-  ibus_engine_update_property(engine_, mode_prop_);
+  IBusText *text = ibus_text_new_from_string(preedit.c_str());
+  ibus_text_append_attribute(text, IBUS_ATTR_TYPE_UNDERLINE,
+                             IBUS_ATTR_UNDERLINE_SINGLE, 0, preedit.length());
 
-  LOG_DEBUG("Mode property updated: {}", label);
+  ibus_engine_update_preedit_text(engine_, text, cursor_pos, TRUE);
 }
 
-void PinyinEngine::updateInputMode() {
-  // Update auxiliary text to show current mode
-  IBusText *text =
-      ibus_text_new_from_string(english_mode_ ? "English" : "中文");
-  ibus_engine_update_auxiliary_text(engine_, text, TRUE);
-  ibus_engine_show_auxiliary_text(engine_);
-
-  Glib::signal_timeout().connect_seconds_once(
-      [this]() { ibus_engine_hide_auxiliary_text(engine_); }, 1);
+void PinyinEngine::focusIn() {
+  activateProfile();
+  requestSurroundingText();
+  EngineBase::focusIn();
+}
 
-  // Update icon
-  updateModeProperty();
+void PinyinEngine::enable() {
+  requestSurroundingText();
+  EngineBase::enable();
+}
 
-  // Clear any pending input when switching modes
-  if (context_->size() > 0) {
-    reset();
-  }
+void PinyinEngine::focusOut() {
+  EngineBase::focusOut();
+  LearningQueue::getInstance().flush();
+  // Optionally save user data
 }
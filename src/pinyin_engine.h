@@ -2,6 +2,7 @@
 #define PINYIN_ENGINE_H
 
 #include <ibus.h>
+#include <libime/core/prediction.h>
 #include <libime/pinyin/pinyincontext.h>
 #include <libime/pinyin/pinyinime.h>
 
@@ -9,70 +10,102 @@
 #include <string>
 #include <vector>
 
-class PinyinEngine {
+#include "configs.h"
+#include "engine_base.h"
+
+class PinyinEngine : public EngineBase {
 public:
-  explicit PinyinEngine(IBusEngine *engine);
-  ~PinyinEngine();
+  PinyinEngine(IBusEngine *engine, const PinyinProfile &profile);
+  ~PinyinEngine() override;
 
   // Static initialization for shared IME
   static void initializeSharedIME();
   static void cleanupSharedIME();
+  static libime::PinyinIME *sharedIME() { return shared_ime_.get(); }
+  static std::string getDataPath(const std::string &filename);
 
-  // Key event handling
-  bool processKeyEvent(guint keyval, guint keycode, guint modifiers);
-
-  // Engine state management
-  void focusIn();
-  void focusInId(const gchar *object_path, const gchar *client);
-  void focusOut();
-  void focusOutId(const gchar *object_path);
-  void reset();
-  void enable();
-  void disable();
+  void focusIn() override;
+  void focusOut() override;
+  void enable() override;
+  void selectCandidate(size_t index) override;
 
-  // Candidate navigation
-  void pageUp();
-  void pageDown();
-  void cursorUp();
-  void cursorDown();
-  void selectCandidate(size_t index);
-  void toggleInputMode();
+protected:
+  size_t inputLength() const override {
+    return english_.empty() ? context_->size() : english_.size();
+  }
+  std::string rawInput() const override {
+    return english_.empty() ? context_->userInput() : english_;
+  }
+  void clearInput() override {
+    context_->clear();
+    english_.clear();
+    leading_words_.clear();
+  }
+  bool processInputKey(guint keyval, guint modifiers) override;
+  bool keepsKey(guint keyval, guint modifiers) const override;
+  bool deleteBackward() override;
+  bool deleteForward() override;
+  bool moveCursor(int delta) override;
+  size_t candidateCount() const override {
+    return english_.empty() ? context_->candidates().size() : 0;
+  }
+  void appendCandidate(size_t index, std::pmr::string &text) const override {
+    appendSentence(context_->candidates()[index], text);
+  }
+  void updatePreedit() override;
+  std::vector<std::string> predictNext() override;
+  void predictionCommitted(size_t index) override;
 
 private:
-  IBusEngine *engine_;
   static std::shared_ptr<libime::PinyinIME>
       shared_ime_; // Shared across all instances
+  // Profile whose settings the shared IME currently carries
+  static const PinyinProfile *active_profile_;
+  // Next-phrase prediction over the shared model, when enabled
+  static std::unique_ptr<libime::Prediction> prediction_;
   std::unique_ptr<libime::PinyinContext> context_;
+  const PinyinProfile &profile_;
+  // Input that cannot be pinyin, typed without decoding
+  std::string english_;
+  // Words committed last, the context of the next prediction
+  std::vector<std::string> committed_words_;
+  // Phrases last predicted from committed_words_
+  std::vector<std::string> predictions_;
+  // The composition is decoded after the text before the cursor, and its
+  // words came from this engine's last commit there
+  bool context_seeded_ = false;
+  bool context_from_commit_ = false;
 
-  // UI state
-  size_t page_size_;
-  size_t current_page_;
-
-  // Input mode state
-  bool english_mode_; // true = English mode, false = Chinese mode
-  bool shift_pressed_;
+  // A word the best sentence starts with, where it ends in the input and
+  // for how many letter keys it has been there
+  struct LeadingWord {
+    std::string word;
+    size_t end;
+    int keys;
+  };
+  // The best sentence's words after the locked ones, as of the last key
+  std::vector<LeadingWord> leading_words_;
 
-  // Punctuation state
-  bool double_quote_left_; // true = next is left quote, false = right quote
-  bool single_quote_left_; // true = next is left quote, false = right quote
-
-  // Properties
-  IBusProperty *mode_prop_;
-  IBusPropList *prop_list_;
-
-  // Helper methods
-  void updateInputMode();
-  void initProperties();
-  void updateModeProperty();
   void initializeIME();
-  void updateUI();
-  void updatePreedit();
-  void updateLookupTable();
-  void commitString(const std::string &text);
-  bool processInputKey(guint keyval, guint modifiers);
-  bool processControlKey(guint keyval, guint modifiers);
-  std::string convertPunctuation(guint keyval);
-  static std::string getDataPath(const std::string &filename);
+  // Switch the shared IME to this engine's profile if another one is active
+  void activateProfile();
+  // Take over the input as English if it cannot be pinyin; true if it did
+  bool detectEnglish(char next);
+  // Offer the input as an English word, and the phrases it abbreviates,
+  // ahead of the pinyin candidates
+  void offerLiteralCandidates();
+  void offerAbbreviations(const std::string &input);
+  void typeEnglish(char ch);
+  // Tell the client the engine uses its surrounding text, if enabled
+  void requestSurroundingText();
+  // Give a new composition the words before the cursor as decoder context
+  void seedContext();
+  std::vector<std::string> wordsBeforeCursor();
+  // Remember the words just committed as the client's context
+  void rememberCommit(const std::string &text);
+  // Lock the leading word of a long composition once it has stayed in the
+  // best sentence for a few keys, so later keys decode only what follows
+  void lockStablePrefix();
 };
 
 #endif // PINYIN_ENGINE_H
@@ -0,0 +1,120 @@
+#include "punctuation.h"
+
+#include <ibus.h>
+
+#include "configs.h"
+#include "logger.h"
+
+namespace {
+
+constexpr PunctuationTable makeDefaultTable() {
+  PunctuationTable table;
+  table.set(',', {"，"});
+  table.set('.', {"。"});
+  table.set('?', {"？"});
+  table.set('!', {"！"});
+  table.set(';', {"；"});
+  table.set(':', {"："});
+  table.set('(', {"（"});
+  table.set(')', {"）"});
+  table.set('[', {"【"});
+  table.set(']', {"】"});
+  table.set('<', {"《"});
+  table.set('>', {"》"});
+  table.set('~', {"～"});
+  table.set('\\', {"、"});
+  table.set('$', {"￥"});
+  table.set('^', {"……"});
+  table.set('_', {"——"});
+  table.set('"', {"“", "”"});
+  table.set('\'', {"‘", "’"});
+  return table;
+}
+
+constexpr PunctuationTable kDefaultTable = makeDefaultTable();
+
+// Printable ASCII from space to '~'
+constexpr size_t kPrintable = '~' - ' ' + 1;
+
+// UTF-8 of the full-width forms, three bytes and a NUL each
+constexpr std::array<char, kPrintable * 4> kFullWidthText = [] {
+  std::array<char, kPrintable * 4> text{};
+  for (size_t i = 0; i < kPrintable; ++i) {
+    unsigned int cp = i == 0 ? 0x3000 : static_cast<unsigned int>(0xFF00 + i);
+    text[i * 4] = static_cast<char>(0xE0 | (cp >> 12));
+    text[i * 4 + 1] = static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+    text[i * 4 + 2] = static_cast<char>(0x80 | (cp & 0x3F));
+  }
+  return text;
+}();
+
+constexpr PunctuationTable makeFullWidthTable() {
+  PunctuationTable table;
+  for (size_t i = 0; i < kPrintable; ++i) {
+    table.set(' ' + i, {std::string_view(&kFullWidthText[i * 4], 3)});
+  }
+  return table;
+}
+
+constexpr PunctuationTable kFullWidthTable = makeFullWidthTable();
+
+static_assert(kDefaultTable.find('"')->close == "”");
+static_assert(kDefaultTable.find('a') == nullptr);
+static_assert(kFullWidthTable.find('A')->open == "Ａ");
+static_assert(kFullWidthTable.find(' ')->open == "　");
+
+} // namespace
+
+PunctuationSchema::PunctuationSchema() : default_(kDefaultTable) {
+  const auto &overrides = Config::getInstance().getPunctuationOverrides();
+  // [punctuation] first, so every per-client table starts from it
+  for (const auto &group : overrides) {
+    if (group.client.empty()) {
+      apply(default_, group.entries);
+    }
+  }
+  for (const auto &group : overrides) {
+    if (!group.client.empty()) {
+      clients_.emplace_back(group.client, default_);
+      apply(clients_.back().second, group.entries);
+    }
+  }
+  LOG_INFO("Punctuation schema loaded with {} client overrides",
+           clients_.size());
+}
+
+void PunctuationSchema::apply(
+    PunctuationTable &table,
+    const std::vector<std::pair<std::string, std::string>> &entries) {
+  for (const auto &[name, value] : entries) {
+    guint keyval = ibus_keyval_from_name(name.c_str());
+    if (keyval < 0x20 || keyval >= PunctuationTable::kSize) {
+      LOG_WARN("Ignoring punctuation for unknown or non-ASCII key: {}", name);
+      continue;
+    }
+    // "open close" alternates; an empty value leaves the key unconverted
+    size_t space = value.find(' ');
+    const std::string &open = text_.emplace_back(value.substr(0, space));
+    std::string_view close;
+    if (space != std::string::npos) {
+      close = text_.emplace_back(value.substr(space + 1));
+    }
+    table.set(keyval, {open, close});
+  }
+}
+
+const PunctuationTable &
+PunctuationSchema::forClient(std::string_view client) const {
+  // The program name follows the toolkit, e.g. "gtk3-im:firefox"
+  std::string_view program = client.substr(client.find(':') + 1);
+  for (const auto &[name, table] : clients_) {
+    if (name == client || name == program) {
+      return table;
+    }
+  }
+  return default_;
+}
+
+const PunctuationTable &PunctuationSchema::fullWidth() {
+  return kFullWidthTable;
+}
@@ -0,0 +1,77 @@
+#ifndef IBUS_LIBIME_PUNCTUATION_H
+#define IBUS_LIBIME_PUNCTUATION_H
+
+#include <glib.h>
+
+#include <array>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Text committed for one key. Keys with a closing form, like quotes,
+// alternate between the two. Every view is NUL-terminated and lives as long
+// as the process.
+struct PunctuationEntry {
+  std::string_view open;
+  std::string_view close;
+};
+
+// Replacements for ASCII keyvals, indexed directly by keyval
+class PunctuationTable {
+public:
+  static constexpr size_t kSize = 128;
+
+  constexpr const PunctuationEntry *find(guint keyval) const {
+    if (keyval >= kSize || entries_[keyval].open.empty()) {
+      return nullptr;
+    }
+    return &entries_[keyval];
+  }
+
+  constexpr void set(guint keyval, PunctuationEntry entry) {
+    entries_[keyval] = entry;
+  }
+
+private:
+  std::array<PunctuationEntry, kSize> entries_{};
+};
+
+// The punctuation schema: the built-in Chinese punctuation, changed by
+// [punctuation] and per-application [punctuation:<client>] groups of the
+// config file, plus the full-width forms of printable ASCII. Everything is
+// compiled into PunctuationTables once, so lookups while typing are a single
+// array access.
+class PunctuationSchema {
+public:
+  static PunctuationSchema &getInstance() {
+    static PunctuationSchema instance;
+    return instance;
+  }
+
+  // Table for an IBus client name such as "gtk3-im:firefox", matched by the
+  // whole name or the program part; the default table when none matches
+  const PunctuationTable &forClient(std::string_view client) const;
+
+  const PunctuationTable &defaultTable() const { return default_; }
+
+  // U+3000 for space and U+FF01..U+FF5E for '!'..'~'
+  static const PunctuationTable &fullWidth();
+
+private:
+  PunctuationSchema();
+
+  void apply(PunctuationTable &table,
+             const std::vector<std::pair<std::string, std::string>> &entries);
+
+  PunctuationTable default_;
+  std::vector<std::pair<std::string, PunctuationTable>> clients_;
+  // Configured replacement text; a deque keeps the views into it valid
+  std::deque<std::string> text_;
+
+  PunctuationSchema(const PunctuationSchema &) = delete;
+  PunctuationSchema &operator=(const PunctuationSchema &) = delete;
+};
+
+#endif // IBUS_LIBIME_PUNCTUATION_H
@@ -0,0 +1,140 @@
+#include "remote_pinyin_engine.h"
+
+#include "logger.h"
+
+RemotePinyinEngine::RemotePinyinEngine(IBusEngine *engine,
+                                       const PinyinProfile &profile,
+                                       std::unique_ptr<DecodeClient> client)
+    : EngineBase(engine), profile_(profile), client_(std::move(client)) {
+  LOG_INFO("RemotePinyinEngine created (profile: {})",
+           profile_.name.empty() ? "default" : profile_.name);
+  page_size_ = profile_.pageSize;
+}
+
+RemotePinyinEngine::~RemotePinyinEngine() = default;
+
+bool RemotePinyinEngine::request(DecodeOp op,
+                                 std::initializer_list<uint32_t> args) {
+  DecodeScope decode(*this);
+  if (!client_->request(op, args, state_)) {
+    state_ = DecodeState();
+    return false;
+  }
+  return true;
+}
+
+bool RemotePinyinEngine::type(std::string_view text) {
+  DecodeScope decode(*this);
+  if (!client_->type(text, state_)) {
+    state_ = DecodeState();
+    return false;
+  }
+  return true;
+}
+
+void RemotePinyinEngine::clearInput() {
+  if (!state_.input.empty()) {
+    request(DecodeOp::Clear);
+  }
+  state_ = DecodeState();
+}
+
+bool RemotePinyinEngine::processInputKey(guint keyval, guint modifiers) {
+  // Handle punctuation in Chinese mode (only when no pending input)
+  if (!english_mode_ && state_.input.empty() && commitPunctuation(keyval)) {
+    return TRUE;
+  }
+  bool letter = keyval >= 'a' && keyval <= 'z';
+  bool separator = keyval == '\'' && !state_.input.empty();
+  if (!letter && !separator) {
+    return FALSE;
+  }
+  // A lost service leaves the key to the engine that replaces this one
+  char ch = static_cast<char>(keyval);
+  if (type(std::string_view(&ch, 1))) {
+    updateUI();
+  }
+  return TRUE;
+}
+
+void RemotePinyinEngine::editDone() {
+  if (state_.input.empty()) {
+    reset();
+  } else {
+    updateUI();
+  }
+}
+
+bool RemotePinyinEngine::deleteBackward() {
+  request(DecodeOp::Backspace);
+  editDone();
+  return TRUE;
+}
+
+bool RemotePinyinEngine::deleteForward() {
+  if (state_.inputCursor == state_.input.size()) {
+    return FALSE;
+  }
+  request(DecodeOp::Delete);
+  editDone();
+  return TRUE;
+}
+
+bool RemotePinyinEngine::moveCursor(int delta) {
+  size_t cursor = state_.inputCursor;
+  if ((delta < 0 && cursor == 0) ||
+      (delta > 0 && cursor == state_.input.size())) {
+    return FALSE;
+  }
+  request(DecodeOp::SetCursor, {static_cast<uint32_t>(cursor + delta)});
+  editDone();
+  return TRUE;
+}
+
+void RemotePinyinEngine::selectCandidate(size_t index) {
+  if (index >= state_.candidates.size()) {
+    LOG_WARN("Invalid candidate index: {} (total: {})", index,
+             state_.candidates.size());
+    return;
+  }
+  LOG_INFO("Selecting candidate {}: {}", index, state_.candidates[index]);
+  auto &selections = EngineMetrics::get().selections;
+  selections[std::min(index, std::size(selections) - 1)]->inc();
+
+  // Whether the selection completes the input is only known from the reply,
+  // so the service learns it unless the field is sensitive
+  if (!request(DecodeOp::Select,
+               {static_cast<uint32_t>(index), !sensitive()})) {
+    reset();
+    return;
+  }
+  if (state_.selected) {
+    commitString(toOutputScript(state_.sentence));
+    EngineMetrics::get().candidateCommits.inc();
+    if (sensitive()) {
+      unlearnedCommits().inc();
+    }
+    // The service has cleared the session already; reset() need not ask
+    state_ = DecodeState();
+    reset();
+  } else {
+    current_page_ = 0;
+    updateUI();
+  }
+}
+
+void RemotePinyinEngine::updatePreedit() {
+  if (state_.input.empty()) {
+    ibus_engine_hide_preedit_text(engine_);
+    return;
+  }
+
+  ibus_engine_hide_auxiliary_text(engine_);
+
+  IBusText *text = ibus_text_new_from_string(state_.preedit.c_str());
+  ibus_text_append_attribute(text, IBUS_ATTR_TYPE_UNDERLINE,
+                             IBUS_ATTR_UNDERLINE_SINGLE, 0,
+                             state_.preedit.length());
+
+  ibus_engine_update_preedit_text(engine_, text, state_.preeditCursor, TRUE);
+}
@@ -0,0 +1,63 @@
+#ifndef REMOTE_PINYIN_ENGINE_H
+#define REMOTE_PINYIN_ENGINE_H
+
+#include <ibus.h>
+
+#include <initializer_list>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "configs.h"
+#include "decode_client.h"
+#include "engine_base.h"
+
+// Pinyin engine whose decoding runs in the shared decode service.
+//
+// The engine keeps only the session state the service returns after each
+// request, so it holds no dictionary or language model of its own. English
+// detection, abbreviations, prediction, surrounding-text context and prefix
+// locking are left to the local PinyinEngine.
+class RemotePinyinEngine : public EngineBase {
+public:
+  RemotePinyinEngine(IBusEngine *engine, const PinyinProfile &profile,
+                     std::unique_ptr<DecodeClient> client);
+  ~RemotePinyinEngine() override;
+
+  // Candidates the service returns per request: ten pages
+  static uint32_t candidateLimit(const PinyinProfile &profile) {
+    return static_cast<uint32_t>(profile.pageSize) * 10;
+  }
+
+  const PinyinProfile &profile() const { return profile_; }
+  bool decoderLost() const override { return !client_->connected(); }
+  void selectCandidate(size_t index) override;
+
+protected:
+  size_t inputLength() const override { return state_.input.size(); }
+  std::string rawInput() const override { return state_.input; }
+  void clearInput() override;
+  bool processInputKey(guint keyval, guint modifiers) override;
+  bool deleteBackward() override;
+  bool deleteForward() override;
+  bool moveCursor(int delta) override;
+  size_t candidateCount() const override { return state_.candidates.size(); }
+  void appendCandidate(size_t index, std::pmr::string &text) const override {
+    text += state_.candidates[index];
+  }
+  void updatePreedit() override;
+
+private:
+  // Run a request and take the session it returns; on failure the session
+  // is dropped and false returned
+  bool request(DecodeOp op, std::initializer_list<uint32_t> args = {});
+  bool type(std::string_view text);
+  // Show the session after an edit, or reset once its input is gone
+  void editDone();
+
+  const PinyinProfile &profile_;
+  std::unique_ptr<DecodeClient> client_;
+  DecodeState state_;
+};
+
+#endif // REMOTE_PINYIN_ENGINE_H
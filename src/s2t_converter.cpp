@@ -0,0 +1,86 @@
+#include "s2t_converter.h"
+
+#include "configs.h"
+#include "logger.h"
+#include "metrics.h"
+
+namespace {
+
+// Byte length of the UTF-8 sequence starting with lead
+size_t utf8Length(unsigned char lead) {
+  if (lead < 0x80) {
+    return 1;
+  }
+  if ((lead & 0xe0) == 0xc0) {
+    return 2;
+  }
+  if ((lead & 0xf0) == 0xe0) {
+    return 3;
+  }
+  if ((lead & 0xf8) == 0xf0) {
+    return 4;
+  }
+  return 1; // Invalid lead byte, copy it through
+}
+
+} // namespace
+
+bool S2TConverter::load() {
+  if (trie_.isOpen() || load_attempted_) {
+    return trie_.isOpen();
+  }
+  load_attempted_ = true;
+
+  const std::string &path = Config::getInstance().getS2TTablePath();
+  if (!trie_.open(path, kMagic)) {
+    LOG_WARN("Traditional Chinese table unavailable: {}", path);
+    return false;
+  }
+
+  Metrics::getInstance()
+      .gauge("ibus_libime_s2t_table_bytes",
+             "Size of the mapped simplified-to-traditional table")
+      .set(static_cast<int64_t>(trie_.mappedSize()));
+  LOG_INFO("Traditional Chinese table mapped: {} ({} nodes)", path,
+           trie_.nodeCount());
+  return true;
+}
+
+void S2TConverter::convert(std::string_view text, std::string &out) const {
+  if (!trie_.isOpen()) {
+    out.append(text);
+    return;
+  }
+  convert(trie_, text, out);
+}
+
+std::string S2TConverter::convert(std::string_view text) const {
+  std::string out;
+  out.reserve(text.size());
+  convert(text, out);
+  return out;
+}
+
+void S2TConverter::convert(const MappedTrie &trie, std::string_view text,
+                           std::string &out) {
+  size_t i = 0;
+  while (i < text.size()) {
+    auto lead = static_cast<unsigned char>(text[i]);
+    if (lead < 0x80) {
+      // Tables only map CJK text, skip the walk for ASCII
+      out += text[i++];
+      continue;
+    }
+
+    std::string_view value;
+    size_t matched = trie.longestMatch(text.substr(i), &value);
+    if (matched > 0) {
+      out.append(value);
+      i += matched;
+    } else {
+      size_t length = std::min(utf8Length(lead), text.size() - i);
+      out.append(text.substr(i, length));
+      i += length;
+    }
+  }
+}
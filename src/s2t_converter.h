@@ -0,0 +1,43 @@
+#ifndef IBUS_LIBIME_S2T_CONVERTER_H
+#define IBUS_LIBIME_S2T_CONVERTER_H
+
+#include <string>
+#include <string_view>
+
+#include "mapped_trie.h"
+
+// Simplified-to-traditional conversion backed by a memory-mapped trie built
+// offline with `ibus-libime-s2t build`. Phrase and character mappings live in
+// one trie, so the longest match prefers a phrase over its characters.
+class S2TConverter {
+public:
+  static constexpr std::string_view kMagic = "IBLS2T01";
+
+  static S2TConverter &getInstance() {
+    static S2TConverter instance;
+    return instance;
+  }
+
+  // Map the table on first use; returns false if it is unavailable
+  bool load();
+  bool isLoaded() const { return trie_.isOpen(); }
+
+  // Append the converted text to out
+  void convert(std::string_view text, std::string &out) const;
+  std::string convert(std::string_view text) const;
+
+  // Convert with an already opened trie (used by the offline tool)
+  static void convert(const MappedTrie &trie, std::string_view text,
+                      std::string &out);
+
+private:
+  S2TConverter() = default;
+
+  MappedTrie trie_;
+  bool load_attempted_ = false;
+
+  S2TConverter(const S2TConverter &) = delete;
+  S2TConverter &operator=(const S2TConverter &) = delete;
+};
+
+#endif // IBUS_LIBIME_S2T_CONVERTER_H
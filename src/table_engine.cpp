@@ -0,0 +1,253 @@
+#include "table_engine.h"
+
+#include "configs.h"
+#include "flight_recorder.h"
+#include "learning_queue.h"
+#include "logger.h"
+#include "mapped_file.h"
+#include "metrics.h"
+#include "pinyin_engine.h"
+
+using namespace libime;
+
+namespace {
+
+const char *defaultTableFile(const std::string &table) {
+  if (table == "wubi") {
+    return "wbx.main.dict";
+  }
+  if (table == "cangjie") {
+    return "cj.main.dict";
+  }
+  return nullptr;
+}
+
+const char *defaultTableLanguage(const std::string &table) {
+  // The Cangjie table is traditional Chinese
+  return table == "cangjie" ? "zh_TW" : "zh_CN";
+}
+
+} // namespace
+
+std::map<std::string, TableEngine::TableData> TableEngine::tables_;
+
+TableEngine::TableEngine(IBusEngine *engine, const std::string &table)
+    : EngineBase(engine), table_(table) {
+  LOG_INFO("TableEngine created for table: {}", table_);
+}
+
+TableEngine::~TableEngine() = default;
+
+TableEngine::TableData *TableEngine::loadTable(const std::string &table) {
+  auto it = tables_.find(table);
+  if (it != tables_.end()) {
+    return it->second.dict ? &it->second : nullptr;
+  }
+  // Remember failures too, so a missing table is only reported once
+  TableData &data = tables_[table];
+
+  std::string path = Config::getInstance().getTablePath(table.c_str());
+  if (path.empty()) {
+    const char *file = defaultTableFile(table);
+    if (!file) {
+      LOG_ERROR("No dictionary configured for table: {}", table);
+      return nullptr;
+    }
+    path = PinyinEngine::getDataPath(file);
+  }
+
+  MappedFile file;
+  if (!file.open(path)) {
+    LOG_ERROR("Failed to map table dictionary: {}", path);
+    return nullptr;
+  }
+
+  gint64 start = g_get_monotonic_time();
+  try {
+    auto dict = std::make_unique<TableBasedDictionary>();
+    MappedStreamBuf buf(file);
+    std::istream in(&buf);
+    dict->load(in, TableFormat::Binary);
+
+    std::string language = Config::getInstance().getTableLanguage(
+        table.c_str());
+    if (language.empty()) {
+      language = defaultTableLanguage(table);
+    }
+    TableOptions options;
+    options.setLanguageCode(language);
+    options.setAutoSelect(true);
+    dict->setTableOptions(options);
+
+    // The language model file is shared with the pinyin engine when the
+    // language is the same; without one, the table's own order decides
+    std::shared_ptr<const StaticLanguageModelFile> lm;
+    try {
+      lm = DefaultLanguageModelResolver::instance()
+               .languageModelFileForLanguage(language);
+    } catch (const std::exception &e) {
+      LOG_WARN("No language model for {}: {}", language, e.what());
+    }
+    data.model = std::make_unique<UserLanguageModel>(lm);
+    data.dict = std::move(dict);
+  } catch (const std::exception &e) {
+    LOG_ERROR("Failed to load table dictionary {}: {}", path, e.what());
+    data.model.reset();
+    return nullptr;
+  }
+
+  auto elapsed = g_get_monotonic_time() - start;
+  Metrics::getInstance()
+      .gauge(std::format("ibus_libime_table_load_microseconds{{table=\"{}\"}}",
+                         table),
+             "Time spent loading a table dictionary")
+      .set(elapsed);
+  LOG_INFO("Table {} loaded from {} ({} bytes) in {}us", table, path,
+           file.size(), elapsed);
+  return &data;
+}
+
+bool TableEngine::ensureContext() {
+  if (context_) {
+    return true;
+  }
+  TableData *data = loadTable(table_);
+  if (!data) {
+    return false;
+  }
+  context_ = std::make_unique<TableContext>(*data->dict, *data->model);
+  return true;
+}
+
+void TableEngine::enable() {
+  // Load the table on activation rather than on the first key press
+  ensureContext();
+  EngineBase::enable();
+}
+
+size_t TableEngine::inputLength() const {
+  return context_ ? context_->size() : 0;
+}
+
+std::string TableEngine::rawInput() const {
+  return context_ ? context_->userInput() : std::string();
+}
+
+void TableEngine::clearInput() {
+  if (context_) {
+    context_->clear();
+  }
+}
+
+size_t TableEngine::candidateCount() const {
+  return context_ ? context_->candidates().size() : 0;
+}
+
+void TableEngine::appendCandidate(size_t index,
+                                  std::pmr::string &text) const {
+  appendSentence(context_->candidates()[index], text);
+}
+
+bool TableEngine::processInputKey(guint keyval, guint modifiers) {
+  if (!ensureContext()) {
+    return FALSE;
+  }
+
+  if (keyval < 0x80 && context_->isValidInput(keyval)) {
+    // A new composition should see everything committed before it
+    if (context_->size() == 0 && !LearningQueue::getInstance().empty()) {
+      LearningQueue::getInstance().flush();
+    }
+    char code = static_cast<char>(keyval);
+    LOG_DEBUG("Typing code: {}", code);
+    {
+      DecodeScope decode(*this);
+      context_->type(std::string_view(&code, 1));
+    }
+    current_page_ = 0;
+    // The table may select on its own once a code is unambiguous
+    if (context_->selected()) {
+      commitSelection();
+    } else {
+      updateUI();
+    }
+    return TRUE;
+  }
+
+  // Handle punctuation in Chinese mode (only when no pending input)
+  if (!english_mode_ && context_->size() == 0) {
+    if (commitPunctuation(keyval)) {
+      return TRUE;
+    }
+  }
+
+  return FALSE;
+}
+
+bool TableEngine::deleteBackward() {
+  {
+    DecodeScope decode(*this);
+    context_->backspace();
+  }
+  if (context_->size() == 0) {
+    reset();
+  } else {
+    current_page_ = 0;
+    updateUI();
+  }
+  return TRUE;
+}
+
+void TableEngine::selectCandidate(size_t index) {
+  if (!context_ || index >= context_->candidates().size()) {
+    LOG_WARN("Invalid candidate index: {} (total: {})", index,
+             candidateCount());
+    return;
+  }
+
+  auto &selections = EngineMetrics::get().selections;
+  selections[std::min(index, std::size(selections) - 1)]->inc();
+
+  {
+    DecodeScope decode(*this);
+    context_->select(index);
+  }
+  if (context_->selected()) {
+    commitSelection();
+  } else {
+    current_page_ = 0;
+    updateUI();
+  }
+}
+
+void TableEngine::commitSelection() {
+  std::string sentence = context_->selectedSentence();
+  commitString(toOutputScript(sentence));
+  EngineMetrics::get().candidateCommits.inc();
+  // Learning happens off the commit path; the next key creates a fresh
+  // context
+  if (learningAllowed()) {
+    std::shared_ptr<TableContext> context = std::move(context_);
+    LearningQueue::getInstance().enqueue([context]() { context->learn(); });
+    LOG_DEBUG("Learning queued");
+  }
+  reset();
+}
+
+void TableEngine::updatePreedit() {
+  if (!context_ || context_->size() == 0) {
+    ibus_engine_hide_preedit_text(engine_);
+    return;
+  }
+
+  ibus_engine_hide_auxiliary_text(engine_);
+
+  std::string preedit = context_->preedit();
+  IBusText *text = ibus_text_new_from_string(preedit.c_str());
+  ibus_text_append_attribute(text, IBUS_ATTR_TYPE_UNDERLINE,
+                             IBUS_ATTR_UNDERLINE_SINGLE, 0,
+                             g_utf8_strlen(preedit.c_str(), -1));
+
+  ibus_engine_update_preedit_text(engine_, text,
+                                  g_utf8_strlen(preedit.c_str(), -1), TRUE);
+}
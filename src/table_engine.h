@@ -0,0 +1,55 @@
+#ifndef TABLE_ENGINE_H
+#define TABLE_ENGINE_H
+
+#include <ibus.h>
+#include <libime/core/userlanguagemodel.h>
+#include <libime/table/tablebaseddictionary.h>
+#include <libime/table/tablecontext.h>
+
+#include <map>
+#include <memory>
+#include <string>
+
+#include "engine_base.h"
+
+// Shape-based input (Wubi, Cangjie, ...) on a libime table dictionary.
+//
+// Every table is loaded once per process, on first use, and shared by all
+// engine instances of that table; each instance only owns its TableContext.
+class TableEngine : public EngineBase {
+public:
+  // table is the config/dictionary key, e.g. "wubi" or "cangjie"
+  TableEngine(IBusEngine *engine, const std::string &table);
+  ~TableEngine() override;
+
+  void enable() override;
+  void selectCandidate(size_t index) override;
+
+protected:
+  size_t inputLength() const override;
+  std::string rawInput() const override;
+  void clearInput() override;
+  bool processInputKey(guint keyval, guint modifiers) override;
+  bool deleteBackward() override;
+  size_t candidateCount() const override;
+  void appendCandidate(size_t index, std::pmr::string &text) const override;
+  void updatePreedit() override;
+
+private:
+  struct TableData {
+    std::unique_ptr<libime::TableBasedDictionary> dict;
+    std::unique_ptr<libime::UserLanguageModel> model;
+  };
+
+  static TableData *loadTable(const std::string &table);
+  static std::map<std::string, TableData> tables_;
+
+  // Load the table and create the context if that has not happened yet
+  bool ensureContext();
+  void commitSelection();
+
+  std::string table_;
+  std::unique_ptr<libime::TableContext> context_;
+};
+
+#endif // TABLE_ENGINE_H
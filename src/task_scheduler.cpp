@@ -0,0 +1,184 @@
+#include "task_scheduler.h"
+
+#include <algorithm>
+
+#include "metrics.h"
+
+namespace {
+
+// A source that only dispatches at the ready time set on it
+GSourceFuncs readyTimeSourceFuncs = {
+    nullptr, // prepare
+    nullptr, // check
+    [](GSource *, GSourceFunc callback, gpointer user_data) -> gboolean {
+      return callback(user_data);
+    },
+    nullptr, // finalize
+    nullptr,
+    nullptr,
+};
+
+struct SchedulerMetrics {
+  Metrics::Counter &run;
+  Metrics::Counter &coalesced;
+  Metrics::Counter &cancelled;
+  Metrics::Gauge &pending;
+};
+
+SchedulerMetrics &schedulerMetrics() {
+  static SchedulerMetrics metrics{
+      Metrics::getInstance().counter("ibus_libime_scheduler_tasks_run_total",
+                                     "Deferred tasks run by the scheduler"),
+      Metrics::getInstance().counter(
+          "ibus_libime_scheduler_tasks_coalesced_total",
+          "Deferred tasks merged into an already pending task"),
+      Metrics::getInstance().counter(
+          "ibus_libime_scheduler_tasks_cancelled_total",
+          "Deferred tasks cancelled before they ran"),
+      Metrics::getInstance().gauge("ibus_libime_scheduler_tasks_pending",
+                                   "Deferred tasks waiting to run"),
+  };
+  return metrics;
+}
+
+} // namespace
+
+TaskScheduler::TaskScheduler()
+    : timer_(createSource(G_PRIORITY_DEFAULT, onTimer, this)),
+      idle_(createSource(G_PRIORITY_LOW, onIdle, this)), next_id_(1) {}
+
+TaskScheduler::~TaskScheduler() {
+  g_source_destroy(timer_);
+  g_source_unref(timer_);
+  g_source_destroy(idle_);
+  g_source_unref(idle_);
+}
+
+GSource *TaskScheduler::createSource(int priority, GSourceFunc func,
+                                     gpointer user_data) {
+  GSource *source = g_source_new(&readyTimeSourceFuncs, sizeof(GSource));
+  g_source_set_priority(source, priority);
+  g_source_set_callback(source, func, user_data, nullptr);
+  g_source_set_ready_time(source, -1);
+  g_source_attach(source, nullptr);
+  return source;
+}
+
+TaskScheduler::TaskId TaskScheduler::runLater(guint delay_ms, Task task,
+                                              Priority priority,
+                                              const void *key) {
+  return post(delay_ms, std::move(task), priority, key, false);
+}
+
+TaskScheduler::TaskId TaskScheduler::runWhenIdle(guint delay_ms, Task task,
+                                                 Priority priority,
+                                                 const void *key) {
+  return post(delay_ms, std::move(task), priority, key, true);
+}
+
+TaskScheduler::TaskId TaskScheduler::post(guint delay_ms, Task task,
+                                          Priority priority, const void *key,
+                                          bool idle) {
+  gint64 deadline =
+      g_get_monotonic_time() + static_cast<gint64>(delay_ms) * 1000;
+
+  if (key) {
+    auto it = std::find_if(tasks_.begin(), tasks_.end(),
+                           [key](const Entry &e) { return e.key == key; });
+    if (it != tasks_.end()) {
+      // Keep the earlier deadline so coalescing never delays work
+      it->deadline = std::min(it->deadline, deadline);
+      it->priority = std::max(it->priority, priority);
+      it->idle = it->idle || idle;
+      it->task = std::move(task);
+      schedulerMetrics().coalesced.inc();
+      rearm();
+      return it->id;
+    }
+  }
+
+  TaskId id = next_id_++;
+  tasks_.push_back({id, key, priority, deadline, idle, std::move(task)});
+  rearm();
+  return id;
+}
+
+bool TaskScheduler::cancel(TaskId id) {
+  if (id == 0) {
+    return false;
+  }
+  auto it = std::find_if(tasks_.begin(), tasks_.end(),
+                         [id](const Entry &e) { return e.id == id; });
+  if (it == tasks_.end()) {
+    return false;
+  }
+  tasks_.erase(it);
+  schedulerMetrics().cancelled.inc();
+  rearm();
+  return true;
+}
+
+void TaskScheduler::cancelKey(const void *key) {
+  auto it = std::find_if(tasks_.begin(), tasks_.end(),
+                         [key](const Entry &e) { return e.key == key; });
+  if (key && it != tasks_.end()) {
+    tasks_.erase(it);
+    schedulerMetrics().cancelled.inc();
+    rearm();
+  }
+}
+
+bool TaskScheduler::pending(const void *key) const {
+  return key && std::any_of(tasks_.begin(), tasks_.end(),
+                            [key](const Entry &e) { return e.key == key; });
+}
+
+void TaskScheduler::run(bool idle) {
+  // Tasks may post or cancel other tasks, so pick one at a time
+  for (;;) {
+    gint64 now = g_get_monotonic_time();
+    auto best = tasks_.end();
+    for (auto it = tasks_.begin(); it != tasks_.end(); ++it) {
+      if (!(it->deadline <= now || (idle && it->idle))) {
+        continue;
+      }
+      if (best == tasks_.end() || it->priority > best->priority ||
+          (it->priority == best->priority && it->deadline < best->deadline)) {
+        best = it;
+      }
+    }
+    if (best == tasks_.end()) {
+      break;
+    }
+
+    Task task = std::move(best->task);
+    tasks_.erase(best);
+    task();
+    schedulerMetrics().run.inc();
+  }
+  rearm();
+}
+
+void TaskScheduler::rearm() {
+  gint64 deadline = -1;
+  bool idle = false;
+  for (const auto &entry : tasks_) {
+    if (deadline < 0 || entry.deadline < deadline) {
+      deadline = entry.deadline;
+    }
+    idle = idle || entry.idle;
+  }
+  g_source_set_ready_time(timer_, deadline);
+  g_source_set_ready_time(idle_, idle ? 0 : -1);
+  schedulerMetrics().pending.set(static_cast<int64_t>(tasks_.size()));
+}
+
+gboolean TaskScheduler::onTimer(gpointer user_data) {
+  static_cast<TaskScheduler *>(user_data)->run(false);
+  return G_SOURCE_CONTINUE;
+}
+
+gboolean TaskScheduler::onIdle(gpointer user_data) {
+  static_cast<TaskScheduler *>(user_data)->run(true);
+  return G_SOURCE_CONTINUE;
+}
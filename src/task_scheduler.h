@@ -0,0 +1,81 @@
+#ifndef IBUS_LIBIME_TASK_SCHEDULER_H
+#define IBUS_LIBIME_TASK_SCHEDULER_H
+
+#include <glib.h>
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// Runs deferred work from the GLib main loop.
+//
+// All deferred tasks share two long-lived sources: a timer whose ready time
+// tracks the earliest deadline, and a low-priority source that only fires
+// when the loop has nothing else to do. Tasks can be cancelled by id, and
+// tasks posted with the same key are coalesced into one, so callers can post
+// on every event without piling up timers.
+class TaskScheduler {
+public:
+  using TaskId = uint64_t; // 0 is never a valid id
+  using Task = std::function<void()>;
+
+  // Order in which tasks that are due together run
+  enum class Priority { Low, Normal, High };
+
+  static TaskScheduler &getInstance() {
+    static TaskScheduler instance;
+    return instance;
+  }
+
+  // Run task once delay_ms has passed
+  TaskId runLater(guint delay_ms, Task task,
+                  Priority priority = Priority::Normal,
+                  const void *key = nullptr);
+
+  // Run task as soon as the main loop is idle, and after delay_ms at the
+  // latest
+  TaskId runWhenIdle(guint delay_ms, Task task,
+                     Priority priority = Priority::Normal,
+                     const void *key = nullptr);
+
+  // Drop a pending task; returns false if it already ran or was cancelled
+  bool cancel(TaskId id);
+  // Drop the pending task posted with key, if any
+  void cancelKey(const void *key);
+
+  bool pending(const void *key) const;
+  size_t size() const { return tasks_.size(); }
+
+private:
+  TaskScheduler();
+  ~TaskScheduler();
+
+  struct Entry {
+    TaskId id;
+    const void *key;
+    Priority priority;
+    gint64 deadline; // Monotonic time, microseconds
+    bool idle;       // May also run early, when the loop is idle
+    Task task;
+  };
+
+  TaskId post(guint delay_ms, Task task, Priority priority, const void *key,
+              bool idle);
+  // Run every task selected by the filter, highest priority first
+  void run(bool idle);
+  void rearm();
+  static GSource *createSource(int priority, GSourceFunc func,
+                               gpointer user_data);
+  static gboolean onTimer(gpointer user_data);
+  static gboolean onIdle(gpointer user_data);
+
+  GSource *timer_;
+  GSource *idle_;
+  TaskId next_id_;
+  std::vector<Entry> tasks_;
+
+  TaskScheduler(const TaskScheduler &) = delete;
+  TaskScheduler &operator=(const TaskScheduler &) = delete;
+};
+
+#endif // IBUS_LIBIME_TASK_SCHEDULER_H
@@ -0,0 +1,285 @@
+// Build, query and benchmark the abbreviation index used for initials-only
+// input such as "zgrm".
+//
+// Usage:
+//   ibus-libime-abbrev build <out.dat> <dict>...
+//   ibus-libime-abbrev lookup <abbrev.dat> [initials]...
+//   ibus-libime-abbrev bench <abbrev.dat> [rounds]
+//
+// Dictionaries are libime pinyin dictionaries: binary ones (*.dict, such as
+// the system sc.dict or a user.dict) or text ones with a phrase, its
+// apostrophe-separated pinyin and an optional weight per line. Phrases are
+// ranked by weight, higher first; when a phrase appears more than once its
+// highest weight counts.
+//
+// bench types a set of initials through the pinyin decoder, as the engine
+// would without the index, and looks the same input up in the index. The
+// pinyin dictionary must be installed (or LIBIME_DATA_DIR set).
+
+#include <libime/core/userlanguagemodel.h>
+#include <libime/pinyin/pinyincontext.h>
+#include <libime/pinyin/pinyindictionary.h>
+#include <libime/pinyin/pinyinime.h>
+
+#include <algorithm>
+#include <chrono>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "abbreviation_index.h"
+#include "mapped_trie.h"
+#include "pinyin_engine.h"
+
+namespace {
+
+// Abbreviations of common phrases, idioms and names
+const char *const kBenchInitials[] = {
+    "zgrm", "bjdx", "zhrmghg", "yyds", "xxgz", "jsj",
+    "dnxx", "ysyd", "qhdx", "zgkxy", "rmrb", "xjp",
+};
+
+int usage(const char *argv0) {
+  std::cerr << std::format("Usage:\n"
+                           "  {0} build <out.dat> <dict>...\n"
+                           "  {0} lookup <abbrev.dat> [initials]...\n"
+                           "  {0} bench <abbrev.dat> [rounds]\n",
+                           argv0);
+  return 1;
+}
+
+struct Phrase {
+  std::string text;
+  float weight;
+};
+
+// Initials of an apostrophe-separated pinyin, or empty if it has too few or
+// too many syllables
+std::string initialsOf(const std::string &pinyin) {
+  std::string initials;
+  bool start = true;
+  for (char c : pinyin) {
+    if (c == '\'') {
+      start = true;
+      continue;
+    }
+    if (c < 'a' || c > 'z') {
+      return {};
+    }
+    if (start) {
+      initials.push_back(c);
+      start = false;
+    }
+  }
+  if (initials.size() < AbbreviationIndex::kMinInitials ||
+      initials.size() > AbbreviationIndex::kMaxInitials) {
+    return {};
+  }
+  return initials;
+}
+
+// Read a dictionary as text, converting binary libime dictionaries
+bool readDictionary(const std::string &path, std::stringstream &text) {
+  if (path.ends_with(".dict")) {
+    libime::PinyinDictionary dict;
+    try {
+      dict.load(libime::PinyinDictionary::SystemDict, path.c_str(),
+                libime::PinyinDictFormat::Binary);
+    } catch (const std::exception &) {
+      return false;
+    }
+    dict.save(libime::PinyinDictionary::SystemDict, text,
+              libime::PinyinDictFormat::Text);
+    return true;
+  }
+  std::ifstream in(path);
+  if (!in) {
+    return false;
+  }
+  text << in.rdbuf();
+  return true;
+}
+
+int build(int argc, char *argv[]) {
+  // Initials to phrase to its best weight
+  std::map<std::string, std::map<std::string, float>> index;
+  for (int i = 3; i < argc; ++i) {
+    std::stringstream text;
+    if (!readDictionary(argv[i], text)) {
+      std::cerr << std::format("Cannot open {}\n", argv[i]);
+      return 1;
+    }
+    size_t added = 0;
+    std::string line;
+    while (std::getline(text, line)) {
+      std::istringstream fields(line);
+      std::string phrase, pinyin;
+      float weight = 0;
+      if (!(fields >> phrase >> pinyin)) {
+        continue;
+      }
+      fields >> weight;
+      std::string initials = initialsOf(pinyin);
+      if (initials.empty()) {
+        continue;
+      }
+      auto [it, inserted] = index[initials].try_emplace(phrase, weight);
+      it->second = std::max(it->second, weight);
+      added += inserted;
+    }
+    std::cout << std::format("{}: {} phrases\n", argv[i], added);
+  }
+
+  TrieBuilder builder;
+  size_t kept = 0;
+  std::vector<Phrase> ranked;
+  for (const auto &[initials, phrases] : index) {
+    ranked.clear();
+    for (const auto &[phrase, weight] : phrases) {
+      ranked.push_back({phrase, weight});
+    }
+    size_t count = std::min(ranked.size(), AbbreviationIndex::kMaxPhrases);
+    std::partial_sort(ranked.begin(), ranked.begin() + count, ranked.end(),
+                      [](const Phrase &a, const Phrase &b) {
+                        return a.weight > b.weight;
+                      });
+    std::string value;
+    for (size_t i = 0; i < count; ++i) {
+      if (i) {
+        value.push_back('\0');
+      }
+      value += ranked[i].text;
+    }
+    builder.insert(initials, value);
+    kept += count;
+  }
+  if (!builder.write(argv[2], AbbreviationIndex::kMagic)) {
+    std::cerr << std::format("Failed to write {}\n", argv[2]);
+    return 1;
+  }
+  std::cout << std::format("Wrote {} phrases under {} abbreviations to {}\n",
+                           kept, builder.size(), argv[2]);
+  return 0;
+}
+
+std::string_view lookup(const MappedTrie &trie, const std::string &initials) {
+  uint32_t node = trie.find(initials);
+  if (node == MappedTrie::kInvalid || !trie.hasValue(node)) {
+    return {};
+  }
+  return trie.value(node);
+}
+
+void print(const MappedTrie &trie, const std::string &initials) {
+  std::string_view phrases = lookup(trie, initials);
+  std::cout << initials << ":";
+  while (!phrases.empty()) {
+    std::cout << " " << AbbreviationIndex::nextPhrase(phrases);
+  }
+  std::cout << "\n";
+}
+
+int bench(const MappedTrie &trie, int argc, char *argv[]) {
+  size_t rounds = argc > 3 ? std::stoul(argv[3]) : 100;
+  if (rounds == 0) {
+    return 1;
+  }
+
+  libime::PinyinIME ime(
+      std::make_unique<libime::PinyinDictionary>(),
+      std::make_unique<libime::UserLanguageModel>(
+          libime::DefaultLanguageModelResolver::instance()
+              .languageModelFileForLanguage("zh_CN")));
+  ime.dict()->load(libime::PinyinDictionary::SystemDict,
+                   PinyinEngine::getDataPath("sc.dict").c_str(),
+                   libime::PinyinDictFormat::Binary);
+  libime::PinyinContext context(&ime);
+
+  using Clock = std::chrono::steady_clock;
+  double decode_total = 0, index_total = 0, index_max = 0;
+  size_t phrases = 0;
+  for (size_t r = 0; r < rounds; ++r) {
+    for (const char *initials : kBenchInitials) {
+      auto start = Clock::now();
+      context.clear();
+      context.type(initials);
+      decode_total += std::chrono::duration<double, std::micro>(
+                          Clock::now() - start)
+                          .count();
+
+      start = Clock::now();
+      std::string_view list = lookup(trie, initials);
+      while (!list.empty()) {
+        AbbreviationIndex::nextPhrase(list);
+        ++phrases;
+      }
+      double elapsed =
+          std::chrono::duration<double, std::micro>(Clock::now() - start)
+              .count();
+      index_total += elapsed;
+      index_max = std::max(index_max, elapsed);
+    }
+  }
+
+  // What each path ranks first, to compare quality
+  for (const char *initials : kBenchInitials) {
+    context.clear();
+    context.type(initials);
+    std::string decoded = context.candidates().empty()
+                              ? std::string("-")
+                              : context.candidates()[0].toString();
+    std::string_view list = lookup(trie, initials);
+    std::string_view indexed = AbbreviationIndex::nextPhrase(list);
+    std::cout << std::format("{:10} decoder: {:12} index: {}\n", initials,
+                             decoded, indexed.empty() ? "-" : indexed);
+  }
+
+  double inputs = static_cast<double>(rounds * std::size(kBenchInitials));
+  std::cout << std::format("{} inputs: decoder {:.2f} us/input, "
+                           "index {:.3f} us/input (max {:.3f} us, "
+                           "{:.1f} phrases each)\n",
+                           static_cast<size_t>(inputs), decode_total / inputs,
+                           index_total / inputs, index_max, phrases / inputs);
+  return 0;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  if (argc < 3) {
+    return usage(argv[0]);
+  }
+
+  std::string command = argv[1];
+  if (command == "build") {
+    return argc < 4 ? usage(argv[0]) : build(argc, argv);
+  }
+
+  MappedTrie trie;
+  if (!trie.open(argv[2], AbbreviationIndex::kMagic)) {
+    std::cerr << std::format("{} is not an abbreviation index\n", argv[2]);
+    return 1;
+  }
+  if (command == "bench") {
+    return bench(trie, argc, argv);
+  }
+  if (command != "lookup") {
+    return usage(argv[0]);
+  }
+  if (argc > 3) {
+    for (int i = 3; i < argc; ++i) {
+      print(trie, argv[i]);
+    }
+    return 0;
+  }
+  std::string line;
+  while (std::getline(std::cin, line)) {
+    print(trie, line);
+  }
+  return 0;
+}
@@ -0,0 +1,359 @@
+// Compile text lexicons into binary pinyin dictionaries, and import phrases
+// into the user dictionary.
+//
+// Usage:
+//   ibus-libime-dict build [-j threads] <out.dict> <lexicon[:weight]>...
+//   ibus-libime-dict import [-j threads] <user.dict> <lexicon[:weight]>...
+//
+// Lexicons have one phrase per line: the phrase, its apostrophe-separated
+// pinyin and an optional frequency (default 1), separated by spaces or tabs.
+// A lexicon's frequencies are multiplied by its weight (default 1). Entries
+// with the same phrase and pinyin are merged by adding their weighted
+// frequencies, and every entry gets the cost log10(frequency / total), so
+// frequent phrases rank first.
+//
+// Lexicons are memory-mapped and cut into line-aligned chunks that worker
+// threads parse and validate in parallel. Each worker sorts its entries into
+// hash shards, and every shard is then merged by its own thread, so nothing
+// is serialized until the dictionary itself is built. build writes a new
+// dictionary for the [general] dictionaries setting; import adds to the user
+// dictionary (~/.local/share/ibus-libime/user.dict by default), keeping the
+// phrases already in it.
+
+#include <libime/pinyin/pinyindictionary.h>
+#include <libime/pinyin/pinyinencoder.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "mapped_file.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Chunks per thread, so uneven chunks still balance out
+constexpr size_t kChunksPerThread = 8;
+// Each thread also owns a shard per thread, so -j grows quadratically
+constexpr size_t kMaxThreads = 256;
+
+int usage(const char *argv0) {
+  std::cerr << std::format(
+      "Usage:\n"
+      "  {0} build [-j threads] <out.dict> <lexicon[:weight]>...\n"
+      "  {0} import [-j threads] <user.dict> <lexicon[:weight]>...\n",
+      argv0);
+  return 1;
+}
+
+// Parse a whole argument as a number; false if anything is left over
+template <typename T> bool parseNumber(std::string_view text, T &value) {
+  const char *end = text.data() + text.size();
+  auto [ptr, ec] = std::from_chars(text.data(), end, value);
+  return ec == std::errc() && ptr == end;
+}
+
+double secondsSince(Clock::time_point start) {
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+struct Lexicon {
+  std::string path;
+  double weight;
+  MappedFile file;
+};
+
+// A line-aligned part of one lexicon
+struct Chunk {
+  const Lexicon *lexicon;
+  size_t begin;
+  size_t end;
+};
+
+// Weighted frequencies keyed by "pinyin\tphrase"
+using Shard = std::unordered_map<std::string, double>;
+
+struct WorkerResult {
+  std::vector<Shard> shards;
+  size_t lines = 0;
+  size_t invalid = 0;
+};
+
+std::vector<Chunk> splitChunks(const std::vector<Lexicon> &lexicons,
+                               size_t threads) {
+  size_t total = 0;
+  for (const auto &lexicon : lexicons) {
+    total += lexicon.file.size();
+  }
+  size_t target = std::max<size_t>(total / (threads * kChunksPerThread), 1);
+
+  std::vector<Chunk> chunks;
+  for (const auto &lexicon : lexicons) {
+    const char *data = lexicon.file.data();
+    size_t size = lexicon.file.size();
+    size_t begin = 0;
+    while (begin < size) {
+      size_t end = std::min(begin + target, size);
+      const void *newline = end < size
+                                ? std::memchr(data + end, '\n', size - end)
+                                : nullptr;
+      end = newline ? static_cast<const char *>(newline) - data + 1 : size;
+      chunks.push_back({&lexicon, begin, end});
+      begin = end;
+    }
+  }
+  return chunks;
+}
+
+// Next space- or tab-separated field of line
+std::string_view nextField(std::string_view &line) {
+  size_t begin = line.find_first_not_of(" \t\r");
+  if (begin == std::string_view::npos) {
+    line = {};
+    return {};
+  }
+  size_t end = line.find_first_of(" \t\r", begin);
+  std::string_view field = line.substr(begin, end - begin);
+  line = end == std::string_view::npos ? std::string_view()
+                                       : line.substr(end);
+  return field;
+}
+
+void parseChunk(const Chunk &chunk, WorkerResult &result,
+                std::atomic<size_t> &parsed) {
+  std::string_view text(chunk.lexicon->file.data() + chunk.begin,
+                        chunk.end - chunk.begin);
+  std::string key;
+  std::hash<std::string_view> hash;
+  while (!text.empty()) {
+    size_t newline = text.find('\n');
+    std::string_view line = text.substr(0, newline);
+    text = newline == std::string_view::npos ? std::string_view()
+                                             : text.substr(newline + 1);
+    std::string_view phrase = nextField(line);
+    if (phrase.empty() || phrase[0] == '#') {
+      continue;
+    }
+    ++result.lines;
+    std::string_view pinyin = nextField(line);
+    std::string_view frequency_text = nextField(line);
+    double frequency = 1;
+    if (!frequency_text.empty()) {
+      std::from_chars(frequency_text.data(),
+                      frequency_text.data() + frequency_text.size(),
+                      frequency);
+    }
+    if (pinyin.empty() || !(frequency > 0)) {
+      ++result.invalid;
+      continue;
+    }
+    // Validation is the expensive part of parsing and runs here, in
+    // parallel, rather than when the dictionary is built
+    try {
+      libime::PinyinEncoder::encodeFullPinyin(pinyin);
+    } catch (const std::exception &) {
+      ++result.invalid;
+      continue;
+    }
+
+    key.assign(pinyin);
+    key.push_back('\t');
+    key.append(phrase);
+    Shard &shard = result.shards[hash(key) % result.shards.size()];
+    shard[key] += frequency * chunk.lexicon->weight;
+  }
+  parsed.fetch_add(chunk.end - chunk.begin, std::memory_order_relaxed);
+}
+
+int compile(int argc, char *argv[], bool import) {
+  size_t threads = std::max(1u, std::thread::hardware_concurrency());
+  int arg = 2;
+  if (arg + 1 < argc && std::strcmp(argv[arg], "-j") == 0) {
+    if (!parseNumber(argv[arg + 1], threads)) {
+      return usage(argv[0]);
+    }
+    threads = std::clamp<size_t>(threads, 1, kMaxThreads);
+    arg += 2;
+  }
+  if (argc - arg < 2) {
+    return usage(argv[0]);
+  }
+  std::string output = argv[arg++];
+
+  std::vector<Lexicon> lexicons(argc - arg);
+  size_t total_bytes = 0;
+  for (size_t i = 0; i < lexicons.size(); ++i) {
+    std::string spec = argv[arg + i];
+    Lexicon &lexicon = lexicons[i];
+    lexicon.weight = 1;
+    size_t colon = spec.rfind(':');
+    if (colon != std::string::npos && colon + 1 < spec.size() &&
+        !std::filesystem::exists(spec)) {
+      if (!parseNumber(std::string_view(spec).substr(colon + 1),
+                       lexicon.weight)) {
+        return usage(argv[0]);
+      }
+      spec.resize(colon);
+    }
+    if (!(lexicon.weight > 0)) {
+      std::cerr << std::format("Weight of {} must be positive\n", spec);
+      return 1;
+    }
+    lexicon.path = spec;
+    if (!lexicon.file.open(spec)) {
+      std::cerr << std::format("Cannot open {}\n", spec);
+      return 1;
+    }
+    total_bytes += lexicon.file.size();
+  }
+
+  // Parse: workers take chunks until none are left
+  auto start = Clock::now();
+  std::vector<Chunk> chunks = splitChunks(lexicons, threads);
+  std::vector<WorkerResult> results(threads);
+  std::atomic<size_t> next_chunk{0};
+  std::atomic<size_t> parsed{0};
+  std::atomic<size_t> running{threads};
+  std::vector<std::thread> workers;
+  for (size_t t = 0; t < threads; ++t) {
+    results[t].shards.resize(threads);
+    workers.emplace_back([&, t]() {
+      for (size_t i; (i = next_chunk.fetch_add(1)) < chunks.size();) {
+        parseChunk(chunks[i], results[t], parsed);
+      }
+      running.fetch_sub(1);
+    });
+  }
+  bool progress = isatty(STDERR_FILENO);
+  while (running.load() > 0) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(250));
+    if (progress && total_bytes > 0) {
+      size_t done = parsed.load();
+      std::cerr << std::format("\rParsing: {:3}% ({:.1f} MB/s)",
+                               done * 100 / total_bytes,
+                               done / 1e6 / secondsSince(start));
+    }
+  }
+  for (auto &worker : workers) {
+    worker.join();
+  }
+  if (progress) {
+    std::cerr << "\r" << std::string(40, ' ') << "\r";
+  }
+  double parse_seconds = secondsSince(start);
+  size_t lines = 0, invalid = 0;
+  for (const auto &result : results) {
+    lines += result.lines;
+    invalid += result.invalid;
+  }
+  std::cout << std::format(
+      "Parsed {} lines ({:.1f} MB) from {} lexicon(s) in {:.2f}s with {} "
+      "thread(s): {:.1f} MB/s, {:.0f} lines/s, {} invalid\n",
+      lines, total_bytes / 1e6, lexicons.size(), parse_seconds, threads,
+      total_bytes / 1e6 / parse_seconds, lines / parse_seconds, invalid);
+
+  // Merge: shard s of every worker is merged by thread s
+  start = Clock::now();
+  std::vector<Shard> merged(threads);
+  workers.clear();
+  for (size_t s = 0; s < threads; ++s) {
+    workers.emplace_back([&, s]() {
+      Shard &into = merged[s];
+      for (auto &result : results) {
+        Shard &from = result.shards[s];
+        if (into.empty()) {
+          into = std::move(from);
+          continue;
+        }
+        for (auto &[key, frequency] : from) {
+          into[key] += frequency;
+        }
+        Shard().swap(from);
+      }
+    });
+  }
+  for (auto &worker : workers) {
+    worker.join();
+  }
+  std::vector<std::pair<std::string, double>> entries;
+  double total_frequency = 0;
+  for (auto &shard : merged) {
+    for (auto &[key, frequency] : shard) {
+      total_frequency += frequency;
+      entries.emplace_back(key, frequency);
+    }
+    Shard().swap(shard);
+  }
+  // Sorted, so the same lexicons always give the same dictionary
+  std::sort(entries.begin(), entries.end());
+  std::cout << std::format("Merged into {} entries ({} duplicates) in "
+                           "{:.2f}s\n",
+                           entries.size(), lines - invalid - entries.size(),
+                           secondsSince(start));
+
+  // Build and save
+  start = Clock::now();
+  libime::PinyinDictionary dict;
+  size_t index = libime::PinyinDictionary::SystemDict;
+  try {
+    std::error_code ec;
+    if (import && std::filesystem::exists(output, ec)) {
+      dict.load(index, output.c_str(), libime::PinyinDictFormat::Binary);
+    }
+    for (const auto &[key, frequency] : entries) {
+      size_t tab = key.find('\t');
+      float cost = static_cast<float>(std::log10(frequency / total_frequency));
+      dict.addWord(index, std::string_view(key).substr(0, tab),
+                   std::string_view(key).substr(tab + 1), cost);
+    }
+    std::filesystem::path parent = std::filesystem::path(output).parent_path();
+    if (!parent.empty()) {
+      std::filesystem::create_directories(parent);
+    }
+    std::ofstream out(output, std::ios::binary | std::ios::trunc);
+    dict.save(index, out, libime::PinyinDictFormat::Binary);
+    if (!out) {
+      std::cerr << std::format("Failed to write {}\n", output);
+      return 1;
+    }
+  } catch (const std::exception &e) {
+    std::cerr << std::format("Failed to build {}: {}\n", output, e.what());
+    return 1;
+  }
+  std::cout << std::format("{} {} entries {} {} in {:.2f}s\n",
+                           import ? "Imported" : "Wrote", entries.size(),
+                           import ? "into" : "to", output,
+                           secondsSince(start));
+  return 0;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  if (argc < 4) {
+    return usage(argv[0]);
+  }
+  std::string command = argv[1];
+  if (command == "build") {
+    return compile(argc, argv, false);
+  }
+  if (command == "import") {
+    return compile(argc, argv, true);
+  }
+  return usage(argv[0]);
+}
@@ -0,0 +1,71 @@
+#!/bin/sh
+# End-to-end key latency: client -> ibus-daemon -> ibus-engine-libime and
+# back, measured on a private D-Bus session and ibus-daemon so it runs
+# without a desktop session.
+#
+# Usage: e2e_bench.sh <build-dir> [rounds] [max-p99-us]
+#
+# Needs dbus-run-session and ibus-daemon in PATH, and the build directory
+# must contain ibus-engine-libime, ibus-libime-bench and libime.xml
+# (configure with -DBUILD_BENCHMARKS=ON). Exits non-zero when the p99 round
+# trip is above max-p99-us.
+
+set -eu
+
+if [ $# -lt 1 ]; then
+    echo "Usage: $0 <build-dir> [rounds] [max-p99-us]" >&2
+    exit 1
+fi
+
+# Re-run inside a private session bus
+if [ -z "${IBUS_LIBIME_E2E_SESSION:-}" ]; then
+    IBUS_LIBIME_E2E_SESSION=1 exec dbus-run-session -- "$0" "$@"
+fi
+
+BUILD_DIR=$(cd "$1" && pwd)
+ROUNDS=${2:-20}
+MAX_P99=${3:-0}
+
+WORK_DIR=$(mktemp -d)
+DAEMON_PID=
+ENGINE_PID=
+cleanup() {
+    [ -n "$ENGINE_PID" ] && kill "$ENGINE_PID" 2>/dev/null || true
+    [ -n "$DAEMON_PID" ] && kill "$DAEMON_PID" 2>/dev/null || true
+    wait 2>/dev/null || true
+    rm -rf "$WORK_DIR"
+}
+trap cleanup EXIT INT TERM
+
+# Keep the user's configuration, caches and learned data out of the run
+export HOME="$WORK_DIR/home"
+export XDG_CONFIG_HOME="$HOME/.config"
+export XDG_CACHE_HOME="$HOME/.cache"
+export XDG_DATA_HOME="$HOME/.local/share"
+export XDG_RUNTIME_DIR="$WORK_DIR/run"
+mkdir -p "$XDG_CONFIG_HOME" "$XDG_CACHE_HOME" "$XDG_DATA_HOME"
+mkdir -m 700 "$XDG_RUNTIME_DIR"
+
+mkdir "$WORK_DIR/component"
+cp "$BUILD_DIR/libime.xml" "$WORK_DIR/component/"
+export IBUS_COMPONENT_PATH="$WORK_DIR/component"
+export IBUS_ADDRESS="unix:path=$WORK_DIR/ibus.sock"
+
+ibus-daemon --address="$IBUS_ADDRESS" --panel=disable --config=disable \
+    --cache=none --replace &
+DAEMON_PID=$!
+
+i=0
+while [ ! -S "$WORK_DIR/ibus.sock" ]; do
+    i=$((i + 1))
+    if [ $i -gt 100 ]; then
+        echo "ibus-daemon did not start" >&2
+        exit 1
+    fi
+    sleep 0.1
+done
+
+"$BUILD_DIR/ibus-engine-libime" >/dev/null &
+ENGINE_PID=$!
+
+"$BUILD_DIR/ibus-libime-bench" keys "$ROUNDS" "$MAX_P99"
@@ -0,0 +1,767 @@
+// Benchmarks for the engine's IBus-facing paths.
+//
+// Usage:
+//   ibus-libime-bench focus [engines] [rounds]
+//   ibus-libime-bench keys [rounds] [max-p99-us]
+//   ibus-libime-bench typing [rounds]
+//   ibus-libime-bench replay <sessions.txt> [rounds]
+//   ibus-libime-bench service [sessions] [rounds]
+//
+// focus runs in-process: engines are real IBusLibIMEEngine objects exported
+// on a private D-Bus peer connection (a socketpair), so every signal they emit
+// is serialized and sent exactly as it would be to ibus-daemon. The peer side
+// only counts messages. The pinyin dictionary must be installed (or
+// LIBIME_DATA_DIR set).
+//
+// keys is an IBus client: it connects to the ibus-daemon at IBUS_ADDRESS,
+// waits for ibus-engine-libime to register, types a pinyin corpus through an
+// input context and reports the key round-trip latency distribution. With
+// max-p99-us it exits with status 2 when the p99 latency is above the limit.
+// tools/e2e_bench.sh sets up a private daemon and engine for it.
+//
+// typing feeds the same corpus straight into one in-process engine and
+// reports the time per key. In builds configured with ENABLE_ALLOC_PROFILING
+// it also reports heap allocations per letter key, split into the front end
+// and libime, and exits with status 2 when the front end averages more than
+// AllocStats::kKeystrokeBudget.
+//
+// replay plays the keystroke sessions of a corpus (data/replay/sessions.txt)
+// through one in-process engine and reports the time per key press. It is
+// the training workload of profile-guided builds (tools/pgo_build.sh) and
+// the measure of their gain.
+//
+// service opens many sessions (default 50) on the running decode service
+// (ibus-libime-decoded, at the [service] socket) and types the corpus into
+// all of them in turn. It reports the round-trip latency per key next to
+// decoding the same keys in process, and the service's resident memory next
+// to what one IME per session would take, measured as the growth of this
+// process when it loads the IME.
+
+#include <gio/gio.h>
+#include <ibus.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "alloc_stats.h"
+#include "configs.h"
+#include "ibus_engine.h"
+#include "pinyin_engine.h"
+#include "remote_pinyin_engine.h"
+
+namespace {
+
+int usage(const char *argv0) {
+  std::cerr << std::format("Usage:\n"
+                           "  {0} focus [engines] [rounds]\n"
+                           "  {0} keys [rounds] [max-p99-us]\n"
+                           "  {0} typing [rounds]\n"
+                           "  {0} replay <sessions.txt> [rounds]\n"
+                           "  {0} service [sessions] [rounds]\n",
+                           argv0);
+  return 1;
+}
+
+// Both ends of a D-Bus peer connection; messages sent by the engines arrive
+// at peer and are counted (and dropped) by a filter
+struct PeerConnection {
+  GDBusConnection *engines = nullptr;
+  GDBusConnection *peer = nullptr;
+  std::atomic<size_t> messages{0};
+};
+
+GDBusMessage *countMessage(GDBusConnection *, GDBusMessage *message,
+                           gboolean incoming, gpointer user_data) {
+  if (incoming) {
+    static_cast<PeerConnection *>(user_data)->messages++;
+    g_object_unref(message);
+    return nullptr;
+  }
+  return message;
+}
+
+GIOStream *socketStream(int fd) {
+  GSocket *socket = g_socket_new_from_fd(fd, nullptr);
+  if (!socket) {
+    return nullptr;
+  }
+  GSocketConnection *connection =
+      g_socket_connection_factory_create_connection(socket);
+  g_object_unref(socket);
+  return G_IO_STREAM(connection);
+}
+
+bool connectPeer(PeerConnection &conn) {
+  int fds[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+    return false;
+  }
+  GIOStream *engine_stream = socketStream(fds[0]);
+  GIOStream *peer_stream = socketStream(fds[1]);
+  if (!engine_stream || !peer_stream) {
+    return false;
+  }
+
+  // The server side authenticates in a worker thread while the client side
+  // blocks here
+  gchar *guid = g_dbus_generate_guid();
+  g_dbus_connection_new(
+      peer_stream, guid, G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_SERVER,
+      nullptr, nullptr,
+      [](GObject *, GAsyncResult *result, gpointer user_data) {
+        auto *conn = static_cast<PeerConnection *>(user_data);
+        conn->peer = g_dbus_connection_new_finish(result, nullptr);
+        if (conn->peer) {
+          g_dbus_connection_add_filter(conn->peer, countMessage, conn,
+                                       nullptr);
+        }
+      },
+      &conn);
+  g_free(guid);
+
+  GError *error = nullptr;
+  conn.engines = g_dbus_connection_new_sync(
+      engine_stream, nullptr, G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT,
+      nullptr, nullptr, &error);
+  g_object_unref(engine_stream);
+  g_object_unref(peer_stream);
+  if (!conn.engines) {
+    std::cerr << std::format("D-Bus handshake failed: {}\n", error->message);
+    g_error_free(error);
+    return false;
+  }
+  while (!conn.peer) {
+    g_main_context_iteration(nullptr, TRUE);
+  }
+  return true;
+}
+
+// Wait until everything sent so far has been counted by the peer
+size_t settle(PeerConnection &conn) {
+  g_dbus_connection_flush_sync(conn.engines, nullptr, nullptr);
+  size_t last = conn.messages.load();
+  for (;;) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    size_t now = conn.messages.load();
+    if (now == last) {
+      return now;
+    }
+    last = now;
+  }
+}
+
+void focusChange(IBusEngine *from, const std::string &from_path,
+                 IBusEngine *to, const std::string &to_path) {
+  if (from) {
+    IBUS_ENGINE_GET_CLASS(from)->focus_out_id(from, from_path.c_str());
+  }
+  IBUS_ENGINE_GET_CLASS(to)->focus_in_id(to, to_path.c_str(), "bench");
+}
+
+int focus(int argc, char *argv[]) {
+  size_t count = argc > 2 ? std::stoul(argv[2]) : 8;
+  size_t rounds = argc > 3 ? std::stoul(argv[3]) : 1000;
+  if (count == 0 || rounds == 0) {
+    return 1;
+  }
+
+  PeerConnection conn;
+  if (!connectPeer(conn)) {
+    return 1;
+  }
+  PinyinEngine::initializeSharedIME();
+
+  std::vector<IBusEngine *> engines;
+  std::vector<std::string> contexts;
+  for (size_t i = 0; i < count; ++i) {
+    std::string path = std::format("/org/freedesktop/IBus/Engine/{}", i + 1);
+    engines.push_back(ibus_engine_new_with_type(
+        IBUS_TYPE_LIBIME_ENGINE, "libime-pinyin", path.c_str(), conn.engines));
+    contexts.push_back(
+        std::format("/org/freedesktop/IBus/InputContext_{}", i + 1));
+  }
+
+  // Cycle focus through every engine, like alt-tab across windows
+  IBusEngine *current = nullptr;
+  size_t current_index = 0;
+  auto cycle = [&](size_t rounds) {
+    for (size_t r = 0; r < rounds; ++r) {
+      for (size_t i = 0; i < count; ++i) {
+        focusChange(current, contexts[current_index], engines[i],
+                    contexts[i]);
+        current = engines[i];
+        current_index = i;
+      }
+    }
+  };
+
+  // The first focus of each engine registers everything from scratch
+  cycle(1);
+  size_t before = settle(conn);
+
+  auto start = std::chrono::steady_clock::now();
+  cycle(rounds);
+  auto elapsed = std::chrono::duration<double, std::micro>(
+                     std::chrono::steady_clock::now() - start)
+                     .count();
+  size_t messages = settle(conn) - before;
+
+  size_t changes = rounds * count;
+  std::cout << std::format(
+      "{} focus changes across {} engines: {:.2f} us/change, "
+      "{:.0f} changes/s, {:.2f} D-Bus messages/change\n",
+      changes, count, elapsed / changes, changes * 1e6 / elapsed,
+      static_cast<double>(messages) / changes);
+
+  for (IBusEngine *engine : engines) {
+    ibus_object_destroy(IBUS_OBJECT(engine));
+    g_object_unref(engine);
+  }
+  g_object_unref(conn.engines);
+  g_object_unref(conn.peer);
+  return 0;
+}
+
+// Pinyin typed by the keys benchmark, each committed with space
+const char *const kKeyCorpus[] = {
+    "nihao",   "women",        "zhongguo", "jintiantianqibucuo",
+    "shurufa", "mingtianjian", "diannao",  "woxiangquchifan",
+    "ceshi",   "xiexie",       "ruanjian", "kaifa",
+};
+
+// Timings of the key currently in flight
+struct KeyProbe {
+  gint64 sent = 0;
+  gint64 replied = 0;
+  gint64 first_signal = 0; // First commit/preedit/lookup signal after sending
+  bool handled = false;
+  bool preedit_visible = false;
+};
+
+void noteSignal(KeyProbe *probe) {
+  if (probe->sent && !probe->first_signal) {
+    probe->first_signal = g_get_monotonic_time();
+  }
+}
+
+void connectProbe(IBusInputContext *ic, KeyProbe *probe) {
+  g_signal_connect(ic, "commit-text",
+                   G_CALLBACK(+[](IBusInputContext *, IBusText *,
+                                  gpointer user_data) {
+                     noteSignal(static_cast<KeyProbe *>(user_data));
+                   }),
+                   probe);
+  g_signal_connect(ic, "update-preedit-text",
+                   G_CALLBACK(+[](IBusInputContext *, IBusText *text, guint,
+                                  gboolean visible, gpointer user_data) {
+                     auto *probe = static_cast<KeyProbe *>(user_data);
+                     probe->preedit_visible =
+                         visible && ibus_text_get_length(text) > 0;
+                     noteSignal(probe);
+                   }),
+                   probe);
+  g_signal_connect(ic, "hide-preedit-text",
+                   G_CALLBACK(+[](IBusInputContext *, gpointer user_data) {
+                     auto *probe = static_cast<KeyProbe *>(user_data);
+                     probe->preedit_visible = false;
+                     noteSignal(probe);
+                   }),
+                   probe);
+  g_signal_connect(ic, "update-lookup-table",
+                   G_CALLBACK(+[](IBusInputContext *, IBusLookupTable *,
+                                  gboolean, gpointer user_data) {
+                     noteSignal(static_cast<KeyProbe *>(user_data));
+                   }),
+                   probe);
+}
+
+// Send one key event and wait for the daemon's reply. Signals the engine
+// emitted while handling the key arrive before the reply.
+bool sendKey(IBusInputContext *ic, KeyProbe &probe, guint keyval,
+             guint state) {
+  probe.sent = g_get_monotonic_time();
+  probe.replied = 0;
+  probe.first_signal = 0;
+  ibus_input_context_process_key_event_async(
+      ic, keyval, 0, state, 5000, nullptr,
+      [](GObject *source, GAsyncResult *result, gpointer user_data) {
+        auto *probe = static_cast<KeyProbe *>(user_data);
+        probe->handled = ibus_input_context_process_key_event_async_finish(
+            IBUS_INPUT_CONTEXT(source), result, nullptr);
+        probe->replied = g_get_monotonic_time();
+      },
+      &probe);
+  while (!probe.replied) {
+    g_main_context_iteration(nullptr, TRUE);
+  }
+  while (g_main_context_iteration(nullptr, FALSE)) {
+  }
+  return probe.handled;
+}
+
+struct LatencySamples {
+  std::vector<gint64> round_trip; // Key sent to reply received
+  std::vector<gint64> first_ui;   // Key sent to first UI signal
+};
+
+void typeKey(IBusInputContext *ic, KeyProbe &probe, guint keyval,
+             LatencySamples *samples) {
+  sendKey(ic, probe, keyval, 0);
+  if (samples) {
+    samples->round_trip.push_back(probe.replied - probe.sent);
+    if (probe.first_signal) {
+      samples->first_ui.push_back(probe.first_signal - probe.sent);
+    }
+  }
+  sendKey(ic, probe, keyval, IBUS_RELEASE_MASK);
+}
+
+void typeCorpus(IBusInputContext *ic, KeyProbe &probe,
+                LatencySamples *samples) {
+  for (const char *pinyin : kKeyCorpus) {
+    for (const char *c = pinyin; *c; ++c) {
+      typeKey(ic, probe, static_cast<guint>(*c), samples);
+    }
+    typeKey(ic, probe, IBUS_KEY_space, samples);
+    // The first candidate may only cover part of the input
+    for (int i = 0; i < 4 && probe.preedit_visible; ++i) {
+      typeKey(ic, probe, IBUS_KEY_space, samples);
+    }
+    if (probe.preedit_visible) {
+      typeKey(ic, probe, IBUS_KEY_Escape, nullptr);
+    }
+  }
+}
+
+void printDistribution(const char *name, std::vector<gint64> &samples) {
+  if (samples.empty()) {
+    std::cout << std::format("{:<12} no samples\n", name);
+    return;
+  }
+  std::sort(samples.begin(), samples.end());
+  auto at = [&samples](double q) {
+    return samples[std::min(samples.size() - 1,
+                            static_cast<size_t>(q * samples.size()))];
+  };
+  std::cout << std::format("{:<12} n={:<6} p50={}us p90={}us p99={}us "
+                           "max={}us\n",
+                           name, samples.size(), at(0.50), at(0.90), at(0.99),
+                           samples.back());
+}
+
+int keys(int argc, char *argv[]) {
+  size_t rounds = argc > 2 ? std::stoul(argv[2]) : 20;
+  gint64 max_p99 = argc > 3 ? std::stoll(argv[3]) : 0;
+
+  IBusBus *bus = ibus_bus_new();
+  if (!ibus_bus_is_connected(bus)) {
+    std::cerr << "Cannot connect to ibus-daemon (is IBUS_ADDRESS set?)\n";
+    return 1;
+  }
+
+  // Wait for the engine process to come up
+  for (int i = 0; !ibus_bus_name_has_owner(bus, "org.freedesktop.IBus.LibIME");
+       ++i) {
+    if (i == 100) {
+      std::cerr << "ibus-engine-libime did not register with the daemon\n";
+      return 1;
+    }
+    g_usleep(100 * 1000);
+  }
+
+  IBusInputContext *ic =
+      ibus_bus_create_input_context(bus, "ibus-libime-bench");
+  if (!ic) {
+    std::cerr << "Cannot create an input context\n";
+    return 1;
+  }
+  KeyProbe probe;
+  connectProbe(ic, &probe);
+  ibus_input_context_set_capabilities(
+      ic, IBUS_CAP_PREEDIT_TEXT | IBUS_CAP_AUXILIARY_TEXT |
+              IBUS_CAP_LOOKUP_TABLE | IBUS_CAP_FOCUS);
+  ibus_input_context_focus_in(ic);
+  ibus_input_context_set_engine(ic, "libime-pinyin");
+  for (int i = 0; !ibus_input_context_get_engine(ic); ++i) {
+    if (i == 100) {
+      std::cerr << "The daemon did not activate libime-pinyin\n";
+      return 1;
+    }
+    g_usleep(100 * 1000);
+  }
+
+  // Warm up caches and the user model before measuring
+  typeCorpus(ic, probe, nullptr);
+
+  LatencySamples samples;
+  for (size_t r = 0; r < rounds; ++r) {
+    typeCorpus(ic, probe, &samples);
+  }
+
+  printDistribution("round-trip", samples.round_trip);
+  printDistribution("first-ui", samples.first_ui);
+
+  ibus_proxy_destroy(IBUS_PROXY(ic));
+  g_object_unref(bus);
+
+  if (max_p99 > 0) {
+    gint64 p99 = samples.round_trip[std::min(
+        samples.round_trip.size() - 1,
+        static_cast<size_t>(0.99 * samples.round_trip.size()))];
+    if (p99 > max_p99) {
+      std::cerr << std::format("FAIL: p99 round trip {}us exceeds {}us\n", p99,
+                               max_p99);
+      return 2;
+    }
+  }
+  return 0;
+}
+
+// Allocations and time spent in letter key presses
+struct TypingTotals {
+  size_t keys = 0;
+  double micros = 0;
+  AllocSnapshot allocations;
+};
+
+void pressKey(IBusEngine *engine, guint keyval, TypingTotals *totals) {
+  auto *klass = IBUS_ENGINE_GET_CLASS(engine);
+  AllocSnapshot before = AllocStats::snapshot();
+  auto start = std::chrono::steady_clock::now();
+  klass->process_key_event(engine, keyval, 0, 0);
+  auto elapsed = std::chrono::duration<double, std::micro>(
+                     std::chrono::steady_clock::now() - start)
+                     .count();
+  AllocSnapshot after = AllocStats::snapshot();
+  klass->process_key_event(engine, keyval, 0, IBUS_RELEASE_MASK);
+
+  if (totals) {
+    totals->keys++;
+    totals->micros += elapsed;
+    totals->allocations.count += after.count - before.count;
+    totals->allocations.bytes += after.bytes - before.bytes;
+    totals->allocations.library_count +=
+        after.library_count - before.library_count;
+    totals->allocations.library_bytes +=
+        after.library_bytes - before.library_bytes;
+  }
+}
+
+void typeCorpus(IBusEngine *engine, TypingTotals *totals) {
+  for (const char *pinyin : kKeyCorpus) {
+    for (const char *c = pinyin; *c; ++c) {
+      pressKey(engine, static_cast<guint>(*c), totals);
+    }
+    // Commit everything typed so the next word starts from an empty context
+    for (int i = 0; i < 5; ++i) {
+      pressKey(engine, IBUS_KEY_space, nullptr);
+    }
+    pressKey(engine, IBUS_KEY_Escape, nullptr);
+  }
+}
+
+int typing(int argc, char *argv[]) {
+  size_t rounds = argc > 2 ? std::stoul(argv[2]) : 20;
+  if (rounds == 0) {
+    return 1;
+  }
+
+  PeerConnection conn;
+  if (!connectPeer(conn)) {
+    return 1;
+  }
+  PinyinEngine::initializeSharedIME();
+
+  IBusEngine *engine = ibus_engine_new_with_type(
+      IBUS_TYPE_LIBIME_ENGINE, "libime-pinyin",
+      "/org/freedesktop/IBus/Engine/1", conn.engines);
+  IBUS_ENGINE_GET_CLASS(engine)->focus_in_id(
+      engine, "/org/freedesktop/IBus/InputContext_1", "bench");
+
+  // Warm up caches and the user model before measuring
+  typeCorpus(engine, nullptr);
+
+  TypingTotals totals;
+  for (size_t r = 0; r < rounds; ++r) {
+    typeCorpus(engine, &totals);
+  }
+
+  double keys = static_cast<double>(totals.keys);
+  std::cout << std::format("{} letter keys: {:.2f} us/key\n", totals.keys,
+                           totals.micros / keys);
+
+  int status = 0;
+  if constexpr (AllocStats::kEnabled) {
+    const AllocSnapshot &a = totals.allocations;
+    double frontend = (a.count - a.library_count) / keys;
+    std::cout << std::format(
+        "allocations per key: front end {:.2f} ({:.0f} bytes), "
+        "libime {:.2f} ({:.0f} bytes)\n",
+        frontend, (a.bytes - a.library_bytes) / keys, a.library_count / keys,
+        a.library_bytes / keys);
+    if (frontend > AllocStats::kKeystrokeBudget) {
+      std::cerr << std::format(
+          "FAIL: {:.2f} front-end allocations per key exceeds {}\n", frontend,
+          AllocStats::kKeystrokeBudget);
+      status = 2;
+    }
+  } else {
+    std::cout << "allocation counts need -DENABLE_ALLOC_PROFILING=ON\n";
+  }
+
+  ibus_object_destroy(IBUS_OBJECT(engine));
+  g_object_unref(engine);
+  settle(conn);
+  g_object_unref(conn.engines);
+  g_object_unref(conn.peer);
+  return status;
+}
+
+// Keyvals of one corpus line: characters are typed as they are and <Name>
+// is an IBus key name. Empty for blank and comment lines.
+std::vector<guint> parseSession(const std::string &line) {
+  std::vector<guint> keys;
+  if (line.empty() || line[0] == '#') {
+    return keys;
+  }
+  for (size_t i = 0; i < line.size(); ++i) {
+    size_t close = line[i] == '<' ? line.find('>', i) : std::string::npos;
+    if (close == std::string::npos || close == i + 1) {
+      keys.push_back(static_cast<unsigned char>(line[i]));
+      continue;
+    }
+    std::string name = line.substr(i + 1, close - i - 1);
+    guint keyval = ibus_keyval_from_name(name.c_str());
+    if (keyval == IBUS_KEY_VoidSymbol) {
+      std::cerr << std::format("Unknown key <{}>\n", name);
+    } else {
+      keys.push_back(keyval);
+    }
+    i = close;
+  }
+  keys.push_back(IBUS_KEY_Escape);
+  return keys;
+}
+
+int replay(int argc, char *argv[]) {
+  if (argc < 3) {
+    return usage(argv[0]);
+  }
+  size_t rounds = argc > 3 ? std::stoul(argv[3]) : 20;
+  if (rounds == 0) {
+    return 1;
+  }
+
+  std::ifstream in(argv[2]);
+  if (!in) {
+    std::cerr << std::format("Cannot open {}\n", argv[2]);
+    return 1;
+  }
+  std::vector<std::vector<guint>> sessions;
+  std::string line;
+  while (std::getline(in, line)) {
+    auto keys = parseSession(line);
+    if (!keys.empty()) {
+      sessions.push_back(std::move(keys));
+    }
+  }
+
+  PeerConnection conn;
+  if (!connectPeer(conn)) {
+    return 1;
+  }
+  PinyinEngine::initializeSharedIME();
+
+  IBusEngine *engine = ibus_engine_new_with_type(
+      IBUS_TYPE_LIBIME_ENGINE, "libime-pinyin",
+      "/org/freedesktop/IBus/Engine/1", conn.engines);
+  auto *klass = IBUS_ENGINE_GET_CLASS(engine);
+  klass->focus_in_id(engine, "/org/freedesktop/IBus/InputContext_1",
+                     "bench");
+
+  // The first round warms up caches and the user model
+  std::vector<gint64> samples;
+  double total = 0;
+  for (size_t r = 0; r <= rounds; ++r) {
+    for (const auto &keys : sessions) {
+      for (guint keyval : keys) {
+        auto start = std::chrono::steady_clock::now();
+        klass->process_key_event(engine, keyval, 0, 0);
+        auto elapsed = std::chrono::duration<double, std::micro>(
+                           std::chrono::steady_clock::now() - start)
+                           .count();
+        klass->process_key_event(engine, keyval, 0, IBUS_RELEASE_MASK);
+        if (r > 0) {
+          samples.push_back(static_cast<gint64>(elapsed));
+          total += elapsed;
+        }
+      }
+      // Deferred work (learning, hiding hints) runs between sessions, as it
+      // would between bursts of typing
+      while (g_main_context_iteration(nullptr, FALSE)) {
+      }
+    }
+    settle(conn);
+  }
+
+  std::cout << std::format("{} sessions, {} key presses: {:.2f} us/key\n",
+                           sessions.size(), samples.size(),
+                           total / static_cast<double>(samples.size()));
+  printDistribution("key press", samples);
+
+  ibus_object_destroy(IBUS_OBJECT(engine));
+  g_object_unref(engine);
+  settle(conn);
+  g_object_unref(conn.engines);
+  g_object_unref(conn.peer);
+  return 0;
+}
+
+} // namespace
+
+// Resident memory of a process, 0 if unknown
+size_t residentBytes(pid_t pid) {
+  std::ifstream statm(std::format("/proc/{}/statm", pid));
+  size_t size = 0, resident = 0;
+  statm >> size >> resident;
+  return resident * sysconf(_SC_PAGESIZE);
+}
+
+// Process id of the service listening at path, 0 if unknown
+pid_t servicePid(const std::string &path) {
+  sockaddr_un addr{};
+  addr.sun_family = AF_UNIX;
+  path.copy(addr.sun_path, sizeof(addr.sun_path) - 1);
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  ucred cred{};
+  socklen_t length = sizeof(cred);
+  if (connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0 ||
+      getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &length) < 0) {
+    cred.pid = 0;
+  }
+  close(fd);
+  return cred.pid;
+}
+
+int service(int argc, char *argv[]) {
+  size_t count = argc > 2 ? std::stoul(argv[2]) : 50;
+  size_t rounds = argc > 3 ? std::stoul(argv[3]) : 5;
+  if (count == 0 || rounds == 0) {
+    return 1;
+  }
+  const std::string &path = Config::getInstance().getDecodeServiceSocket();
+  const PinyinProfile &profile = Config::getInstance().getPinyinProfile("");
+  uint32_t limit = RemotePinyinEngine::candidateLimit(profile);
+
+  std::vector<std::unique_ptr<DecodeClient>> sessions;
+  for (size_t i = 0; i < count; ++i) {
+    auto client = std::make_unique<DecodeClient>();
+    if (!client->connect(path, limit)) {
+      std::cerr << std::format("Cannot open session {} at {}\n", i, path);
+      return 1;
+    }
+    sessions.push_back(std::move(client));
+  }
+
+  // Every session types the same word a key at a time, in turn, then takes
+  // first candidates until the word is committed; nothing is learned. Round
+  // 0 warms up and is not measured.
+  std::vector<gint64> remote;
+  DecodeState state;
+  for (size_t r = 0; r <= rounds; ++r) {
+    for (const char *pinyin : kKeyCorpus) {
+      for (const char *c = pinyin; *c; ++c) {
+        for (auto &session : sessions) {
+          gint64 start = g_get_monotonic_time();
+          if (!session->type(std::string_view(c, 1), state)) {
+            std::cerr << "The decode service went away\n";
+            return 1;
+          }
+          if (r > 0) {
+            remote.push_back(g_get_monotonic_time() - start);
+          }
+        }
+      }
+      for (auto &session : sessions) {
+        do {
+          session->request(DecodeOp::Select, {0, 0}, state);
+        } while (!state.selected && !state.candidates.empty());
+        session->request(DecodeOp::Clear, {}, state);
+      }
+    }
+  }
+
+  // The same keys decoded in this process, as an engine without the
+  // service does
+  size_t before = residentBytes(getpid());
+  PinyinEngine::initializeSharedIME();
+  size_t ime_bytes = residentBytes(getpid()) - before;
+  libime::PinyinContext context(PinyinEngine::sharedIME());
+  std::vector<gint64> local;
+  for (size_t r = 0; r <= rounds; ++r) {
+    for (const char *pinyin : kKeyCorpus) {
+      for (const char *c = pinyin; *c; ++c) {
+        gint64 start = g_get_monotonic_time();
+        context.type(std::string_view(c, 1));
+        // Candidates are copied out, as the service does for its reply
+        for (size_t i = 0; i < std::min<size_t>(context.candidates().size(),
+                                                limit);
+             ++i) {
+          state.candidates.push_back(context.candidates()[i].toString());
+        }
+        if (r > 0) {
+          local.push_back(g_get_monotonic_time() - start);
+        }
+        state.candidates.clear();
+      }
+      context.clear();
+    }
+  }
+
+  printDistribution("local", local);
+  printDistribution("remote", remote);
+  size_t service_bytes = 0;
+  if (pid_t pid = servicePid(path)) {
+    service_bytes = residentBytes(pid);
+  }
+  std::cout << std::format(
+      "memory: IME {:.1f} MB per engine process, {:.1f} MB for {} "
+      "sessions; service resident {:.1f} MB\n",
+      ime_bytes / 1e6, ime_bytes * count / 1e6, count, service_bytes / 1e6);
+  return 0;
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 2) {
+    return usage(argv[0]);
+  }
+  ibus_init();
+
+  std::string command = argv[1];
+  if (command == "focus") {
+    return focus(argc, argv);
+  }
+  if (command == "keys") {
+    return keys(argc, argv);
+  }
+  if (command == "typing") {
+    return typing(argc, argv);
+  }
+  if (command == "replay") {
+    return replay(argc, argv);
+  }
+  if (command == "service") {
+    return service(argc, argv);
+  }
+  return usage(argv[0]);
+}
@@ -0,0 +1,231 @@
+// Build and query the English word list used to detect English typed in
+// Chinese mode, and the completion table used in English mode.
+//
+// Usage:
+//   ibus-libime-english build <out.dat> <words.txt>...
+//   ibus-libime-english check <english.dat> [word]...
+//   ibus-libime-english completions <out.dat> <words.txt>...
+//   ibus-libime-english complete <completion.dat> [prefix]...
+//
+// Word lists have one word per line, optionally followed by a tab and its
+// frequency. Words are stored lowercased; words with anything but ASCII
+// letters, apostrophes and hyphens are skipped. When a word appears more than
+// once the frequencies are added up.
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "english_completer.h"
+#include "english_detector.h"
+#include "mapped_trie.h"
+
+namespace {
+
+int usage(const char *argv0) {
+  std::cerr << std::format("Usage:\n"
+                           "  {0} build <out.dat> <words.txt>...\n"
+                           "  {0} check <english.dat> [word]...\n"
+                           "  {0} completions <out.dat> <words.txt>...\n"
+                           "  {0} complete <completion.dat> [prefix]...\n",
+                           argv0);
+  return 1;
+}
+
+bool normalize(std::string &word) {
+  for (char &c : word) {
+    if (c >= 'A' && c <= 'Z') {
+      c = static_cast<char>(c - 'A' + 'a');
+    } else if (!(c >= 'a' && c <= 'z') && c != '\'' && c != '-') {
+      return false;
+    }
+  }
+  return !word.empty();
+}
+
+bool readWords(int argc, char *argv[],
+               std::map<std::string, uint64_t> &frequencies) {
+  for (int i = 3; i < argc; ++i) {
+    std::ifstream in(argv[i]);
+    if (!in) {
+      std::cerr << std::format("Cannot open {}\n", argv[i]);
+      return false;
+    }
+    size_t added = 0;
+    std::string line;
+    while (std::getline(in, line)) {
+      if (line.empty() || line[0] == '#') {
+        continue;
+      }
+      size_t tab = line.find('\t');
+      std::string word = line.substr(0, tab);
+      uint64_t frequency = 1;
+      if (tab != std::string::npos) {
+        frequency = std::strtoull(line.c_str() + tab + 1, nullptr, 10);
+      }
+      if (normalize(word)) {
+        frequencies[word] += frequency;
+        ++added;
+      }
+    }
+    std::cout << std::format("{}: {} words\n", argv[i], added);
+  }
+  return true;
+}
+
+int build(int argc, char *argv[]) {
+  std::map<std::string, uint64_t> frequencies;
+  if (!readWords(argc, argv, frequencies)) {
+    return 1;
+  }
+
+  TrieBuilder builder;
+  for (const auto &[word, frequency] : frequencies) {
+    uint32_t value =
+        static_cast<uint32_t>(std::min<uint64_t>(frequency, UINT32_MAX));
+    builder.insert(word, std::string_view(
+                             reinterpret_cast<const char *>(&value),
+                             sizeof(value)));
+  }
+  if (!builder.write(argv[2], EnglishDetector::kMagic)) {
+    std::cerr << std::format("Failed to write {}\n", argv[2]);
+    return 1;
+  }
+  std::cout << std::format("Wrote {} words to {}\n", builder.size(), argv[2]);
+  return 0;
+}
+
+int buildCompletions(int argc, char *argv[]) {
+  std::map<std::string, uint64_t> frequencies;
+  if (!readWords(argc, argv, frequencies)) {
+    return 1;
+  }
+
+  // Most frequent first, so every prefix keeps its best words
+  std::vector<std::pair<uint64_t, std::string>> ranked;
+  for (auto &[word, frequency] : frequencies) {
+    ranked.emplace_back(frequency, word);
+  }
+  std::stable_sort(
+      ranked.begin(), ranked.end(),
+      [](const auto &a, const auto &b) { return a.first > b.first; });
+
+  std::map<std::string, std::string> completions;
+  std::map<std::string, size_t> counts;
+  for (const auto &[frequency, word] : ranked) {
+    for (size_t n = EnglishCompleter::kMinPrefix; n < word.size(); ++n) {
+      std::string prefix = word.substr(0, n);
+      size_t &count = counts[prefix];
+      if (count == EnglishCompleter::kMaxCompletions) {
+        continue;
+      }
+      std::string &list = completions[prefix];
+      if (count++) {
+        list.push_back('\0');
+      }
+      list += word;
+    }
+  }
+
+  TrieBuilder builder;
+  for (const auto &[prefix, list] : completions) {
+    builder.insert(prefix, list);
+  }
+  if (!builder.write(argv[2], EnglishCompleter::kMagic)) {
+    std::cerr << std::format("Failed to write {}\n", argv[2]);
+    return 1;
+  }
+  std::cout << std::format("Wrote completions of {} prefixes to {}\n",
+                           builder.size(), argv[2]);
+  return 0;
+}
+
+void complete(const MappedTrie &trie, const std::string &prefix) {
+  uint32_t node = trie.find(prefix);
+  std::string_view words = node != MappedTrie::kInvalid && trie.hasValue(node)
+                               ? trie.value(node)
+                               : std::string_view();
+  std::cout << prefix << ":";
+  while (!words.empty()) {
+    std::cout << " " << EnglishCompleter::nextWord(words);
+  }
+  std::cout << "\n";
+}
+
+void check(const MappedTrie &trie, const std::string &word) {
+  std::string lower = word;
+  bool valid = normalize(lower);
+  uint32_t node = valid ? trie.find(lower) : MappedTrie::kInvalid;
+  uint32_t frequency = 0;
+  if (node != MappedTrie::kInvalid && trie.hasValue(node) &&
+      trie.value(node).size() == sizeof(frequency)) {
+    std::memcpy(&frequency, trie.value(node).data(), sizeof(frequency));
+  }
+  std::cout << std::format(
+      "{}: {} (frequency {}), pinyin: {}\n", word,
+      frequency ? "word" : "not a word", frequency,
+      EnglishDetector::isFullPinyin(word)  ? "full"
+      : EnglishDetector::canBePinyin(word) ? "partial"
+                                           : "no");
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  if (argc < 3) {
+    return usage(argv[0]);
+  }
+
+  std::string command = argv[1];
+  if (command == "build") {
+    return argc < 4 ? usage(argv[0]) : build(argc, argv);
+  }
+  if (command == "completions") {
+    return argc < 4 ? usage(argv[0]) : buildCompletions(argc, argv);
+  }
+  if (command == "complete") {
+    MappedTrie trie;
+    if (!trie.open(argv[2], EnglishCompleter::kMagic)) {
+      std::cerr << std::format("{} is not a completion table\n", argv[2]);
+      return 1;
+    }
+    if (argc > 3) {
+      for (int i = 3; i < argc; ++i) {
+        complete(trie, argv[i]);
+      }
+      return 0;
+    }
+    std::string line;
+    while (std::getline(std::cin, line)) {
+      complete(trie, line);
+    }
+    return 0;
+  }
+  if (command != "check") {
+    return usage(argv[0]);
+  }
+
+  MappedTrie trie;
+  if (!trie.open(argv[2], EnglishDetector::kMagic)) {
+    std::cerr << std::format("{} is not an English word list\n", argv[2]);
+    return 1;
+  }
+  if (argc > 3) {
+    for (int i = 3; i < argc; ++i) {
+      check(trie, argv[i]);
+    }
+    return 0;
+  }
+  std::string line;
+  while (std::getline(std::cin, line)) {
+    check(trie, line);
+  }
+  return 0;
+}
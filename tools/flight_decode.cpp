@@ -0,0 +1,195 @@
+// Convert an ibus-libime flight recorder dump into a readable timeline.
+//
+// Usage: ibus-libime-flight-decode <flight-PID.bin>
+
+#include <algorithm>
+#include <cstring>
+#include <ctime>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "flight_recorder.h"
+
+namespace {
+
+const char *eventName(uint32_t type) {
+  switch (static_cast<FlightEvent>(type)) {
+  case FlightEvent::KeyEvent:
+    return "KEY";
+  case FlightEvent::Decode:
+    return "DECODE";
+  case FlightEvent::UiUpdate:
+    return "UI";
+  case FlightEvent::FocusIn:
+    return "FOCUS_IN";
+  case FlightEvent::FocusOut:
+    return "FOCUS_OUT";
+  case FlightEvent::Commit:
+    return "COMMIT";
+  case FlightEvent::Reset:
+    return "RESET";
+  case FlightEvent::SlowKey:
+    return "SLOW_KEY";
+  }
+  return "UNKNOWN";
+}
+
+const char *reasonName(uint32_t reason) {
+  switch (static_cast<FlightDumpReason>(reason)) {
+  case FlightDumpReason::Signal:
+    return "SIGUSR1";
+  case FlightDumpReason::SlowKey:
+    return "slow keystroke";
+  case FlightDumpReason::Crash:
+    return "crash";
+  }
+  return "unknown";
+}
+
+const char *keyClassName(uint32_t key_class) {
+  switch (static_cast<FlightKeyClass>(key_class)) {
+  case FlightKeyClass::Letter:
+    return "letter";
+  case FlightKeyClass::Digit:
+    return "digit";
+  case FlightKeyClass::Punctuation:
+    return "punctuation";
+  case FlightKeyClass::Space:
+    return "space";
+  case FlightKeyClass::Control:
+    return "control";
+  case FlightKeyClass::Modifier:
+    return "modifier";
+  }
+  return "unknown";
+}
+
+std::string keyvalName(uint32_t keyval) {
+  switch (keyval) {
+  case 0:
+    return "";
+  case 0xff08:
+    return "BackSpace";
+  case 0xff09:
+    return "Tab";
+  case 0xff0d:
+    return "Return";
+  case 0xff1b:
+    return "Escape";
+  case 0xff50:
+    return "Home";
+  case 0xff51:
+    return "Left";
+  case 0xff52:
+    return "Up";
+  case 0xff53:
+    return "Right";
+  case 0xff54:
+    return "Down";
+  case 0xff55:
+    return "Page_Up";
+  case 0xff56:
+    return "Page_Down";
+  case 0xff57:
+    return "End";
+  case 0xff8d:
+    return "KP_Enter";
+  case 0xffe1:
+    return "Shift_L";
+  case 0xffe2:
+    return "Shift_R";
+  case 0xffe3:
+    return "Control_L";
+  case 0xffe4:
+    return "Control_R";
+  case 0xffff:
+    return "Delete";
+  default:
+    return std::format("0x{:x}", keyval);
+  }
+}
+
+std::string describe(const FlightRecord &record) {
+  switch (static_cast<FlightEvent>(record.type)) {
+  case FlightEvent::KeyEvent:
+    return std::format("{} {}{} {}{} us", keyClassName(record.a),
+                       keyvalName(record.b),
+                       record.flags & FlightFlagRelease ? " release" : "",
+                       record.flags & FlightFlagHandled ? "handled "
+                                                        : "passed ",
+                       record.c);
+  case FlightEvent::Decode:
+    return std::format("input={}B candidates={} {} us", record.a, record.b,
+                       record.c);
+  case FlightEvent::UiUpdate:
+    return std::format("candidates={} {} us", record.a, record.c);
+  case FlightEvent::Commit:
+    return std::format("length={}B", record.a);
+  case FlightEvent::SlowKey:
+    return std::format("{} us", record.c);
+  default:
+    return "";
+  }
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  if (argc != 2) {
+    std::cerr << std::format("Usage: {} <flight-dump.bin>\n", argv[0]);
+    return 1;
+  }
+
+  std::ifstream in(argv[1], std::ios::binary);
+  if (!in) {
+    std::cerr << std::format("Cannot open {}\n", argv[1]);
+    return 1;
+  }
+
+  FlightDumpHeader header;
+  if (!in.read(reinterpret_cast<char *>(&header), sizeof(header)) ||
+      memcmp(header.magic, "IBLFREC1", sizeof(header.magic)) != 0 ||
+      header.record_size != sizeof(FlightRecord) || header.capacity == 0 ||
+      header.capacity > kMaxFlightRecords) {
+    std::cerr << std::format("{} is not a flight recorder dump\n", argv[1]);
+    return 1;
+  }
+
+  std::vector<FlightRecord> records(header.capacity);
+  if (!in.read(reinterpret_cast<char *>(records.data()),
+               sizeof(FlightRecord) * records.size())) {
+    std::cerr << "Truncated dump\n";
+    return 1;
+  }
+
+  time_t dump_time = static_cast<time_t>(header.realtime_us / 1000000);
+  char time_buf[64];
+  strftime(time_buf, sizeof(time_buf), "%Y-%m-%d %H:%M:%S",
+           localtime(&dump_time));
+  std::cout << std::format("pid {} dumped at {} ({}), {} of {} events "
+                           "retained\n",
+                           header.pid, time_buf, reasonName(header.reason),
+                           std::min<uint64_t>(header.head, header.capacity),
+                           header.head);
+  std::cout << "time relative to dump (ms), event, details\n";
+
+  // Oldest retained record first
+  uint64_t first =
+      header.head > header.capacity ? header.head - header.capacity : 0;
+  for (uint64_t i = first; i < header.head; ++i) {
+    const FlightRecord &record = records[i % header.capacity];
+    if (record.type == 0) {
+      continue; // Slot was being written or never used
+    }
+    double offset_ms =
+        (static_cast<double>(record.timestamp_us) -
+         static_cast<double>(header.monotonic_us)) /
+        1000.0;
+    std::cout << std::format("{:>12.3f}  {:<10} {}\n", offset_ms,
+                             eventName(record.type), describe(record));
+  }
+  return 0;
+}
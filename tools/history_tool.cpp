@@ -0,0 +1,474 @@
+// Pretrain the user history from a local text corpus, so a new user's
+// candidates are ranked by their own writing from the first day.
+//
+// Usage:
+//   ibus-libime-history train [-j threads] [-m max-size] <out.history>
+//                             <corpus>...
+//   ibus-libime-history dump <user.history>
+//
+// The corpus is UTF-8 text, such as the user's own documents or a team
+// glossary. Every run of Chinese characters is a sentence; it is segmented
+// into words by the highest-scoring path through the dictionary words (the
+// system dictionary plus the [general] dictionaries and userdict the engine
+// loads) and added to the history as if the user had typed it.
+//
+// Corpora are memory-mapped and cut into line-aligned chunks that worker
+// threads segment in parallel; the history itself is then trained in corpus
+// order. -m caps the size of the snapshot (with an optional K or M suffix):
+// the history favours what was added last, so the end of the corpus is kept
+// and the oldest sentences are dropped until the snapshot fits.
+//
+// The engine loads the snapshot from [general] userhistory
+// (~/.local/share/ibus-libime/user.history by default) at startup.
+
+#include <libime/core/historybigram.h>
+#include <libime/pinyin/pinyindictionary.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "configs.h"
+#include "mapped_file.h"
+#include "pinyin_engine.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Chunks per thread, so uneven chunks still balance out
+constexpr size_t kChunksPerThread = 8;
+// Longest dictionary word tried while segmenting, in characters
+constexpr size_t kMaxWordChars = 8;
+// Score (log10 probability) of a character no dictionary word covers
+constexpr float kUnknownCost = -10;
+
+int usage(const char *argv0) {
+  std::cerr << std::format(
+      "Usage:\n"
+      "  {0} train [-j threads] [-m max-size] <out.history> <corpus>...\n"
+      "  {0} dump <user.history>\n",
+      argv0);
+  return 1;
+}
+
+double secondsSince(Clock::time_point start) {
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// Length of the UTF-8 sequence starting with lead
+size_t utf8Length(unsigned char lead) {
+  if (lead < 0x80) {
+    return 1;
+  }
+  if ((lead >> 5) == 0x6) {
+    return 2;
+  }
+  if ((lead >> 4) == 0xE) {
+    return 3;
+  }
+  if ((lead >> 3) == 0x1E) {
+    return 4;
+  }
+  return 1;
+}
+
+// Whether the UTF-8 character is a CJK ideograph
+bool isHan(std::string_view c) {
+  uint32_t code;
+  if (c.size() == 3) {
+    code = (c[0] & 0x0F) << 12 | (c[1] & 0x3F) << 6 | (c[2] & 0x3F);
+  } else if (c.size() == 4) {
+    code = (c[0] & 0x07) << 18 | (c[1] & 0x3F) << 12 | (c[2] & 0x3F) << 6 |
+           (c[3] & 0x3F);
+  } else {
+    return false;
+  }
+  return (code >= 0x3400 && code <= 0x4DBF) ||
+         (code >= 0x4E00 && code <= 0x9FFF) ||
+         (code >= 0xF900 && code <= 0xFAFF) ||
+         (code >= 0x20000 && code <= 0x3134F);
+}
+
+// Unigram segmenter over the dictionary words
+class Segmenter {
+public:
+  // Read every word of a binary pinyin dictionary, keeping its best score
+  bool load(const std::string &path) {
+    std::stringstream text;
+    try {
+      libime::PinyinDictionary dict;
+      dict.load(libime::PinyinDictionary::SystemDict, path.c_str(),
+                libime::PinyinDictFormat::Binary);
+      dict.save(libime::PinyinDictionary::SystemDict, text,
+                libime::PinyinDictFormat::Text);
+    } catch (const std::exception &e) {
+      std::cerr << std::format("Failed to load {}: {}\n", path, e.what());
+      return false;
+    }
+    std::string line;
+    while (std::getline(text, line)) {
+      std::istringstream fields(line);
+      std::string word, pinyin;
+      float cost;
+      if (fields >> word >> pinyin >> cost) {
+        auto [it, inserted] = words_.try_emplace(std::move(word), cost);
+        it->second = std::max(it->second, cost);
+      }
+    }
+    return true;
+  }
+
+  size_t size() const { return words_.size(); }
+
+  // Append the words of sentence to out, separated by spaces. offsets holds
+  // the byte offset of every character and the end of the sentence.
+  void segment(std::string_view sentence, const std::vector<size_t> &offsets,
+               std::string &out, std::vector<float> &best,
+               std::vector<size_t> &back) const {
+    size_t chars = offsets.size() - 1;
+    best.assign(chars + 1, -std::numeric_limits<float>::infinity());
+    back.assign(chars + 1, 0);
+    best[0] = 0;
+    for (size_t i = 0; i < chars; ++i) {
+      for (size_t len = 1; len <= kMaxWordChars && i + len <= chars; ++len) {
+        std::string_view word =
+            sentence.substr(offsets[i], offsets[i + len] - offsets[i]);
+        auto it = words_.find(word);
+        if (it == words_.end() && len > 1) {
+          continue;
+        }
+        float score =
+            best[i] + (it == words_.end() ? kUnknownCost : it->second);
+        if (score > best[i + len]) {
+          best[i + len] = score;
+          back[i + len] = i;
+        }
+      }
+    }
+    // Words come out last first; reverse them in place afterwards
+    size_t start = out.size();
+    for (size_t end = chars; end > 0; end = back[end]) {
+      std::string_view word = sentence.substr(
+          offsets[back[end]], offsets[end] - offsets[back[end]]);
+      out.append(word.rbegin(), word.rend());
+      out.push_back(' ');
+    }
+    out.pop_back();
+    std::reverse(out.begin() + start, out.end());
+    out.push_back('\n');
+  }
+
+private:
+  struct Hash {
+    using is_transparent = void;
+    size_t operator()(std::string_view s) const {
+      return std::hash<std::string_view>()(s);
+    }
+  };
+  std::unordered_map<std::string, float, Hash, std::equal_to<>> words_;
+};
+
+struct Chunk {
+  const MappedFile *file;
+  size_t begin;
+  size_t end;
+};
+
+// Segmented sentences of one chunk, one per line with space-separated
+// words, in corpus order
+struct ChunkResult {
+  std::string sentences;
+  size_t chars = 0;
+  size_t han = 0;
+};
+
+std::vector<Chunk> splitChunks(const std::vector<MappedFile> &files,
+                               size_t threads) {
+  size_t total = 0;
+  for (const auto &file : files) {
+    total += file.size();
+  }
+  size_t target = std::max<size_t>(total / (threads * kChunksPerThread), 1);
+
+  std::vector<Chunk> chunks;
+  for (const auto &file : files) {
+    const char *data = file.data();
+    size_t size = file.size();
+    size_t begin = 0;
+    while (begin < size) {
+      size_t end = std::min(begin + target, size);
+      const void *newline = end < size
+                                ? std::memchr(data + end, '\n', size - end)
+                                : nullptr;
+      end = newline ? static_cast<const char *>(newline) - data + 1 : size;
+      chunks.push_back({&file, begin, end});
+      begin = end;
+    }
+  }
+  return chunks;
+}
+
+void segmentChunk(const Segmenter &segmenter, const Chunk &chunk,
+                  ChunkResult &result, std::atomic<size_t> &processed) {
+  std::string_view text(chunk.file->data() + chunk.begin,
+                        chunk.end - chunk.begin);
+  std::vector<size_t> offsets;
+  std::vector<float> best;
+  std::vector<size_t> back;
+  size_t sentence_begin = 0;
+  auto flush = [&](size_t end) {
+    if (!offsets.empty()) {
+      offsets.push_back(end);
+      std::string_view sentence =
+          text.substr(sentence_begin, end - sentence_begin);
+      for (size_t &offset : offsets) {
+        offset -= sentence_begin;
+      }
+      segmenter.segment(sentence, offsets, result.sentences, best, back);
+      offsets.clear();
+    }
+  };
+  for (size_t pos = 0; pos < text.size();) {
+    size_t len = std::min(utf8Length(text[pos]), text.size() - pos);
+    ++result.chars;
+    if (isHan(text.substr(pos, len))) {
+      if (offsets.empty()) {
+        sentence_begin = pos;
+      }
+      offsets.push_back(pos);
+      ++result.han;
+    } else {
+      flush(pos);
+    }
+    pos += len;
+  }
+  flush(text.size());
+  processed.fetch_add(chunk.end - chunk.begin, std::memory_order_relaxed);
+}
+
+// Train a fresh history on the sentences from first on
+void train(libime::HistoryBigram &history,
+           const std::vector<std::string_view> &sentences, size_t first) {
+  history.clear();
+  std::vector<std::string> words;
+  for (size_t i = first; i < sentences.size(); ++i) {
+    words.clear();
+    std::string_view sentence = sentences[i];
+    while (!sentence.empty()) {
+      size_t space = sentence.find(' ');
+      words.emplace_back(sentence.substr(0, space));
+      sentence = space == std::string_view::npos ? std::string_view()
+                                                 : sentence.substr(space + 1);
+    }
+    history.add(words);
+  }
+}
+
+size_t snapshotSize(libime::HistoryBigram &history) {
+  std::ostringstream out;
+  history.save(out);
+  return out.str().size();
+}
+
+// Parse a size such as 4096, 512K or 2M
+size_t parseSize(const std::string &text) {
+  size_t end = 0;
+  size_t size = std::stoul(text, &end);
+  if (end < text.size()) {
+    char unit = text[end];
+    if (unit == 'K' || unit == 'k') {
+      size *= 1024;
+    } else if (unit == 'M' || unit == 'm') {
+      size *= 1024 * 1024;
+    }
+  }
+  return size;
+}
+
+int trainCommand(int argc, char *argv[]) {
+  size_t threads = std::max(1u, std::thread::hardware_concurrency());
+  size_t max_size = 0;
+  int arg = 2;
+  while (arg + 1 < argc && argv[arg][0] == '-') {
+    if (std::strcmp(argv[arg], "-j") == 0) {
+      threads = std::max(1ul, std::stoul(argv[arg + 1]));
+    } else if (std::strcmp(argv[arg], "-m") == 0) {
+      max_size = parseSize(argv[arg + 1]);
+    } else {
+      return usage(argv[0]);
+    }
+    arg += 2;
+  }
+  if (argc - arg < 2) {
+    return usage(argv[0]);
+  }
+  std::string output = argv[arg++];
+
+  // The same dictionaries the engine decodes with
+  auto start = Clock::now();
+  Segmenter segmenter;
+  const auto &config = Config::getInstance();
+  if (!segmenter.load(PinyinEngine::getDataPath("sc.dict"))) {
+    return 1;
+  }
+  for (const auto &path : config.getDictionaryPaths()) {
+    segmenter.load(path);
+  }
+  std::error_code ec;
+  if (std::filesystem::exists(config.getUserDictPath(), ec)) {
+    segmenter.load(config.getUserDictPath());
+  }
+  std::cout << std::format("Loaded {} words in {:.2f}s\n", segmenter.size(),
+                           secondsSince(start));
+
+  std::vector<MappedFile> files(argc - arg);
+  size_t total_bytes = 0;
+  for (size_t i = 0; i < files.size(); ++i) {
+    if (!files[i].open(argv[arg + i])) {
+      std::cerr << std::format("Cannot open {}\n", argv[arg + i]);
+      return 1;
+    }
+    total_bytes += files[i].size();
+  }
+
+  // Segment: workers take chunks until none are left
+  start = Clock::now();
+  std::vector<Chunk> chunks = splitChunks(files, threads);
+  std::vector<ChunkResult> results(chunks.size());
+  std::atomic<size_t> next_chunk{0};
+  std::atomic<size_t> processed{0};
+  std::atomic<size_t> running{threads};
+  std::vector<std::thread> workers;
+  for (size_t t = 0; t < threads; ++t) {
+    workers.emplace_back([&]() {
+      for (size_t i; (i = next_chunk.fetch_add(1)) < chunks.size();) {
+        segmentChunk(segmenter, chunks[i], results[i], processed);
+      }
+      running.fetch_sub(1);
+    });
+  }
+  bool progress = isatty(STDERR_FILENO);
+  while (running.load() > 0) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(250));
+    if (progress && total_bytes > 0) {
+      size_t done = processed.load();
+      std::cerr << std::format("\rSegmenting: {:3}% ({:.1f} MB/s)",
+                               done * 100 / total_bytes,
+                               done / 1e6 / secondsSince(start));
+    }
+  }
+  for (auto &worker : workers) {
+    worker.join();
+  }
+  if (progress) {
+    std::cerr << "\r" << std::string(40, ' ') << "\r";
+  }
+  double segment_seconds = secondsSince(start);
+
+  size_t chars = 0, han = 0;
+  std::vector<std::string_view> sentences;
+  for (const auto &result : results) {
+    chars += result.chars;
+    han += result.han;
+    std::string_view text = result.sentences;
+    while (!text.empty()) {
+      size_t newline = text.find('\n');
+      sentences.push_back(text.substr(0, newline));
+      text = text.substr(newline + 1);
+    }
+  }
+  std::cout << std::format(
+      "Segmented {} chars ({} Chinese) into {} sentences in {:.2f}s with {} "
+      "thread(s): {:.0f} chars/s\n",
+      chars, han, sentences.size(), segment_seconds, threads,
+      chars / segment_seconds);
+
+  // Train, dropping the oldest sentences while the snapshot is too large
+  start = Clock::now();
+  libime::HistoryBigram history;
+  train(history, sentences, 0);
+  size_t size = snapshotSize(history);
+  size_t first = 0;
+  if (max_size > 0 && size > max_size) {
+    // Smallest first whose snapshot fits
+    size_t low = 1, high = sentences.size();
+    while (low < high) {
+      size_t mid = low + (high - low) / 2;
+      train(history, sentences, mid);
+      if (snapshotSize(history) <= max_size) {
+        high = mid;
+      } else {
+        low = mid + 1;
+      }
+    }
+    first = low;
+    train(history, sentences, first);
+    size = snapshotSize(history);
+  }
+  std::cout << std::format("Trained on {} sentences ({} dropped for the size "
+                           "cap) in {:.2f}s\n",
+                           sentences.size() - first, first,
+                           secondsSince(start));
+
+  std::filesystem::path parent = std::filesystem::path(output).parent_path();
+  if (!parent.empty()) {
+    std::filesystem::create_directories(parent, ec);
+  }
+  std::ofstream out(output, std::ios::binary | std::ios::trunc);
+  history.save(out);
+  if (!out) {
+    std::cerr << std::format("Failed to write {}\n", output);
+    return 1;
+  }
+  std::cout << std::format("Wrote {} ({} bytes)\n", output, size);
+  return 0;
+}
+
+int dumpCommand(const char *path) {
+  std::ifstream in(path, std::ios::binary);
+  if (!in) {
+    std::cerr << std::format("Cannot open {}\n", path);
+    return 1;
+  }
+  libime::HistoryBigram history;
+  try {
+    history.load(in);
+  } catch (const std::exception &e) {
+    std::cerr << std::format("Failed to load {}: {}\n", path, e.what());
+    return 1;
+  }
+  history.dump(std::cout);
+  return 0;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  if (argc < 3) {
+    return usage(argv[0]);
+  }
+  std::string command = argv[1];
+  if (command == "train") {
+    return trainCommand(argc, argv);
+  }
+  if (command == "dump") {
+    return dumpCommand(argv[2]);
+  }
+  return usage(argv[0]);
+}
@@ -0,0 +1,82 @@
+#!/bin/sh
+# Two-stage profile-guided build trained on the replay corpus, and the key
+# latency of the same workload before and after.
+#
+# Usage: pgo_build.sh <work-dir> [rounds] [cmake-args]...
+#
+# Builds <work-dir>/baseline with plain release flags, then <work-dir>/pgo
+# twice: instrumented (PGO=GENERATE) and trained by replaying
+# data/replay/sessions.txt, then rebuilt from the profile with link-time
+# optimization (PGO=USE, ENABLE_LTO=ON). Finally both builds replay the
+# corpus and the per-key latencies are compared. Replays run with a private
+# HOME so the user's configuration and learned data stay out of it. The
+# pinyin dictionary must be installed (or LIBIME_DATA_DIR set).
+
+set -eu
+
+if [ $# -lt 1 ]; then
+    echo "Usage: $0 <work-dir> [rounds] [cmake-args]..." >&2
+    exit 1
+fi
+
+SOURCE_DIR=$(cd "$(dirname "$0")/.." && pwd)
+mkdir -p "$1"
+WORK_DIR=$(cd "$1" && pwd)
+ROUNDS=${2:-20}
+[ $# -gt 1 ] && shift 2 || shift 1
+CORPUS="$SOURCE_DIR/data/replay/sessions.txt"
+PROFILE_DIR="$WORK_DIR/profile"
+JOBS=$(nproc 2>/dev/null || echo 4)
+
+HOME_DIR=$(mktemp -d)
+trap 'rm -rf "$HOME_DIR"' EXIT INT TERM
+export HOME="$HOME_DIR"
+export XDG_CONFIG_HOME="$HOME/.config"
+export XDG_CACHE_HOME="$HOME/.cache"
+export XDG_DATA_HOME="$HOME/.local/share"
+export XDG_STATE_HOME="$HOME/.local/state"
+
+build() {
+    dir=$1
+    shift
+    cmake -S "$SOURCE_DIR" -B "$dir" -DCMAKE_BUILD_TYPE=Release \
+        -DBUILD_BENCHMARKS=ON "$@" >/dev/null
+    cmake --build "$dir" -j"$JOBS" --target ibus-engine-libime \
+        ibus-libime-bench >/dev/null
+}
+
+replay() {
+    "$1/ibus-libime-bench" replay "$CORPUS" "$ROUNDS"
+}
+
+echo "== Baseline build"
+build "$WORK_DIR/baseline" "$@"
+
+echo "== Stage 1: instrumented build and training"
+rm -rf "$PROFILE_DIR"
+build "$WORK_DIR/pgo" -DPGO=GENERATE -DPGO_PROFILE_DIR="$PROFILE_DIR" \
+    -DENABLE_LTO=OFF "$@"
+replay "$WORK_DIR/pgo" >/dev/null
+if ls "$PROFILE_DIR"/*.profraw >/dev/null 2>&1; then
+    llvm-profdata merge -o "$PROFILE_DIR/default.profdata" \
+        "$PROFILE_DIR"/*.profraw
+fi
+
+echo "== Stage 2: optimized build"
+build "$WORK_DIR/pgo" -DPGO=USE -DPGO_PROFILE_DIR="$PROFILE_DIR" \
+    -DENABLE_LTO=ON "$@"
+
+echo "== Baseline"
+replay "$WORK_DIR/baseline" | tee "$WORK_DIR/baseline.txt"
+echo "== PGO + LTO"
+replay "$WORK_DIR/pgo" | tee "$WORK_DIR/pgo.txt"
+
+per_key() {
+    sed -n 's/.*: \([0-9.]*\) us\/key$/\1/p' "$1"
+}
+BASE=$(per_key "$WORK_DIR/baseline.txt")
+OPT=$(per_key "$WORK_DIR/pgo.txt")
+awk -v base="$BASE" -v opt="$OPT" 'BEGIN {
+    printf "== Per key: %.2f us -> %.2f us (%+.1f%%)\n", base, opt,
+        (opt - base) * 100 / base
+}'
@@ -0,0 +1,166 @@
+// Build and benchmark the simplified-to-traditional conversion table.
+//
+// Usage:
+//   ibus-libime-s2t build <out.dat> <table.txt>...
+//   ibus-libime-s2t convert <s2t.dat> [text]...
+//   ibus-libime-s2t bench <s2t.dat> [iterations]
+//
+// Tables use the OpenCC text format: a simplified phrase or character, a tab,
+// then one or more space-separated traditional variants (the first one is
+// used). When several tables define the same key the earlier table wins, so
+// pass phrase tables before character tables.
+//
+// bench converts a fixed page of candidates the way the engine's lookup
+// table does: each candidate is built in the per-event arena and converted
+// into one reused buffer, and the arena is reset after every page.
+
+#include <charconv>
+#include <chrono>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <memory_resource>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "key_arena.h"
+#include "mapped_trie.h"
+#include "s2t_converter.h"
+
+namespace {
+
+// A typical candidate page: sentence candidates of decreasing length
+const char *const kBenchPage[] = {
+    "我们今天下午去图书馆学习", "我们今天下午", "我们今天", "我们",
+    "我门", "沃们", "我", "窝", "握",
+};
+
+int usage(const char *argv0) {
+  std::cerr << std::format("Usage:\n"
+                           "  {0} build <out.dat> <table.txt>...\n"
+                           "  {0} convert <s2t.dat> [text]...\n"
+                           "  {0} bench <s2t.dat> [iterations]  "
+                           "(converts a fixed sample page)\n",
+                           argv0);
+  return 1;
+}
+
+int build(int argc, char *argv[]) {
+  TrieBuilder builder;
+  for (int i = 3; i < argc; ++i) {
+    std::ifstream in(argv[i]);
+    if (!in) {
+      std::cerr << std::format("Cannot open {}\n", argv[i]);
+      return 1;
+    }
+    size_t added = 0;
+    std::string line;
+    while (std::getline(in, line)) {
+      size_t tab = line.find('\t');
+      if (line.empty() || line[0] == '#' || tab == std::string::npos) {
+        continue;
+      }
+      std::string key = line.substr(0, tab);
+      std::string value = line.substr(tab + 1);
+      value = value.substr(0, value.find(' '));
+      if (!key.empty() && !value.empty() && builder.insertIfAbsent(key, value)) {
+        ++added;
+      }
+    }
+    std::cout << std::format("{}: {} entries\n", argv[i], added);
+  }
+
+  if (!builder.write(argv[2], S2TConverter::kMagic)) {
+    std::cerr << std::format("Failed to write {}\n", argv[2]);
+    return 1;
+  }
+  std::cout << std::format("Wrote {} entries to {}\n", builder.size(), argv[2]);
+  return 0;
+}
+
+int convert(const MappedTrie &trie, int argc, char *argv[]) {
+  std::string out;
+  if (argc > 3) {
+    for (int i = 3; i < argc; ++i) {
+      out.clear();
+      S2TConverter::convert(trie, argv[i], out);
+      std::cout << out << "\n";
+    }
+    return 0;
+  }
+  std::string line;
+  while (std::getline(std::cin, line)) {
+    out.clear();
+    S2TConverter::convert(trie, line, out);
+    std::cout << out << "\n";
+  }
+  return 0;
+}
+
+int bench(const MappedTrie &trie, int argc, char *argv[]) {
+  size_t iterations = 100000;
+  if (argc > 3) {
+    std::string_view text = argv[3];
+    auto [end, ec] =
+        std::from_chars(text.data(), text.data() + text.size(), iterations);
+    if (ec != std::errc() || end != text.data() + text.size()) {
+      return usage(argv[0]);
+    }
+  }
+  if (iterations == 0) {
+    return 1;
+  }
+  std::string out;
+  size_t bytes = 0;
+
+  auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < iterations; ++i) {
+    KeyArena::Scope scope;
+    std::pmr::string text(KeyArena::getInstance().resource());
+    for (const char *candidate : kBenchPage) {
+      text.clear();
+      text += candidate;
+      out.clear();
+      S2TConverter::convert(trie, text, out);
+      bytes += out.size();
+    }
+  }
+  auto elapsed = std::chrono::duration<double, std::micro>(
+                     std::chrono::steady_clock::now() - start)
+                     .count();
+
+  std::cout << std::format("{} pages of {} candidates: {:.3f} us/page, "
+                           "{:.3f} us/candidate ({} bytes out)\n",
+                           iterations, std::size(kBenchPage),
+                           elapsed / iterations,
+                           elapsed / (iterations * std::size(kBenchPage)),
+                           bytes);
+  return 0;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  if (argc < 3) {
+    return usage(argv[0]);
+  }
+
+  std::string command = argv[1];
+  if (command == "build") {
+    return argc < 4 ? usage(argv[0]) : build(argc, argv);
+  }
+
+  MappedTrie trie;
+  if (!trie.open(argv[2], S2TConverter::kMagic)) {
+    std::cerr << std::format("{} is not a conversion table\n", argv[2]);
+    return 1;
+  }
+  if (command == "convert") {
+    return convert(trie, argc, argv);
+  }
+  if (command == "bench") {
+    return bench(trie, argc, argv);
+  }
+  return usage(argv[0]);
+}